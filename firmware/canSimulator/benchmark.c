@@ -0,0 +1,363 @@
+// SPI cost of the CAN driver hot path, measured on the MCP2517FD model (mcp2517fd_sim.c)
+//
+// Build and run from this directory:
+//   gcc -std=gnu99 -O2 -Wall -Wno-unknown-pragmas -I. -o canBenchmark benchmark.c mcp2517fd_sim.c ../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_api.c
+//   ./canBenchmark [smclkHz] > benchmark.csv
+//
+// One CSV line per operation, variant, payload and time stamp setting:
+//   load      DRV_CANFDSPI_TransmitChannelLoad into FIFO 1
+//   receive   DRV_CANFDSPI_ReceiveMessageGet from FIFO 2
+//   tef       DRV_CANFDSPI_TefMessageGet
+// Variant "crc" does the same with READ_CRC/WRITE_CRC: status and user address with
+// ReadByteArrayWithCRC, the object with Read/WriteByteArrayWithCRC, then the UINC as usual.
+// Variants "batch1" to "batch8" load with DRV_CANFDSPI_TransmitChannelLoadBatch, n objects per call
+// (as many whole batches as fit BENCH_DEPTH per round).
+// TX objects have no time stamp, load lines only come with timestamp 0.
+//
+// msgs_per_s is SPI bound: simulated SCK time at SMCLK / DRV_SPI_ClockDivider (24Mhz by default, the
+// MAX_THROUGHPUT profile) plus CANSIM_SPI_SETUP_NS per transaction; MCU cycles are not counted.
+// Exits with 1 if a call failed or returned the wrong data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mcp2517fd_sim.h"
+#include "../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_api.h"
+
+#define BENCH_DEPTH         16      // FIFO and TEF depth, messages per round
+#define BENCH_ROUNDS        8
+#define BENCH_CHANNEL_TX    CAN_FIFO_CH1
+#define BENCH_CHANNEL_RX    CAN_FIFO_CH2
+#define BENCH_SID           0x123
+#define BENCH_BATCH_MAX     8       // largest TransmitChannelLoadBatch measured
+
+typedef enum
+{
+    BENCH_LOAD,
+    BENCH_RECEIVE,
+    BENCH_TEF
+} BENCH_OPERATION;
+
+static const char* benchOperations[] = {"load", "receive", "tef"};
+
+// Payload of every DLC
+static const uint8_t benchPayloads[] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+static uint8_t benchErrors = 0;
+
+static CAN_FIFO_PLSIZE benchPayloadSize(uint8_t bytes)
+{
+    CAN_FIFO_PLSIZE size = CAN_PLSIZE_8;
+    while (DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) (CAN_DLC_8 + size)) < bytes)
+        size++;
+    return size;
+}
+
+static CAN_DLC benchDlc(uint8_t bytes)
+{
+    CAN_DLC dlc = CAN_DLC_0;
+    while (DRV_CANFDSPI_DlcToDataBytes(dlc) < bytes)
+        dlc++;
+    return dlc;
+}
+
+static void benchCheck(int8_t err, const char* step)
+{
+    if (err)
+    {
+        fprintf(stderr, "%s: %d\n", step, err);
+        benchErrors = 1;
+    }
+}
+
+// Controller from reset: FIFO 1 TX (and the TEF) or FIFO 2 RX behind filter 0 (accepts everything)
+// 16 objects of 64 bytes in both FIFOs would not fit in RAM
+static void benchConfigure(BENCH_OPERATION operation, uint8_t bytes, uint8_t timeStamp)
+{
+    uint8_t tef = operation == BENCH_TEF;
+    CAN_CONFIG config;
+    CAN_TX_FIFO_CONFIG txConfig;
+    CAN_RX_FIFO_CONFIG rxConfig;
+    CAN_TEF_CONFIG tefConfig;
+    CAN_FILTEROBJ_ID filter = {0};
+    CAN_MASKOBJ_ID mask = {0};
+
+    benchCheck(DRV_CANFDSPI_Reset(DRV_CANFDSPI_INDEX_0), "reset");
+    DRV_CANFDSPI_ConfigureObjectReset(&config);
+    config.IsoCrcEnable = 0;
+    config.StoreInTEF = tef;
+    benchCheck(DRV_CANFDSPI_Configure(DRV_CANFDSPI_INDEX_0, &config), "configure");
+    benchCheck(DRV_CANFDSPI_BitTimeConfigure(DRV_CANFDSPI_INDEX_0, CAN_500K_2M, CAN_SSP_MODE_AUTO, CAN_SYSCLK_20M), "bit time");
+    if (tef)
+    {
+        DRV_CANFDSPI_TefConfigureObjectReset(&tefConfig);
+        tefConfig.FifoSize = BENCH_DEPTH - 1;
+        tefConfig.TimeStampEnable = timeStamp;
+        benchCheck(DRV_CANFDSPI_TefConfigure(DRV_CANFDSPI_INDEX_0, &tefConfig), "tef");
+    }
+    if (operation == BENCH_RECEIVE)
+    {
+        DRV_CANFDSPI_ReceiveChannelConfigureObjectReset(&rxConfig);
+        rxConfig.FifoSize = BENCH_DEPTH - 1;
+        rxConfig.PayLoadSize = benchPayloadSize(bytes);
+        rxConfig.RxTimeStampEnable = timeStamp;
+        benchCheck(DRV_CANFDSPI_ReceiveChannelConfigure(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_RX, &rxConfig), "rx fifo");
+    }
+    else
+    {
+        DRV_CANFDSPI_TransmitChannelConfigureObjectReset(&txConfig);
+        txConfig.FifoSize = BENCH_DEPTH - 1;
+        txConfig.PayLoadSize = benchPayloadSize(bytes);
+        benchCheck(DRV_CANFDSPI_TransmitChannelConfigure(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_TX, &txConfig), "tx fifo");
+    }
+    benchCheck(DRV_CANFDSPI_FilterObjectConfigure(DRV_CANFDSPI_INDEX_0, CAN_FILTER0, &filter), "filter");
+    benchCheck(DRV_CANFDSPI_FilterMaskConfigure(DRV_CANFDSPI_INDEX_0, CAN_FILTER0, &mask), "mask");
+    benchCheck(DRV_CANFDSPI_FilterToFifoLink(DRV_CANFDSPI_INDEX_0, CAN_FILTER0, BENCH_CHANNEL_RX, true), "link");
+    benchCheck(DRV_CANFDSPI_TimeStampEnable(DRV_CANFDSPI_INDEX_0), "time stamp");
+    benchCheck(DRV_CANFDSPI_OperationModeSelect(DRV_CANFDSPI_INDEX_0, CAN_NORMAL_MODE), "normal mode");
+    // OPMOD follows once the bus is integrated
+    while (DRV_CANFDSPI_OperationModeGet(DRV_CANFDSPI_INDEX_0) == CAN_CONFIGURATION_MODE)
+        ;
+}
+
+static void benchTxObject(CAN_TX_MSGOBJ* txObj, uint8_t bytes, uint8_t seq)
+{
+    txObj->word[0] = 0;
+    txObj->word[1] = 0;
+    txObj->bF.id.SID = BENCH_SID;
+    txObj->bF.ctrl.DLC = benchDlc(bytes);
+    txObj->bF.ctrl.FDF = bytes > 8;
+    txObj->bF.ctrl.BRS = bytes > 8;
+    txObj->bF.ctrl.SEQ = seq;
+}
+
+// Status and user address of a FIFO (or the TEF) with READ_CRC
+static int8_t benchStatusWithCrc(uint16_t address, uint32_t status[2])
+{
+    bool crcIsCorrect;
+    int8_t err = DRV_CANFDSPI_ReadByteArrayWithCRC(DRV_CANFDSPI_INDEX_0, address, (uint8_t*) status, 8, false, &crcIsCorrect);
+    if (err)
+        return err;
+    return crcIsCorrect ? 0 : -10;
+}
+
+// TransmitChannelLoad with WRITE_CRC
+static int8_t benchLoadWithCrc(CAN_TX_MSGOBJ* txObj, const uint8_t* txd, uint8_t bytes)
+{
+    uint8_t object[8 + MAX_DATA_BYTES] = {0};
+    uint32_t status[2];
+    REG_CiFIFOSTA ciFifoSta;
+    REG_CiFIFOUA ciFifoUa;
+    int8_t err;
+
+    err = benchStatusWithCrc(cREGADDR_CiFIFOSTA + BENCH_CHANNEL_TX * CiFIFO_OFFSET, status);
+    if (err)
+        return err;
+    ciFifoSta.word = status[0];
+    ciFifoUa.word = status[1];
+    if (!ciFifoSta.txBF.TxNotFullIF)
+        return -6;
+    memcpy(object, txObj->byte, 8);
+    memcpy(object + 8, txd, bytes);
+    err = DRV_CANFDSPI_WriteByteArrayWithCRC(DRV_CANFDSPI_INDEX_0, cRAMADDR_START + ciFifoUa.bF.UserAddress, object,
+            8 + ((bytes + 3) & ~3), true);
+    if (err)
+        return err;
+    return DRV_CANFDSPI_TransmitChannelUpdate(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_TX, true);
+}
+
+// ReceiveMessageGet with READ_CRC
+static int8_t benchReceiveWithCrc(CAN_RX_MSGOBJ* rxObj, uint8_t* rxd, uint8_t bytes, uint8_t timeStamp)
+{
+    uint8_t object[12 + MAX_DATA_BYTES];
+    uint8_t header = timeStamp ? 12 : 8;
+    uint32_t status[2];
+    REG_CiFIFOSTA ciFifoSta;
+    REG_CiFIFOUA ciFifoUa;
+    bool crcIsCorrect;
+    int8_t err;
+
+    err = benchStatusWithCrc(cREGADDR_CiFIFOSTA + BENCH_CHANNEL_RX * CiFIFO_OFFSET, status);
+    if (err)
+        return err;
+    ciFifoSta.word = status[0];
+    ciFifoUa.word = status[1];
+    if (!ciFifoSta.rxBF.RxNotEmptyIF)
+        return -6;
+    err = DRV_CANFDSPI_ReadByteArrayWithCRC(DRV_CANFDSPI_INDEX_0, cRAMADDR_START + ciFifoUa.bF.UserAddress, object,
+            header + ((bytes + 3) & ~3), true, &crcIsCorrect);
+    if (err)
+        return err;
+    if (!crcIsCorrect)
+        return -10;
+    memcpy(rxObj->byte, object, header);
+    if (!timeStamp)
+        rxObj->word[2] = 0;
+    memcpy(rxd, object + header, bytes);
+    return DRV_CANFDSPI_ReceiveChannelUpdate(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_RX);
+}
+
+// TefMessageGet with READ_CRC
+static int8_t benchTefWithCrc(CAN_TEF_MSGOBJ* tefObj, uint8_t timeStamp)
+{
+    uint32_t status[2];
+    REG_CiTEFSTA ciTefSta;
+    bool crcIsCorrect;
+    int8_t err;
+
+    err = benchStatusWithCrc(cREGADDR_CiTEFSTA, status);
+    if (err)
+        return err;
+    ciTefSta.word = status[0];
+    if (!ciTefSta.bF.TEFNotEmptyIF)
+        return -6;
+    tefObj->word[2] = 0;
+    err = DRV_CANFDSPI_ReadByteArrayWithCRC(DRV_CANFDSPI_INDEX_0, cRAMADDR_START + (status[1] & 0xFFF), tefObj->byte,
+            timeStamp ? 12 : 8, true, &crcIsCorrect);
+    if (err)
+        return err;
+    if (!crcIsCorrect)
+        return -10;
+    return DRV_CANFDSPI_TefUpdate(DRV_CANFDSPI_INDEX_0);
+}
+
+// Fill FIFO 1 without measuring and let the bus send it
+static void benchSend(uint8_t bytes, const uint8_t* txd)
+{
+    CAN_TX_MSGOBJ txObj;
+    uint8_t i;
+
+    for (i = 0; i < BENCH_DEPTH; i++)
+    {
+        benchTxObject(&txObj, bytes, i);
+        benchCheck(DRV_CANFDSPI_TransmitChannelLoad(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_TX, &txObj, (uint8_t*) txd, bytes, true), "send");
+    }
+    CANSIM_BusIdle(1000000000ULL);
+}
+
+// Fill FIFO 2 from the bus
+static void benchInject(uint8_t bytes, const uint8_t* data)
+{
+    CANSIM_FRAME frame = {0};
+    uint8_t i;
+
+    frame.id = BENCH_SID;
+    frame.dlc = benchDlc(bytes);
+    frame.fdf = bytes > 8;
+    frame.brs = bytes > 8;
+    memcpy(frame.data, data, bytes);
+    for (i = 0; i < BENCH_DEPTH; i++)
+        benchCheck(CANSIM_BusInject(DRV_CANFDSPI_INDEX_0, &frame), "inject");
+}
+
+// batch: 0 loads one object per call (crc selects how), n > 0 n objects per TransmitChannelLoadBatch
+static void benchRun(BENCH_OPERATION operation, uint8_t crc, uint8_t batch, uint8_t bytes, uint8_t timeStamp)
+{
+    CAN_TX_MSGOBJ txObj;
+    CAN_TX_MSGOBJ txObjs[BENCH_BATCH_MAX];
+    CAN_RX_MSGOBJ rxObj;
+    CAN_TEF_MSGOBJ tefObj;
+    CANSIM_SPI_STATS spi = {0}, round;
+    uint8_t txd[MAX_DATA_BYTES], rxd[MAX_DATA_BYTES];
+    uint8_t* txds[BENCH_BATCH_MAX];
+    char variant[12];
+    uint64_t ns = 0, start;
+    uint32_t messages = 0;
+    uint8_t depth = batch ? BENCH_DEPTH / batch * batch : BENCH_DEPTH;
+    uint8_t r, i, j, loaded;
+    int8_t err;
+
+    for (i = 0; i < MAX_DATA_BYTES; i++)
+        txd[i] = (uint8_t) (i * 7 + bytes);
+    benchConfigure(operation, bytes, timeStamp);
+
+    for (r = 0; r < BENCH_ROUNDS; r++)
+    {
+        if (operation == BENCH_RECEIVE)
+            benchInject(bytes, txd);
+        else if (operation == BENCH_TEF)
+            benchSend(bytes, txd);
+        else
+            CANSIM_BusHold(true);
+
+        CANSIM_SpiStatsReset();
+        start = CANSIM_TimeNs();
+        for (i = 0; i < depth; i++)
+        {
+            if (batch)
+            {
+                for (j = 0; j < batch; j++)
+                {
+                    benchTxObject(&txObjs[j], bytes, i + j);
+                    txds[j] = txd;
+                }
+                err = DRV_CANFDSPI_TransmitChannelLoadBatch(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_TX, txObjs, txds, batch,
+                        &loaded, true);
+                if (!err && loaded != batch)
+                    err = -20;
+                i += batch - 1;
+            }
+            else if (operation == BENCH_LOAD)
+            {
+                benchTxObject(&txObj, bytes, i);
+                err = crc ? benchLoadWithCrc(&txObj, txd, bytes)
+                        : DRV_CANFDSPI_TransmitChannelLoad(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_TX, &txObj, txd, bytes, true);
+            }
+            else if (operation == BENCH_RECEIVE)
+            {
+                memset(rxd, 0, sizeof(rxd));
+                err = crc ? benchReceiveWithCrc(&rxObj, rxd, bytes, timeStamp)
+                        : DRV_CANFDSPI_ReceiveMessageGet(DRV_CANFDSPI_INDEX_0, BENCH_CHANNEL_RX, &rxObj, rxd, bytes);
+                if (!err && (rxObj.bF.id.SID != BENCH_SID || memcmp(rxd, txd, bytes)))
+                    err = -20;
+            }
+            else
+            {
+                err = crc ? benchTefWithCrc(&tefObj, timeStamp) : DRV_CANFDSPI_TefMessageGet(DRV_CANFDSPI_INDEX_0, &tefObj);
+                if (!err && (tefObj.bF.id.SID != BENCH_SID || tefObj.bF.ctrl.SEQ != i))
+                    err = -20;
+            }
+            benchCheck(err, benchOperations[operation]);
+        }
+        ns += CANSIM_TimeNs() - start;
+        messages += depth;
+        CANSIM_SpiStatsGet(DRV_CANFDSPI_INDEX_0, &round);
+        spi.transactions += round.transactions;
+        spi.bytes += round.bytes;
+
+        if (operation == BENCH_LOAD)
+        {
+            CANSIM_BusHold(false);
+            CANSIM_BusIdle(1000000000ULL);
+        }
+    }
+
+    if (batch)
+        snprintf(variant, sizeof(variant), "batch%u", batch);
+    else
+        snprintf(variant, sizeof(variant), "%s", crc ? "crc" : "plain");
+    printf("%s,%s,%u,%u,%lu,%.2f,%.2f,%.3f,%.0f\n", benchOperations[operation], variant, bytes, timeStamp,
+           (unsigned long) messages, (double) spi.transactions / messages, (double) spi.bytes / messages,
+           ns / 1000.0 / messages, messages * 1e9 / ns);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t smclkHz = argc > 1 ? strtoul(argv[1], NULL, 0) : 24000000;
+    uint8_t operation, crc, batch, payload, timeStamp;
+
+    CANSIM_Initialize();
+    DRV_SPI_ClockConfigure(smclkHz);
+    DRV_SPI_Initialize();
+
+    printf("operation,variant,payload,timestamp,messages,transactions_per_msg,bytes_per_msg,us_per_msg,msgs_per_s\n");
+    for (operation = BENCH_LOAD; operation <= BENCH_TEF; operation++)
+        for (crc = 0; crc < 2; crc++)
+            for (timeStamp = 0; timeStamp < (operation == BENCH_LOAD ? 1 : 2); timeStamp++)
+                for (payload = 0; payload < sizeof(benchPayloads); payload++)
+                    benchRun((BENCH_OPERATION) operation, crc, 0, benchPayloads[payload], timeStamp);
+    for (batch = 1; batch <= BENCH_BATCH_MAX; batch++)
+        for (payload = 0; payload < sizeof(benchPayloads); payload++)
+            benchRun(BENCH_LOAD, 0, batch, benchPayloads[payload], 0);
+    return benchErrors;
+}
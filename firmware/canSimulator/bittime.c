@@ -0,0 +1,194 @@
+// Bit time table check: every CAN_BITTIME_SETUP at every CAN_SYSCLK_SPEED, on the MCP2517FD model
+//
+// Build and run from this directory:
+//   gcc -std=gnu99 -Wall -Wno-unknown-pragmas -I. -o canBitTime bittime.c mcp2517fd_sim.c ../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_api.c
+//   ./canBitTime
+//
+// DRV_CANFDSPI_BitTimeConfigure writes CiNBTCFG/CiDBTCFG, the registers are decoded back into bit rates
+// and sample points. A setup it accepts has to be within DRV_CANFDSPI_BIT_RATE_TOLERANCE of the requested
+// rates; one it refuses must not be reachable by any BRP and segment split the registers can hold.
+// The registers also have to match what the per-clock switch tables the calculator replaced wrote, but
+// for the differences listed in bitTimeChanges. Prints one line per setup and clock, exits with 1 on a
+// mismatch.
+
+#include <stdio.h>
+#include "mcp2517fd_sim.h"
+#include "../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_api.h"
+
+// Nominal and data bit rate [kbit/s] of each CAN_BITTIME_SETUP, as named
+static const struct {
+    const char* name;
+    uint16_t nominal;
+    uint16_t data;
+} bitTimeSetups[] = {
+    {"CAN_500K_1M", 500, 1000}, {"CAN_500K_2M", 500, 2000}, {"CAN_500K_3M", 500, 3000},
+    {"CAN_500K_4M", 500, 4000}, {"CAN_500K_5M", 500, 5000}, {"CAN_500K_6M7", 500, 6666},
+    {"CAN_500K_8M", 500, 8000}, {"CAN_500K_10M", 500, 10000}, {"CAN_250K_500K", 250, 500},
+    {"CAN_250K_833K", 250, 833}, {"CAN_250K_1M", 250, 1000}, {"CAN_250K_1M5", 250, 1500},
+    {"CAN_250K_2M", 250, 2000}, {"CAN_250K_3M", 250, 3000}, {"CAN_250K_4M", 250, 4000},
+    {"CAN_1000K_4M", 1000, 4000}, {"CAN_1000K_8M", 1000, 8000}, {"CAN_125K_500K", 125, 500}
+};
+
+static const uint32_t sysclks[] = {40000000, 20000000, 10000000};  // CAN_SYSCLK_SPEED order
+
+typedef struct {
+    uint32_t nbtcfg;
+    uint32_t dbtcfg;
+    uint32_t tdc;
+} BIT_TIME_WORDS;
+
+// CiNBTCFG, CiDBTCFG and CiTDC the switch tables wrote (CAN_SSP_MODE_AUTO), by CAN_SYSCLK_SPEED and
+// CAN_BITTIME_SETUP; all 0: the tables returned -1
+static const BIT_TIME_WORDS bitTimeTables[3][CAN_125K_500K + 1] = {
+    {   // 40 MHz
+        {0x003E0F0F, 0x001E0707, 0x00021F00}, {0x003E0F0F, 0x000E0303, 0x00020F00}, {0x003E0F0F, 0x00080202, 0x00020900},
+        {0x003E0F0F, 0x00060101, 0x00020700}, {0x003E0F0F, 0x00040101, 0x00020500}, {0x003E0F0F, 0x00030000, 0x00020400},
+        {0x003E0F0F, 0x00020000, 0x00020301}, {0x003E0F0F, 0x00010000, 0x00020200}, {0x007E1F1F, 0x011E0707, 0x00001F00},
+        {0x007E1F1F, 0x01110404, 0x00001200}, {0x007E1F1F, 0x001E0707, 0x00021F00}, {0x007E1F1F, 0x00120505, 0x00021300},
+        {0x007E1F1F, 0x000E0303, 0x00020F00}, {0x007E1F1F, 0x00080202, 0x00020900}, {0x007E1F1F, 0x00060101, 0x00020700},
+        {0x001E0707, 0x00060101, 0x00020700}, {0x001E0707, 0x00020000, 0x00020301}, {0x00FE3F3F, 0x011E0707, 0x00001F00},
+    },
+    {   // 20 MHz
+        {0x001E0707, 0x000E0303, 0x00020F00}, {0x001E0707, 0x00060101, 0x00020700}, {0, 0, 0},
+        {0x001E0707, 0x00020000, 0x00020300}, {0x001E0707, 0x00010000, 0x00020200}, {0, 0, 0},
+        {0, 0, 0}, {0, 0, 0}, {0x003E0F0F, 0x001E0707, 0x00001F00},
+        {0x003E0F0F, 0x00110404, 0x00001200}, {0x003E0F0F, 0x000E0303, 0x00020F00}, {0x003E0F0F, 0x00080202, 0x00020900},
+        {0x003E0F0F, 0x00060101, 0x00020700}, {0, 0, 0}, {0x003E0F0F, 0x00020000, 0x00020300},
+        {0x000E0303, 0x00020000, 0x00020300}, {0, 0, 0}, {0x007E1F1F, 0x001E0707, 0x00001F00},
+    },
+    {   // 10 MHz
+        {0x000E0303, 0x00060101, 0x00020700}, {0x000E0303, 0x00020000, 0x00020300}, {0, 0, 0},
+        {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+        {0, 0, 0}, {0, 0, 0}, {0x001E0707, 0x000E0303, 0x00000F00},
+        {0x001E0707, 0x00070202, 0x00000800}, {0x001E0707, 0x00060101, 0x00020700}, {0, 0, 0},
+        {0x001E0707, 0x00020000, 0x00020300}, {0, 0, 0}, {0, 0, 0},
+        {0, 0, 0}, {0, 0, 0}, {0x003E0F0F, 0x000E0303, 0x00000F00},
+    },
+};
+
+// Where the calculator deliberately writes something else; words all 0: it returns -1
+static const struct {
+    CAN_SYSCLK_SPEED clk;
+    CAN_BITTIME_SETUP setup;
+    BIT_TIME_WORDS words;
+    const char* why;
+} bitTimeChanges[] = {
+    // 13 or 26 time quanta per bit: 2.6% above the named data rate, other nodes at the exact rate fail
+    {CAN_SYSCLK_40M, CAN_500K_3M, {0, 0, 0}, "table ran 3077k"},
+    {CAN_SYSCLK_40M, CAN_250K_1M5, {0, 0, 0}, "table ran 1538k"},
+    {CAN_SYSCLK_40M, CAN_250K_3M, {0, 0, 0}, "table ran 3077k"},
+    {CAN_SYSCLK_20M, CAN_250K_1M5, {0, 0, 0}, "table ran 1538k"},
+    // Sample point at or before 80%: 4 of 6 time quanta, the table had 5 of 6
+    {CAN_SYSCLK_40M, CAN_500K_6M7, {0x003E0F0F, 0x00020101, 0x00020300}, "table sp 83.3%"},
+    // TDCValue is measured in auto mode, the table wrote 1
+    {CAN_SYSCLK_40M, CAN_500K_8M, {0x003E0F0F, 0x00020000, 0x00020300}, "table TDCV 1"},
+    {CAN_SYSCLK_40M, CAN_1000K_8M, {0x001E0707, 0x00020000, 0x00020300}, "table TDCV 1"},
+    // TDCO in SYSCLK periods with a data BRP of 1, the table counted time quanta (TDC is off below 1 Mbit/s)
+    {CAN_SYSCLK_40M, CAN_250K_500K, {0x007E1F1F, 0x011E0707, 0x00003E00}, "table TDCO 31"},
+    {CAN_SYSCLK_40M, CAN_250K_833K, {0x007E1F1F, 0x01110404, 0x00002400}, "table TDCO 18"},
+    {CAN_SYSCLK_40M, CAN_125K_500K, {0x00FE3F3F, 0x011E0707, 0x00003E00}, "table TDCO 31"},
+};
+
+// Expected words of a setup, and why they differ from the tables (NULL: they don't)
+static const BIT_TIME_WORDS* bitTimeExpected(uint8_t clk, uint8_t setup, const char** why)
+{
+    uint8_t i;
+
+    for (i = 0; i < sizeof(bitTimeChanges) / sizeof(bitTimeChanges[0]); i++)
+        if (bitTimeChanges[i].clk == clk && bitTimeChanges[i].setup == setup)
+        {
+            *why = bitTimeChanges[i].why;
+            return &bitTimeChanges[i].words;
+        }
+    *why = NULL;
+    return &bitTimeTables[clk][setup];
+}
+
+// Bit rate error [1/1000] of brp+1 SYSCLK periods per quantum and ntq quanta per bit
+static uint32_t bitTimeError(uint32_t sysclk, uint32_t bps, uint32_t brp, uint32_t ntq)
+{
+    uint64_t reached = (uint64_t) (brp + 1) * ntq * bps;
+    uint64_t error = reached > sysclk ? reached - sysclk : sysclk - reached;
+
+    return (uint32_t) (error * 1000 / sysclk);
+}
+
+// Whether any register setting reaches bps within the tolerance; TSEG1/TSEG2 bound the quanta per bit
+static int bitTimeReachable(uint32_t sysclk, uint32_t bps, uint32_t tseg1Max, uint32_t tseg2Max)
+{
+    uint32_t brp, ntq;
+
+    for (brp = 0; brp < 256; brp++)
+        for (ntq = 4; ntq <= 1 + tseg1Max + tseg2Max; ntq++)
+            if ((uint64_t) (brp + 1) * ntq * bps * 1000 >= (uint64_t) sysclk * (1000 - DRV_CANFDSPI_BIT_RATE_TOLERANCE)
+                && (uint64_t) (brp + 1) * ntq * bps * 1000 <= (uint64_t) sysclk * (1000 + DRV_CANFDSPI_BIT_RATE_TOLERANCE))
+                return 1;
+    return 0;
+}
+
+int main(void)
+{
+    REG_CiNBTCFG nbtcfg;
+    REG_CiDBTCFG dbtcfg;
+    uint32_t tdc;
+    const BIT_TIME_WORDS* expected;
+    const char* why;
+    uint32_t sysclk, nominalBps, dataBps, nominalNtq, dataNtq;
+    uint8_t setup, clk;
+    int8_t rc;
+    int errors = 0, ok;
+
+    CANSIM_Initialize();
+    DRV_SPI_Initialize();
+
+    printf("setup          sysclk   nominal              data\n");
+    for (clk = 0; clk < sizeof(sysclks) / sizeof(sysclks[0]); clk++)
+    {
+        sysclk = sysclks[clk];
+        for (setup = 0; setup < sizeof(bitTimeSetups) / sizeof(bitTimeSetups[0]); setup++)
+        {
+            nominalBps = bitTimeSetups[setup].nominal * 1000UL;
+            dataBps = bitTimeSetups[setup].data * 1000UL;
+            DRV_CANFDSPI_Reset(DRV_CANFDSPI_INDEX_0);
+            rc = DRV_CANFDSPI_BitTimeConfigure(DRV_CANFDSPI_INDEX_0, (CAN_BITTIME_SETUP) setup, CAN_SSP_MODE_AUTO,
+                                               (CAN_SYSCLK_SPEED) clk);
+            expected = bitTimeExpected(clk, setup, &why);
+            if (rc)
+            {
+                // Refused: right only if one of the phases can't be reached, and as listed
+                ok = !bitTimeReachable(sysclk, nominalBps, 256, 128) || !bitTimeReachable(sysclk, dataBps, 32, 16);
+                printf("%-14s %2luMHz  refused%s%s%s%s\n", bitTimeSetups[setup].name, (unsigned long) (sysclk / 1000000),
+                       why ? "  (" : "", why ? why : "", why ? ")" : "",
+                       !ok ? "  MISMATCH: reachable" : expected->nbtcfg ? "  MISMATCH: table" : "");
+                errors |= !ok || expected->nbtcfg;
+                continue;
+            }
+            nbtcfg.word = CANSIM_PeekWord(DRV_CANFDSPI_INDEX_0, cREGADDR_CiNBTCFG);
+            dbtcfg.word = CANSIM_PeekWord(DRV_CANFDSPI_INDEX_0, cREGADDR_CiDBTCFG);
+            tdc = CANSIM_PeekWord(DRV_CANFDSPI_INDEX_0, cREGADDR_CiTDC);
+            nominalNtq = 1 + (nbtcfg.bF.TSEG1 + 1) + (nbtcfg.bF.TSEG2 + 1);
+            dataNtq = 1 + (dbtcfg.bF.TSEG1 + 1) + (dbtcfg.bF.TSEG2 + 1);
+            ok = bitTimeError(sysclk, nominalBps, nbtcfg.bF.BRP, nominalNtq) <= DRV_CANFDSPI_BIT_RATE_TOLERANCE
+                 && bitTimeError(sysclk, dataBps, dbtcfg.bF.BRP, dataNtq) <= DRV_CANFDSPI_BIT_RATE_TOLERANCE;
+            printf("%-14s %2luMHz  %7.1fk sp %4.1f%%  %7.1fk sp %4.1f%%%s%s%s%s\n", bitTimeSetups[setup].name,
+                   (unsigned long) (sysclk / 1000000),
+                   sysclk / 1000.0 / ((nbtcfg.bF.BRP + 1) * nominalNtq), 100.0 * (nbtcfg.bF.TSEG1 + 2) / nominalNtq,
+                   sysclk / 1000.0 / ((dbtcfg.bF.BRP + 1) * dataNtq), 100.0 * (dbtcfg.bF.TSEG1 + 2) / dataNtq,
+                   why ? "  (" : "", why ? why : "", why ? ")" : "", ok ? "" : "  MISMATCH: bit rate");
+            errors |= !ok;
+            if (nbtcfg.word != expected->nbtcfg || dbtcfg.word != expected->dbtcfg || tdc != expected->tdc)
+            {
+                printf("  MISMATCH: table %08lX %08lX %08lX, written %08lX %08lX %08lX\n",
+                       (unsigned long) expected->nbtcfg, (unsigned long) expected->dbtcfg, (unsigned long) expected->tdc,
+                       (unsigned long) nbtcfg.word, (unsigned long) dbtcfg.word, (unsigned long) tdc);
+                errors = 1;
+            }
+        }
+    }
+
+    // Past the end of the table
+    rc = DRV_CANFDSPI_BitTimeConfigure(DRV_CANFDSPI_INDEX_0, (CAN_BITTIME_SETUP) (CAN_125K_500K + 1), CAN_SSP_MODE_AUTO,
+                                       CAN_SYSCLK_20M);
+    errors |= rc != -1;
+    return errors;
+}
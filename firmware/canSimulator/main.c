@@ -0,0 +1,98 @@
+// Host run of the mcp2517.h CAN path against the MCP2517FD model (mcp2517fd_sim.c)
+//
+// Build and run from this directory:
+//   gcc -std=gnu99 -Wall -Wno-unknown-pragmas -I. -o canSim main.c mcp2517fd_sim.c ../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_api.c
+//   ./canSim
+//
+// The driver and mcp2517.h are compiled as they are for the MSP430 (msp430.h here stands in for TI's).
+// Configures the controller, sends scheduler and packed frames, matches their TEF entries, receives an
+// injected frame through the nINT chain, recovers from bus-off and prints what it cost on SPI.
+
+#include <stdio.h>
+#include "../earlyConfigurationAndTests/helper.h"
+#include "../earlyConfigurationAndTests/mcp2517.h"
+#include "mcp2517fd_sim.h"
+
+static void printSpi(const char* step)
+{
+    CANSIM_SPI_STATS spi;
+    CANSIM_SpiStatsGet(DRV_CANFDSPI_INDEX_0, &spi);
+    printf("%-12s %6lu transactions %7lu bytes %8.1f us SCK %10.1f us simulated\n", step,
+           (unsigned long) spi.transactions, (unsigned long) spi.bytes, spi.busyNs / 1000.0, CANSIM_TimeNs() / 1000.0);
+    CANSIM_SpiStatsReset();
+}
+
+int main(void)
+{
+    CANSIM_FRAME frames[CANSIM_BUS_LOG_LENGTH];
+    CANSIM_FRAME rx = {0};
+    CAN_RX_FRAME frame;
+    uint16_t distance = 1234;
+    uint8_t alert[2] = {0xA1, 0x01};
+    uint8_t n, i, received = 0, latencyOk;
+
+    CANSIM_Initialize();
+    initializeGPIO();
+    configureClockProfile(CLOCK_PROFILE_MAX_THROUGHPUT);
+    canStbyState(OFF);
+    initializeTimebase();
+    __enable_interrupt();
+    DRV_SPI_Initialize();
+
+    printf("configure: %s\n", canConfigure() ? "restored" : "captured");
+    canFilterConfigure();
+    canRxInterruptEnable();
+    initializeRAMAndSelectNormalMode();
+    printf("mode %d, RAM init %lu us\n", DRV_CANFDSPI_OperationModeGet(DRV_CANFDSPI_INDEX_0), canRamInitMicros);
+    printSpi("bring-up");
+
+    canTefInitialize();
+    configureTBC();
+    canSyncSample();
+    printSpi("sync");
+
+    canTxSubmit(CAN_TX_CLASS_ALERT, alert, sizeof(alert), (uint16_t) (timebaseMicros() / 1000));
+    canPackAdd(CAN_PACK_ULTRASOUND, (uint8_t*) &distance, sizeof(distance), timebaseMicros(), 1);
+    printSpi("transmit");
+
+    CANSIM_BusIdle(10000000);
+    canTefService();
+    printSpi("tef");
+    n = CANSIM_BusLog(DRV_CANFDSPI_INDEX_0, frames, CANSIM_BUS_LOG_LENGTH);
+    for (i = 0; i < n; i++)
+        printf("sent 0x%03lX dlc %u seq %u at %.1f us\n", (unsigned long) frames[i].id, frames[i].dlc, frames[i].seq,
+               frames[i].sofNs / 1000.0);
+    printf("load to bus: alert %lu us, pack %lu us (lost %u, unmatched %u)\n",
+           (unsigned long) canLatencyAverage(&canTefLoadToBus[CAN_TX_CLASS_ALERT]),
+           (unsigned long) canLatencyAverage(&canTefLoadToBus[CAN_PACK_SEQ]), canTefLost, canTefUnmatched);
+    // Both frames went out within a millisecond of being loaded, and nothing else did
+    latencyOk = canTefLoadToBus[CAN_TX_CLASS_ALERT].maxUs < 1000 && canTefLoadToBus[CAN_PACK_SEQ].maxUs < 1000
+            && n == 2 && !canTefUnmatched;
+
+    // A frame for FIFO 2 from another node: nINT falls, Port1_ISR runs the chain
+    rx.id = 0x305;
+    rx.dlc = CAN_DLC_8;
+    for (i = 0; i < 8; i++)
+        rx.data[i] = i;
+    printf("inject: %d\n", CANSIM_BusInject(DRV_CANFDSPI_INDEX_0, &rx));
+    while (canRxRingGet(&frame))
+    {
+        printf("received 0x%03X filter %u data %02X..%02X ts %lu\n", (unsigned) frame.obj.bF.id.SID,
+               (unsigned) frame.obj.bF.ctrl.FilterHit, frame.data[0], frame.data[7], (unsigned long) frame.obj.bF.timeStamp);
+        received++;
+    }
+    printSpi("receive");
+
+    // Bus-off that only a restart clears; filters and TBC have to come back with the controller
+    canBusInitialize();
+    CANSIM_ErrorCountsSet(DRV_CANFDSPI_INDEX_0, 256, 0, 0);
+    while (canBusService(timebaseMicros()) != CAN_BUS_ACTIVE)
+        CANSIM_Advance(1000000);
+    printf("restarts %u, recovered in %lu us, sync %u\n", canBusHealth.restarts,
+           (unsigned long) canBusHealth.lastRecoverUs, canSyncState);
+    printf("inject: %d\n", CANSIM_BusInject(DRV_CANFDSPI_INDEX_0, &rx));
+    while (canRxRingGet(&frame))
+        received++;
+    printSpi("restart");
+    return received == 2 && canSyncState && latencyOk ? 0 : 1;
+}
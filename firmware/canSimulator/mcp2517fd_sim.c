@@ -0,0 +1,1750 @@
+// Include files
+#include <stdio.h>
+#include <string.h>
+#include "mcp2517fd_sim.h"
+#include "../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_api.h"
+
+// Host model of the MCP2517FD, see mcp2517fd_sim.h
+// Not modelled: ECC, bit timing (frames take the CANSIM_*_BPS rates), stuff bits, arbitration
+// against other nodes (CANSIM_BusHold stands in), TXQ priority order (it is sent in FIFO order),
+// one-shot/retransmission attempts, GPIO pins and the clock output
+
+#define SIM_SFR_SIZE            0x18
+#define SIM_SESSION_LENGTH      (3 + 255 * 4 + 2)
+#define SIM_NO_EVENT            UINT64_MAX
+
+// Register bits the model acts on, see drv_canfdspi_register.h for the full layouts
+#define SIM_CICON_RESET         0x04980760UL
+#define SIM_CICON_STEF          0x08        // byte 2
+#define SIM_CICON_TXQEN         0x10        // byte 2
+#define SIM_CICON_ABAT          0x08        // byte 3
+#define SIM_TSCON_TBCEN         0x01        // byte 2
+
+#define SIM_INT_TXIF            0x0001
+#define SIM_INT_RXIF            0x0002
+#define SIM_INT_TBCIF           0x0004
+#define SIM_INT_MODIF           0x0008
+#define SIM_INT_TEFIF           0x0010
+#define SIM_INT_SPICRCIF        0x0200
+#define SIM_INT_TXATIF          0x0400
+#define SIM_INT_RXOVIF          0x0800
+#define SIM_INT_SERRIF          0x1000
+#define SIM_INT_CERRIF          0x2000
+#define SIM_INT_WAKIF           0x4000
+#define SIM_INT_IVMIF           0x8000
+// Flags the host clears by writing 0, the others follow the FIFOs
+#define SIM_INT_CLEARABLE       (SIM_INT_TBCIF|SIM_INT_MODIF|SIM_INT_SERRIF|SIM_INT_CERRIF|SIM_INT_WAKIF|SIM_INT_IVMIF)
+
+#define SIM_FIFOCON_RXTSEN      0x20        // byte 0
+#define SIM_FIFOCON_TXEN        0x80        // byte 0
+#define SIM_FIFOCON_UINC        0x01        // byte 1
+#define SIM_FIFOCON_TXREQ       0x02        // byte 1
+#define SIM_FIFOCON_FRESET      0x04        // byte 1
+#define SIM_FIFOCON_RESET       0x00600000UL
+#define SIM_FIFOSTA_RXOVIF      0x08        // byte 0
+#define SIM_FIFOSTA_TXATIF      0x10
+#define SIM_FIFOSTA_TXABT       0x80
+#define SIM_FIFOSTA_TXFLAGS     0xF0        // TXATIF, TXERR, TXLARB, TXABT
+#define SIM_FIFOUA_CONFIG       0x00000FFCUL  // what CiFIFOUA reads in Configuration Mode: past the end of RAM
+
+#define SIM_TEFCON_TEFTSEN      0x20        // byte 0
+#define SIM_TEFSTA_OVIF         0x08
+
+#define SIM_OSC_RESET           0x00000460UL
+#define SIM_OSC_OSCDIS          0x04        // byte 0
+#define SIM_OSC_READY           0x15        // byte 1: PLLRDY, OSCRDY, SCLKRDY
+#define SIM_OSC_PLLEN           0x01        // byte 0
+#define SIM_CRC_FLAGS           0x03        // byte 2: CRCERRIF, FERRIF
+#define SIM_CRC_CRCERRIF        0x01
+#define SIM_CRC_FERRIF          0x02
+#define SIM_DEVID               0x14        // MCP2518FD, REV 4
+
+#define SIM_OBJ_IDE             0x10        // control word byte 0
+#define SIM_OBJ_BRS             0x40
+#define SIM_OBJ_FDF             0x80
+
+#define SIM_MODE_NORMAL         CAN_NORMAL_MODE
+#define SIM_MODE_SLEEP          CAN_SLEEP_MODE
+#define SIM_MODE_CONFIG         CAN_CONFIGURATION_MODE
+
+// Transceiver standby (PJ.3, CAN_STBY in helper.h) on the node of controller 0
+#define SIM_STBY_PIN            BIT3
+// nINT of controller 0 on P1.2
+#define SIM_NINT_PIN            BIT2
+
+//! FIFO, TXQ or TEF as the controller tracks it once RAM is allocated
+
+typedef struct {
+    uint16_t base;      // RAM offset of object 0
+    uint8_t size;       // bytes per object
+    uint8_t depth;
+    uint8_t head;       // next object written (TX: by the host, RX/TEF: by the controller)
+    uint8_t tail;       // next object read (TX: sent by the controller, RX/TEF: by the host)
+    uint8_t count;
+    uint8_t allocated;
+} SIM_FIFO;
+
+//! One controller
+
+typedef struct {
+    uint8_t reg[cRAMADDR_START];
+    uint8_t ram[cRAM_SIZE];
+    uint8_t sfr[SIM_SFR_SIZE];
+    uint8_t mode;
+    uint8_t modeRequest;        // REQOP waiting for bus integration
+    uint64_t modeAtNs;          // when OPMOD follows it, SIM_NO_EVENT: nothing pending
+    uint8_t allocated;
+    SIM_FIFO fifo[CAN_FIFO_TOTAL_CHANNELS];
+    SIM_FIFO tef;
+    uint8_t filterHit;
+    // Bus
+    int8_t txChannel;           // -1: not transmitting
+    uint64_t txEndNs;
+    CANSIM_FRAME txFrame;
+    uint16_t tec;
+    uint8_t rec;
+    uint64_t recoverAtNs;       // bus-off: 0 stays off
+    // Time base counter, counts from tbcBase at tbcBaseNs
+    uint32_t tbcBase;
+    uint64_t tbcBaseNs;
+    uint64_t oscReadyNs;
+    // SPI
+    uint16_t spiClockDivider;   // DRV_SPI_DeviceConfigure, 0 follows the clock profile
+    uint16_t crcLast;
+    uint8_t crcCorrupt;
+    CANSIM_SPI_STATS spi;
+    CANSIM_DEVICE_STATS stats;
+    CANSIM_FRAME log[CANSIM_BUS_LOG_LENGTH];
+    uint32_t logCount;
+} SIM_DEVICE;
+
+static SIM_DEVICE simDevices[DRV_CANFDSPI_INDEX_COUNT];
+static uint64_t simNow = 0;
+static uint8_t simHold = 0;
+
+// SPI instruction in progress (chip select asserted)
+static struct {
+    int8_t device;              // -1: CS released
+    uint16_t position;
+    uint8_t instruction;
+    uint16_t address;
+    uint16_t crcLength;         // READ_CRC: data bytes
+    uint8_t buffer[SIM_SESSION_LENGTH];
+} simSession = {-1};
+static uint8_t simSpiLatch = 0;
+
+// MCU side
+static uint32_t simSmclkHz = CANSIM_SMCLK_RESET_HZ;
+static uint16_t simClockDivider = 1;
+static uint8_t simGie = 0;
+static uint8_t simInIsr = 0;
+static uint8_t simWake = 0;
+static uint8_t simSleepWarned = 0;
+static uint64_t simTb0Count = 0;        // ticks since TBCLR, 64 bit
+static uint64_t simTb0OriginNs = 0;     // simulated time at which the count was simTb0OriginCount
+static uint64_t simTb0OriginCount = 0;
+static volatile uint16_t simTb0R = 0;
+static DRV_SPI_BUS_MODE simBusMode = DRV_SPI_BUS_NONE;
+
+// Transaction queue, as drv_spi.c: 15 bit sequences, run as if from the eUSCI_A0 ISR
+#define SIM_QUEUE_SEQUENCE_MASK 0x7FFF
+static DRV_SPI_TRANSACTION simQueue[DRV_SPI_TRANSACTION_QUEUE_LENGTH];
+static uint16_t simQueueHead = 0;
+static uint16_t simQueueTail = 0;
+
+// Registers of msp430.h
+volatile uint16_t PM5CTL0, WDTCTL, SFRIFG1, FRCTL0;
+volatile uint16_t CSCTL0, CSCTL1, CSCTL2, CSCTL3, CSCTL4, CSCTL5;
+volatile uint8_t CSCTL0_H;
+volatile uint16_t TA0CTL, TA0EX0, TA0CCTL1, TA0CCR1, TA0IV, TA0R;
+volatile uint16_t TB0CTL, TB0EX0, TB0IV, TB0CCTL1, TB0CCR1;
+volatile uint16_t UCA0CTLW0, UCA0BRW, UCA0MCTLW, UCA0STATW, UCA0IFG, UCA0IE, UCA0TXBUF, UCA0RXBUF;
+volatile uint8_t UCA0CTL1;
+volatile uint16_t UCB0CTLW0, UCB0BRW, UCB0STATW;
+volatile uint8_t UCB0CTL1;
+volatile uint8_t P1IN, P1OUT, P1DIR, P1SEL0, P1SEL1, P1IE, P1IES, P1IFG;
+volatile uint16_t P1IV;
+volatile uint8_t P2IN, P2OUT, P2DIR, P2SEL0, P2SEL1;
+volatile uint16_t PJOUT, PJDIR, PJSEL0, PJSEL1;
+
+// Interrupt handlers of the firmware, if it has them
+extern void Port1_ISR(void) __attribute__((weak));
+extern void Timer0_B1_ISR(void) __attribute__((weak));
+
+static void sim_run_until(uint64_t ns);
+static void sim_dispatch(void);
+static void sim_bus_start(SIM_DEVICE* dev);
+
+static uint32_t sim_get32(const uint8_t* p)
+{
+    return p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void sim_put32(uint8_t* p, uint32_t value)
+{
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+static uint8_t* sim_fifo_con(SIM_DEVICE* dev, uint8_t channel)
+{
+    return &dev->reg[cREGADDR_CiFIFOCON + channel * CiFIFO_OFFSET];
+}
+
+// TXQ when enabled, FIFOs with TXEN
+static uint8_t sim_fifo_tx(SIM_DEVICE* dev, uint8_t channel)
+{
+    if (channel == CAN_TXQUEUE_CH0)
+        return (dev->reg[cREGADDR_CiCON + 2] & SIM_CICON_TXQEN) != 0;
+    return (sim_fifo_con(dev, channel)[0] & SIM_FIFOCON_TXEN) != 0;
+}
+
+// Time base counter at ns (not before the last TBC/TSCON write)
+static uint32_t sim_tbc_at(SIM_DEVICE* dev, uint64_t ns)
+{
+    uint8_t* tscon = &dev->reg[cREGADDR_CiTSCON];
+    uint64_t tickNs;
+    if (!(tscon[2] & SIM_TSCON_TBCEN) || dev->mode == SIM_MODE_SLEEP || ns < dev->tbcBaseNs)
+        return dev->tbcBase;
+    tickNs = (((tscon[0] | (tscon[1] << 8)) & 0x3FF) + 1) * (1000000000ULL / CANSIM_SYSCLK_HZ);
+    return dev->tbcBase + (uint32_t) ((ns - dev->tbcBaseNs) / tickNs);
+}
+
+static uint32_t sim_tbc(SIM_DEVICE* dev) {return sim_tbc_at(dev, simNow);}
+
+static void sim_tbc_fold(SIM_DEVICE* dev)
+{
+    dev->tbcBase = sim_tbc(dev);
+    dev->tbcBaseNs = simNow;
+}
+
+// Derived register fields: OPMOD, TBC, FIFO/TEF status and UA, interrupt flags and codes, TREC,
+// oscillator and CRC status; then nINT
+static void sim_refresh(SIM_DEVICE* dev)
+{
+    uint32_t rxif = 0, txif = 0, rxovif = 0, txatif = 0, txreq = 0, bit, trec;
+    uint16_t flags, enables, stored;
+    uint8_t channel, sta, code, rxcode = 0x40, txcode = 0x40, icode = 0x40;
+    uint8_t* con;
+    SIM_FIFO* f;
+
+    dev->reg[cREGADDR_CiCON + 2] = (dev->reg[cREGADDR_CiCON + 2] & 0x1F) | (dev->mode << 5);
+    sim_put32(&dev->reg[cREGADDR_CiTBC], sim_tbc(dev));
+
+    for (channel = 0; channel < CAN_FIFO_TOTAL_CHANNELS; channel++)
+    {
+        f = &dev->fifo[channel];
+        con = sim_fifo_con(dev, channel);
+        bit = 1UL << channel;
+        if (channel == CAN_TXQUEUE_CH0)
+            con[0] |= SIM_FIFOCON_TXEN;
+        if (!f->allocated)
+        {
+            // Configuration Mode: a reset TX FIFO looks empty, but its user address is not an object yet
+            con[4] &= sim_fifo_tx(dev, channel) ? SIM_FIFOSTA_TXFLAGS : SIM_FIFOSTA_RXOVIF;
+            if (!dev->allocated && sim_fifo_tx(dev, channel))
+                con[4] |= 0x07;
+            con[5] = con[6] = con[7] = 0;
+            sim_put32(con + 8, dev->allocated ? 0 : SIM_FIFOUA_CONFIG);
+            continue;
+        }
+        if (sim_fifo_tx(dev, channel))
+        {
+            sta = con[4] & SIM_FIFOSTA_TXFLAGS;
+            if (f->count < f->depth)
+                sta |= 0x01;
+            if ((f->depth - f->count) * 2 >= f->depth)
+                sta |= 0x02;
+            if (f->count == 0)
+                sta |= 0x04;
+            con[5] = f->tail;
+            sim_put32(con + 8, f->base + f->head * f->size);
+            if (sta & con[0] & 0x07)
+                txif |= bit;
+            if (sta & SIM_FIFOSTA_TXATIF)
+                txatif |= bit;
+            if (con[1] & SIM_FIFOCON_TXREQ)
+                txreq |= bit;
+        }
+        else
+        {
+            sta = con[4] & SIM_FIFOSTA_RXOVIF;
+            if (f->count)
+                sta |= 0x01;
+            if (f->count && f->count * 2 >= f->depth)
+                sta |= 0x02;
+            if (f->count == f->depth)
+                sta |= 0x04;
+            con[5] = f->head;
+            sim_put32(con + 8, f->base + f->tail * f->size);
+            if (sta & con[0] & 0x07)
+                rxif |= bit;
+            if (sta & SIM_FIFOSTA_RXOVIF)
+                rxovif |= bit;
+        }
+        con[4] = sta;
+        con[6] = con[7] = 0;
+    }
+
+    // TEF
+    f = &dev->tef;
+    con = &dev->reg[cREGADDR_CiTEFCON];
+    sta = dev->reg[cREGADDR_CiTEFSTA] & SIM_TEFSTA_OVIF;
+    if (f->allocated)
+    {
+        if (f->count)
+            sta |= 0x01;
+        if (f->count && f->count * 2 >= f->depth)
+            sta |= 0x02;
+        if (f->count == f->depth)
+            sta |= 0x04;
+    }
+    sim_put32(&dev->reg[cREGADDR_CiTEFSTA], sta);
+    sim_put32(&dev->reg[cREGADDR_CiTEFUA], f->allocated ? f->base + f->tail * f->size : dev->allocated ? 0 : SIM_FIFOUA_CONFIG);
+    sim_put32(&dev->reg[cREGADDR_CiFIFOBA], cRAMADDR_START);
+
+    sim_put32(&dev->reg[cREGADDR_CiRXIF], rxif);
+    sim_put32(&dev->reg[cREGADDR_CiTXIF], txif);
+    sim_put32(&dev->reg[cREGADDR_CiRXOVIF], rxovif);
+    sim_put32(&dev->reg[cREGADDR_CiTXATIF], txatif);
+    sim_put32(&dev->reg[cREGADDR_CiTXREQ], txreq);
+
+    // Error counters
+    trec = dev->rec | ((uint32_t) (dev->tec > 255 ? 255 : dev->tec) << 8);
+    if (dev->tec >= 96 || dev->rec >= 96)
+        trec |= 1UL << 16;
+    if (dev->rec >= 96)
+        trec |= 1UL << 17;
+    if (dev->tec >= 96)
+        trec |= 1UL << 18;
+    if (dev->rec >= 128)
+        trec |= 1UL << 19;
+    if (dev->tec >= 128)
+        trec |= 1UL << 20;
+    if (dev->tec > 255)
+        trec |= 1UL << 21;
+    sim_put32(&dev->reg[cREGADDR_CiTREC], trec);
+
+    // CRC value and flags of the SPI CRC instructions
+    dev->sfr[cREGADDR_CRC - cREGADDR_OSC] = dev->crcLast;
+    dev->sfr[cREGADDR_CRC - cREGADDR_OSC + 1] = dev->crcLast >> 8;
+
+    // Interrupt flags
+    stored = (dev->reg[cREGADDR_CiINT] | (dev->reg[cREGADDR_CiINT + 1] << 8)) & SIM_INT_CLEARABLE;
+    enables = dev->reg[cREGADDR_CiINTENABLE] | (dev->reg[cREGADDR_CiINTENABLE + 1] << 8);
+    flags = stored;
+    if (txif)
+        flags |= SIM_INT_TXIF;
+    if (rxif)
+        flags |= SIM_INT_RXIF;
+    if (sta & con[0] & 0x0F)
+        flags |= SIM_INT_TEFIF;
+    if (rxovif)
+        flags |= SIM_INT_RXOVIF;
+    if (txatif)
+        flags |= SIM_INT_TXATIF;
+    if (dev->sfr[cREGADDR_CRC - cREGADDR_OSC + 2] & SIM_CRC_FLAGS)
+        flags |= SIM_INT_SPICRCIF;
+    dev->reg[cREGADDR_CiINT] = flags;
+    dev->reg[cREGADDR_CiINT + 1] = flags >> 8;
+
+    // Interrupt codes, lowest channel first
+    for (channel = 0; channel < CAN_FIFO_TOTAL_CHANNELS; channel++)
+    {
+        bit = 1UL << channel;
+        if ((rxif & bit) && rxcode == 0x40)
+            rxcode = channel;
+        if ((txif & bit) && txcode == 0x40)
+            txcode = channel;
+    }
+    code = rxcode < txcode ? rxcode : txcode;
+    if ((flags & enables & (SIM_INT_RXIF|SIM_INT_TXIF)) && code != 0x40)
+        icode = code;
+    else if (flags & enables & (SIM_INT_SERRIF|SIM_INT_CERRIF))
+        icode = 0x41;
+    else if (flags & enables & SIM_INT_WAKIF)
+        icode = 0x42;
+    else if (flags & enables & SIM_INT_RXOVIF)
+        icode = 0x43;
+    else if (flags & enables & SIM_INT_TBCIF)
+        icode = 0x46;
+    else if (flags & enables & SIM_INT_MODIF)
+        icode = 0x47;
+    else if (flags & enables & SIM_INT_IVMIF)
+        icode = 0x48;
+    else if (flags & enables & SIM_INT_TEFIF)
+        icode = 0x49;
+    else if (flags & enables & SIM_INT_TXATIF)
+        icode = 0x4A;
+    dev->reg[cREGADDR_CiVEC] = icode;
+    dev->reg[cREGADDR_CiVEC + 1] = dev->filterHit;
+    dev->reg[cREGADDR_CiVEC + 2] = txcode;
+    dev->reg[cREGADDR_CiVEC + 3] = rxcode;
+
+    // Oscillator
+    if (dev->mode == SIM_MODE_SLEEP || simNow < dev->oscReadyNs)
+        dev->sfr[1] &= ~SIM_OSC_READY;
+    else
+        dev->sfr[1] = (dev->sfr[1] & ~SIM_OSC_READY) | (dev->sfr[0] & SIM_OSC_PLLEN) | 0x14;
+    dev->sfr[cREGADDR_DEVID - cREGADDR_OSC] = SIM_DEVID;
+
+    dev->stats.nInt = !(flags & enables);
+}
+
+// Message RAM allocation on leaving Configuration Mode: TEF, TXQ, then FIFO 1 to 31
+static void sim_allocate(SIM_DEVICE* dev)
+{
+    uint16_t offset = 0;
+    uint8_t channel, payload, size;
+    uint8_t* con;
+    SIM_FIFO* f;
+
+    memset(dev->fifo, 0, sizeof(dev->fifo));
+    memset(&dev->tef, 0, sizeof(dev->tef));
+    if (dev->reg[cREGADDR_CiCON + 2] & SIM_CICON_STEF)
+    {
+        f = &dev->tef;
+        con = &dev->reg[cREGADDR_CiTEFCON];
+        f->size = (con[0] & SIM_TEFCON_TEFTSEN) ? 12 : 8;
+        f->depth = (con[3] & 0x1F) + 1;
+        f->base = offset;
+        f->allocated = 1;
+        offset += f->size * f->depth;
+    }
+    for (channel = 0; channel < CAN_FIFO_TOTAL_CHANNELS; channel++)
+    {
+        if (channel == CAN_TXQUEUE_CH0 && !sim_fifo_tx(dev, channel))
+            continue;
+        f = &dev->fifo[channel];
+        con = sim_fifo_con(dev, channel);
+        payload = DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) (CAN_DLC_8 + (con[3] >> 5)));
+        size = 8 + payload;
+        if (!sim_fifo_tx(dev, channel) && (con[0] & SIM_FIFOCON_RXTSEN))
+            size += 4;
+        f->size = size;
+        f->depth = (con[3] & 0x1F) + 1;
+        if (offset + size * f->depth > cRAM_SIZE)
+            break;
+        f->base = offset;
+        f->allocated = 1;
+        offset += size * f->depth;
+    }
+    dev->allocated = 1;
+}
+
+static void sim_txreq_clear_all(SIM_DEVICE* dev)
+{
+    uint8_t channel;
+    for (channel = 0; channel < CAN_FIFO_TOTAL_CHANNELS; channel++)
+        sim_fifo_con(dev, channel)[1] &= ~SIM_FIFOCON_TXREQ;
+}
+
+static void sim_mode_set(SIM_DEVICE* dev, uint8_t mode)
+{
+    dev->modeAtNs = SIM_NO_EVENT;
+    if (mode == dev->mode)
+        return;
+    if (mode == SIM_MODE_CONFIG)
+    {
+        // FIFOs are reset and RAM is allocated again on leaving Configuration Mode
+        dev->txChannel = -1;
+        dev->allocated = 0;
+        memset(dev->fifo, 0, sizeof(dev->fifo));
+        memset(&dev->tef, 0, sizeof(dev->tef));
+        sim_txreq_clear_all(dev);
+    }
+    else if (mode == SIM_MODE_SLEEP)
+    {
+        dev->txChannel = -1;
+        dev->sfr[0] |= SIM_OSC_OSCDIS;
+    }
+    else if (!dev->allocated)
+        sim_allocate(dev);
+    dev->mode = mode;
+    dev->reg[cREGADDR_CiINT] |= SIM_INT_MODIF;
+}
+
+// REQOP written: out of Configuration Mode into a bus mode, OPMOD follows after CANSIM_INTEGRATION_BITS recessive
+// bits; Configuration and Sleep Mode are immediate
+static void sim_mode_request(SIM_DEVICE* dev, uint8_t mode)
+{
+    if (dev->mode == SIM_MODE_CONFIG && mode != SIM_MODE_CONFIG && mode != SIM_MODE_SLEEP)
+    {
+        if (dev->modeAtNs == SIM_NO_EVENT || dev->modeRequest != mode)
+            dev->modeAtNs = simNow + CANSIM_INTEGRATION_BITS * (1000000000ULL / CANSIM_NOMINAL_BPS);
+        dev->modeRequest = mode;
+    }
+    else
+        sim_mode_set(dev, mode);
+}
+
+// Leave Sleep Mode (OSCDIS cleared or bus activity): Configuration Mode once the oscillator runs
+static void sim_wake(SIM_DEVICE* dev)
+{
+    dev->modeAtNs = SIM_NO_EVENT;
+    dev->sfr[0] &= ~SIM_OSC_OSCDIS;
+    dev->oscReadyNs = simNow + CANSIM_OSC_START_NS;
+    dev->mode = SIM_MODE_CONFIG;
+    dev->reg[cREGADDR_CiINT] |= SIM_INT_MODIF;
+}
+
+static void sim_reset(SIM_DEVICE* dev)
+{
+    uint8_t channel;
+
+    memset(dev->reg, 0, sizeof(dev->reg));
+    memset(dev->sfr, 0, sizeof(dev->sfr));
+    sim_put32(&dev->reg[cREGADDR_CiCON], SIM_CICON_RESET);
+    sim_put32(&dev->reg[cREGADDR_CiNBTCFG], 0x003E0F0F);
+    sim_put32(&dev->reg[cREGADDR_CiDBTCFG], 0x000E0303);
+    sim_put32(&dev->reg[cREGADDR_CiTDC], 0x00021000);
+    for (channel = 0; channel < CAN_FIFO_TOTAL_CHANNELS; channel++)
+        sim_put32(sim_fifo_con(dev, channel), SIM_FIFOCON_RESET);
+    sim_put32(&dev->sfr[cREGADDR_OSC - cREGADDR_OSC], SIM_OSC_RESET);
+    sim_put32(&dev->sfr[cREGADDR_IOCON - cREGADDR_OSC], 0x00000003);
+    dev->mode = SIM_MODE_CONFIG;
+    dev->modeAtNs = SIM_NO_EVENT;
+    dev->allocated = 0;
+    memset(dev->fifo, 0, sizeof(dev->fifo));
+    memset(&dev->tef, 0, sizeof(dev->tef));
+    dev->filterHit = 0;
+    dev->txChannel = -1;
+    dev->tec = 0;
+    dev->rec = 0;
+    dev->recoverAtNs = 0;
+    dev->tbcBase = 0;
+    dev->tbcBaseNs = simNow;
+    dev->oscReadyNs = simNow;
+    dev->crcLast = 0;
+    sim_refresh(dev);
+}
+
+static uint8_t sim_read(SIM_DEVICE* dev, uint16_t address)
+{
+    if (address < cRAMADDR_START)
+        return dev->reg[address];
+    if (address < cRAMADDR_END)
+        return dev->ram[address - cRAMADDR_START];
+    if (address >= cREGADDR_OSC && address < cREGADDR_OSC + SIM_SFR_SIZE)
+        return dev->sfr[address - cREGADDR_OSC];
+    return 0;
+}
+
+// FIFO control byte 1: UINC, TXREQ, FRESET
+static void sim_fifo_action(SIM_DEVICE* dev, uint8_t channel, uint8_t value)
+{
+    SIM_FIFO* f = &dev->fifo[channel];
+    uint8_t* con = sim_fifo_con(dev, channel);
+    uint8_t tx = sim_fifo_tx(dev, channel);
+
+    if (value & SIM_FIFOCON_FRESET)
+    {
+        if (dev->txChannel == channel)
+            dev->txChannel = -1;
+        f->head = f->tail = f->count = 0;
+        con[1] &= ~SIM_FIFOCON_TXREQ;
+        return;
+    }
+    if ((value & SIM_FIFOCON_UINC) && f->allocated)
+    {
+        if (tx && f->count < f->depth)
+        {
+            f->head = (f->head + 1) % f->depth;
+            f->count++;
+        }
+        else if (!tx && f->count)
+        {
+            f->tail = (f->tail + 1) % f->depth;
+            f->count--;
+        }
+    }
+    if ((value & SIM_FIFOCON_TXREQ) && tx)
+        con[1] |= SIM_FIFOCON_TXREQ;
+}
+
+static void sim_write(SIM_DEVICE* dev, uint16_t address, uint8_t value)
+{
+    uint8_t config = dev->mode == SIM_MODE_CONFIG;
+    uint8_t channel, offset;
+    uint8_t* p;
+
+    if (address >= cRAMADDR_START && address < cRAMADDR_END)
+    {
+        dev->ram[address - cRAMADDR_START] = value;
+        return;
+    }
+    if (address >= cREGADDR_OSC && address < cREGADDR_OSC + SIM_SFR_SIZE)
+    {
+        offset = address - cREGADDR_OSC;
+        p = &dev->sfr[offset];
+        switch (offset)
+        {
+            case 0:
+                if ((*p & SIM_OSC_OSCDIS) && !(value & SIM_OSC_OSCDIS) && dev->mode == SIM_MODE_SLEEP)
+                    sim_wake(dev);
+                else if (value & SIM_OSC_OSCDIS)
+                    sim_mode_set(dev, SIM_MODE_SLEEP);
+                *p = (value & ~SIM_OSC_OSCDIS) | (*p & SIM_OSC_OSCDIS);
+                break;
+            case 1:
+                // Ready bits are status
+                break;
+            case cREGADDR_CRC - cREGADDR_OSC:
+            case cREGADDR_CRC - cREGADDR_OSC + 1:
+            case cREGADDR_DEVID - cREGADDR_OSC:
+            case cREGADDR_DEVID - cREGADDR_OSC + 1:
+            case cREGADDR_DEVID - cREGADDR_OSC + 2:
+            case cREGADDR_DEVID - cREGADDR_OSC + 3:
+                break;
+            case cREGADDR_CRC - cREGADDR_OSC + 2:
+            case cREGADDR_ECCSTA - cREGADDR_OSC:
+                *p &= value;
+                break;
+            default:
+                *p = value;
+                break;
+        }
+        return;
+    }
+    if (address >= cRAMADDR_START)
+        return;
+
+    // Filters
+    if (address >= cREGADDR_CiFLTCON)
+    {
+        dev->reg[address] = value;
+        return;
+    }
+    // FIFOs
+    if (address >= cREGADDR_CiFIFOCON)
+    {
+        channel = (address - cREGADDR_CiFIFOCON) / CiFIFO_OFFSET;
+        offset = (address - cREGADDR_CiFIFOCON) % CiFIFO_OFFSET;
+        p = &dev->reg[address];
+        switch (offset)
+        {
+            case 0:
+                if (config)
+                    *p = value;
+                else
+                    *p = (*p & (SIM_FIFOCON_TXEN|SIM_FIFOCON_RXTSEN)) | (value & ~(SIM_FIFOCON_TXEN|SIM_FIFOCON_RXTSEN));
+                break;
+            case 1:
+                sim_fifo_action(dev, channel, value);
+                break;
+            case 2:
+                *p = value;
+                break;
+            case 3:
+                if (config)
+                    *p = value;
+                break;
+            case 4:
+                // Event flags are cleared by writing 0
+                *p &= value | 0x07;
+                break;
+            default:
+                break;
+        }
+        return;
+    }
+
+    p = &dev->reg[address];
+    switch (address & ~3)
+    {
+        case cREGADDR_CiCON:
+            if ((address & 3) == 3)
+            {
+                if (value & SIM_CICON_ABAT)
+                {
+                    sim_txreq_clear_all(dev);
+                    value &= ~SIM_CICON_ABAT;
+                }
+                *p = value;
+                sim_mode_request(dev, value & 0x07);
+            }
+            else if (config)
+                *p = ((address & 3) == 2) ? (value & 0x1F) | (*p & 0xE0) : value;
+            break;
+        case cREGADDR_CiNBTCFG:
+        case cREGADDR_CiDBTCFG:
+        case cREGADDR_CiTDC:
+            if (config)
+                *p = value;
+            break;
+        case cREGADDR_CiTBC:
+            sim_tbc_fold(dev);
+            sim_put32(&dev->reg[cREGADDR_CiTBC], dev->tbcBase);
+            *p = value;
+            dev->tbcBase = sim_get32(&dev->reg[cREGADDR_CiTBC]);
+            break;
+        case cREGADDR_CiTSCON:
+            sim_tbc_fold(dev);
+            *p = value;
+            break;
+        case cREGADDR_CiINT:
+            if ((address & 3) < 2)
+                *p &= value | (uint8_t) ~(((address & 3) == 0) ? SIM_INT_CLEARABLE : SIM_INT_CLEARABLE >> 8);
+            else
+                *p = value;
+            break;
+        case cREGADDR_CiTXREQ:
+            for (channel = 0; channel < 8; channel++)
+                if (value & (1 << channel))
+                    sim_fifo_action(dev, (address & 3) * 8 + channel, SIM_FIFOCON_TXREQ);
+            break;
+        case cREGADDR_CiBDIAG0:
+        case cREGADDR_CiBDIAG1:
+            *p = value;
+            break;
+        case cREGADDR_CiTEFCON:
+            if ((address & 3) == 1)
+            {
+                if (value & SIM_FIFOCON_FRESET)
+                    dev->tef.head = dev->tef.tail = dev->tef.count = 0;
+                else if ((value & SIM_FIFOCON_UINC) && dev->tef.count)
+                {
+                    dev->tef.tail = (dev->tef.tail + 1) % dev->tef.depth;
+                    dev->tef.count--;
+                }
+            }
+            else if ((address & 3) == 0)
+                *p = config ? value : (*p & SIM_TEFCON_TEFTSEN) | (value & ~SIM_TEFCON_TEFTSEN);
+            else if (config)
+                *p = value;
+            break;
+        case cREGADDR_CiTEFSTA:
+            if ((address & 3) == 0)
+                *p &= value | ~SIM_TEFSTA_OVIF;
+            break;
+        default:
+            // VEC, RXIF..TXATIF, TREC, TEFUA, FIFOBA are status
+            break;
+    }
+}
+
+// Start of the data phase of a READ: the derived fields have to be current
+static void sim_session_read_start(SIM_DEVICE* dev)
+{
+    sim_refresh(dev);
+}
+
+static uint8_t sim_session_byte(uint8_t mosi)
+{
+    SIM_DEVICE* dev = &simDevices[simSession.device];
+    uint16_t position = simSession.position++;
+    uint16_t length;
+    uint8_t miso = 0;
+
+    if (position == 0)
+    {
+        simSession.instruction = mosi >> 4;
+        simSession.address = (mosi & 0x0F) << 8;
+    }
+    else if (position == 1)
+        simSession.address |= mosi;
+
+    switch (simSession.instruction)
+    {
+        case cINSTRUCTION_READ:
+            if (position == 2)
+                sim_session_read_start(dev);
+            if (position >= 2)
+                miso = sim_read(dev, simSession.address++);
+            break;
+        case cINSTRUCTION_WRITE:
+            if (position >= 2)
+                sim_write(dev, simSession.address++, mosi);
+            break;
+        case cINSTRUCTION_READ_CRC:
+            if (position < 3)
+                simSession.buffer[position] = mosi;
+            if (position == 2)
+            {
+                // Length in words for RAM, in bytes for registers; data and CRC are prepared here
+                length = mosi;
+                if (simSession.address >= cRAMADDR_START && simSession.address < cRAMADDR_END)
+                    length *= 4;
+                simSession.crcLength = length;
+                sim_session_read_start(dev);
+                for (length = 0; length < simSession.crcLength; length++)
+                    simSession.buffer[3 + length] = sim_read(dev, simSession.address + length);
+                length = DRV_CANFDSPI_CalculateCRC16(simSession.buffer, 3 + simSession.crcLength);
+                if (dev->crcCorrupt)
+                {
+                    length ^= 0x0001;
+                    dev->crcCorrupt = 0;
+                }
+                simSession.buffer[3 + simSession.crcLength] = length >> 8;
+                simSession.buffer[4 + simSession.crcLength] = length;
+            }
+            else if (position > 2 && position < 5 + simSession.crcLength)
+                miso = simSession.buffer[position];
+            break;
+        case cINSTRUCTION_WRITE_CRC:
+        case cINSTRUCTION_WRITE_SAFE:
+            if (position < SIM_SESSION_LENGTH)
+                simSession.buffer[position] = mosi;
+            break;
+        default:
+            break;
+    }
+    return miso;
+}
+
+// WRITE_CRC/WRITE_SAFE are applied at the end, if length and CRC check
+static void sim_session_write_crc(SIM_DEVICE* dev, uint16_t size)
+{
+    uint16_t header = (simSession.instruction == cINSTRUCTION_WRITE_CRC) ? 3 : 2;
+    uint16_t length, crc, i;
+    uint8_t* crcFlags = &dev->sfr[cREGADDR_CRC - cREGADDR_OSC + 2];
+
+    if (size < header + 2 || size > SIM_SESSION_LENGTH)
+    {
+        *crcFlags |= SIM_CRC_FERRIF;
+        dev->spi.crcErrors++;
+        return;
+    }
+    length = size - header - 2;
+    if (simSession.instruction == cINSTRUCTION_WRITE_CRC)
+    {
+        i = simSession.buffer[2];
+        if (simSession.address >= cRAMADDR_START && simSession.address < cRAMADDR_END)
+            i *= 4;
+        if (i != length)
+            length = 0;
+    }
+    else if (length > 4)
+        length = 0;
+    if (length == 0)
+    {
+        *crcFlags |= SIM_CRC_FERRIF;
+        dev->spi.crcErrors++;
+        return;
+    }
+    crc = DRV_CANFDSPI_CalculateCRC16(simSession.buffer, header + length);
+    dev->crcLast = crc;
+    if (dev->crcCorrupt)
+    {
+        crc ^= 0x0001;
+        dev->crcCorrupt = 0;
+    }
+    if (crc != ((simSession.buffer[header + length] << 8) | simSession.buffer[header + length + 1]))
+    {
+        *crcFlags |= SIM_CRC_CRCERRIF;
+        dev->spi.crcErrors++;
+        return;
+    }
+    for (i = 0; i < length; i++)
+        sim_write(dev, simSession.address + i, simSession.buffer[header + i]);
+}
+
+static void sim_session_begin(uint8_t index)
+{
+    simSession.device = index;
+    simSession.position = 0;
+    simSession.instruction = 0xFF;
+    simSession.crcLength = 0;
+}
+
+// Chip select released: finish the instruction, account for the SPI time, let the bus catch up
+static void sim_session_end(void)
+{
+    SIM_DEVICE* dev;
+    uint16_t size = simSession.position;
+    uint16_t divider;
+    uint64_t ns;
+
+    if (simSession.device < 0)
+        return;
+    dev = &simDevices[simSession.device];
+    simSession.device = -1;
+    if (size == 0)
+        return;
+
+    if (simSession.instruction == cINSTRUCTION_RESET && size >= 2)
+        sim_reset(dev);
+    else if (simSession.instruction == cINSTRUCTION_WRITE_CRC || simSession.instruction == cINSTRUCTION_WRITE_SAFE)
+        sim_session_write_crc(dev, size);
+
+    divider = dev->spiClockDivider ? dev->spiClockDivider : simClockDivider;
+    ns = (uint64_t) size * 8 * 1000000000ULL * divider / simSmclkHz;
+    dev->spi.transactions++;
+    dev->spi.bytes += size;
+    dev->spi.instructions[simSession.instruction & 0x0F]++;
+    dev->spi.busyNs += ns;
+
+    sim_bus_start(dev);
+    sim_run_until(simNow + ns + CANSIM_SPI_SETUP_NS);
+}
+
+// Bus
+
+static uint64_t sim_frame_ns(const CANSIM_FRAME* frame)
+{
+    uint32_t bytes = DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) frame->dlc);
+    uint32_t nominal, data = 0;
+
+    if (!frame->fdf)
+    {
+        // SOF, ID, control, data, CRC, ACK, EOF; no stuff bits
+        nominal = (frame->ide ? 64 : 44) + 8 * bytes;
+    }
+    else
+    {
+        // Arbitration and control up to BRS, then ESI, DLC, data, stuff count and CRC
+        nominal = frame->ide ? 34 : 16;
+        data = 1 + 4 + 8 * bytes + 4 + (bytes > 16 ? 21 : 17);
+        // CRC delimiter, ACK, EOF
+        nominal += 10;
+        if (!frame->brs)
+        {
+            nominal += data;
+            data = 0;
+        }
+    }
+    // Intermission
+    nominal += 3;
+    return (uint64_t) nominal * 1000000000ULL / CANSIM_NOMINAL_BPS + (uint64_t) data * 1000000000ULL / CANSIM_DATA_BPS;
+}
+
+static void sim_log(SIM_DEVICE* dev, const CANSIM_FRAME* frame)
+{
+    dev->log[dev->logCount % CANSIM_BUS_LOG_LENGTH] = *frame;
+    dev->logCount++;
+}
+
+static uint8_t sim_standby(SIM_DEVICE* dev)
+{
+    return dev == &simDevices[0] && (PJOUT & SIM_STBY_PIN);
+}
+
+// Receive a frame seen on the bus at sofNs; 0 if it was stored in a RX FIFO
+static int8_t sim_receive(SIM_DEVICE* dev, const CANSIM_FRAME* frame, uint64_t sofNs)
+{
+    uint8_t filter, channel = 0, size, bytes;
+    uint32_t object, mask, bits, ctrl, sid, eid;
+    uint8_t* con;
+    uint8_t* p;
+    SIM_FIFO* f;
+
+    if (dev->mode == SIM_MODE_SLEEP)
+    {
+        // Bus activity wakes the controller, the frame itself is lost
+        dev->reg[cREGADDR_CiINT + 1] |= SIM_INT_WAKIF >> 8;
+        sim_wake(dev);
+        return 1;
+    }
+    if (dev->mode == SIM_MODE_CONFIG || sim_standby(dev))
+        return 1;
+
+    sid = frame->ide ? (frame->id >> 18) & 0x7FF : frame->id & 0x7FF;
+    eid = frame->ide ? frame->id & 0x3FFFF : 0;
+    bits = sid | (eid << 11);
+    for (filter = 0; filter < 32; filter++)
+    {
+        con = &dev->reg[cREGADDR_CiFLTCON + filter];
+        if (!(*con & 0x80))
+            continue;
+        object = sim_get32(&dev->reg[cREGADDR_CiFLTOBJ + filter * CiFILTER_OFFSET]);
+        mask = sim_get32(&dev->reg[cREGADDR_CiMASK + filter * CiFILTER_OFFSET]);
+        if ((mask & (1UL << 30)) && ((object >> 30) & 1) != frame->ide)
+            continue;
+        mask &= frame->ide ? 0x1FFFFFFF : 0x7FF;
+        if ((bits ^ object) & mask)
+            continue;
+        channel = *con & 0x1F;
+        break;
+    }
+    f = &dev->fifo[channel];
+    if (filter == 32 || channel == CAN_TXQUEUE_CH0 || !f->allocated || sim_fifo_tx(dev, channel))
+    {
+        dev->stats.framesRejected++;
+        return 1;
+    }
+    con = sim_fifo_con(dev, channel);
+    if (f->count == f->depth)
+    {
+        con[4] |= SIM_FIFOSTA_RXOVIF;
+        dev->stats.rxOverflows++;
+        return 1;
+    }
+
+    p = &dev->ram[f->base + f->head * f->size];
+    ctrl = frame->dlc | (frame->ide ? SIM_OBJ_IDE : 0) | (frame->brs ? SIM_OBJ_BRS : 0) | (frame->fdf ? SIM_OBJ_FDF : 0);
+    ctrl |= (uint32_t) filter << 11;
+    sim_put32(p, bits);
+    sim_put32(p + 4, ctrl);
+    p += 8;
+    if (con[0] & SIM_FIFOCON_RXTSEN)
+    {
+        // TSEOF is not modelled, the time stamp is taken at SOF
+        sim_put32(p, sim_tbc_at(dev, sofNs));
+        p += 4;
+    }
+    size = f->size - (p - &dev->ram[f->base + f->head * f->size]);
+    bytes = DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) frame->dlc);
+    memcpy(p, frame->data, bytes < size ? bytes : size);
+    f->head = (f->head + 1) % f->depth;
+    f->count++;
+    dev->filterHit = filter;
+    dev->stats.framesReceived++;
+    return 0;
+}
+
+// Next frame to send: highest TXPRI among TXQ and TX FIFOs with TXREQ set, lowest channel on a tie
+static void sim_bus_start(SIM_DEVICE* dev)
+{
+    int8_t best = -1;
+    uint8_t channel, priority, bestPriority = 0, mode = dev->mode;
+    uint32_t id, ctrl;
+    uint8_t* con;
+    uint8_t* p;
+    SIM_FIFO* f;
+
+    if (dev->txChannel >= 0 || simHold || dev->tec > 255 || sim_standby(dev))
+        return;
+    if (mode != SIM_MODE_NORMAL && mode != CAN_INTERNAL_LOOPBACK_MODE && mode != CAN_EXTERNAL_LOOPBACK_MODE
+            && mode != CAN_CLASSIC_MODE)
+        return;
+    for (channel = 0; channel < CAN_FIFO_TOTAL_CHANNELS; channel++)
+    {
+        con = sim_fifo_con(dev, channel);
+        f = &dev->fifo[channel];
+        if (!f->allocated || !sim_fifo_tx(dev, channel) || !(con[1] & SIM_FIFOCON_TXREQ) || !f->count)
+            continue;
+        priority = con[2] & 0x1F;
+        if (best < 0 || priority > bestPriority)
+        {
+            best = channel;
+            bestPriority = priority;
+        }
+    }
+    if (best < 0)
+        return;
+
+    f = &dev->fifo[best];
+    p = &dev->ram[f->base + f->tail * f->size];
+    id = sim_get32(p);
+    ctrl = sim_get32(p + 4);
+    memset(&dev->txFrame, 0, sizeof(dev->txFrame));
+    dev->txFrame.ide = (ctrl & SIM_OBJ_IDE) != 0;
+    dev->txFrame.fdf = (ctrl & SIM_OBJ_FDF) != 0 && mode != CAN_CLASSIC_MODE;
+    dev->txFrame.brs = dev->txFrame.fdf && (ctrl & SIM_OBJ_BRS) != 0;
+    dev->txFrame.dlc = ctrl & 0x0F;
+    if (!dev->txFrame.fdf && dev->txFrame.dlc > CAN_DLC_8)
+        dev->txFrame.dlc = CAN_DLC_8;
+    dev->txFrame.seq = ctrl >> 9;
+    dev->txFrame.id = dev->txFrame.ide ? ((id & 0x7FF) << 18) | ((id >> 11) & 0x3FFFF) : id & 0x7FF;
+    memcpy(dev->txFrame.data, p + 8, f->size - 8);
+    dev->txFrame.sofNs = simNow;
+    dev->txChannel = best;
+    dev->txEndNs = simNow + sim_frame_ns(&dev->txFrame);
+}
+
+static void sim_bus_complete(SIM_DEVICE* dev)
+{
+    SIM_FIFO* f = &dev->fifo[dev->txChannel];
+    uint8_t* con = sim_fifo_con(dev, dev->txChannel);
+    uint8_t* object = &dev->ram[f->base + f->tail * f->size];
+    SIM_FIFO* tef = &dev->tef;
+    uint8_t* p;
+
+    dev->txChannel = -1;
+    if (dev->reg[cREGADDR_CiCON + 2] & SIM_CICON_STEF)
+    {
+        if (tef->allocated && tef->count < tef->depth)
+        {
+            p = &dev->ram[tef->base + tef->head * tef->size];
+            memcpy(p, object, 8);
+            if (tef->size > 8)
+                sim_put32(p + 8, sim_tbc_at(dev, dev->txFrame.sofNs));
+            tef->head = (tef->head + 1) % tef->depth;
+            tef->count++;
+        }
+        else
+        {
+            dev->reg[cREGADDR_CiTEFSTA] |= SIM_TEFSTA_OVIF;
+            dev->stats.tefOverflows++;
+        }
+    }
+    f->tail = (f->tail + 1) % f->depth;
+    f->count--;
+    if (!f->count)
+        con[1] &= ~SIM_FIFOCON_TXREQ;
+    sim_log(dev, &dev->txFrame);
+    dev->stats.framesSent++;
+    if (dev->mode == CAN_INTERNAL_LOOPBACK_MODE || dev->mode == CAN_EXTERNAL_LOOPBACK_MODE)
+        sim_receive(dev, &dev->txFrame, dev->txFrame.sofNs);
+}
+
+// Simulated time at which Timer B0 reaches count, ACLK edges don't fall on whole nanoseconds
+static uint64_t sim_tb0_ns(uint64_t count)
+{
+    return simTb0OriginNs + ((count - simTb0OriginCount) * 1000000000ULL + CANSIM_ACLK_HZ - 1) / CANSIM_ACLK_HZ;
+}
+
+// MCU: Timer B0 counts simulated time; TBIFG on a lap, CCIFG when TB0R passes TB0CCR1
+static void sim_tb0_sync(void)
+{
+    uint64_t ticks, last;
+    uint16_t ccr;
+
+    if (TB0CTL & TBCLR)
+    {
+        TB0CTL &= ~TBCLR;
+        simTb0Count = simTb0OriginCount = 0;
+        simTb0OriginNs = simNow;
+    }
+    if (!(TB0CTL & (MC0|MC1)))
+    {
+        simTb0OriginCount = simTb0Count;
+        simTb0OriginNs = simNow;
+        simTb0R = simTb0Count;
+        return;
+    }
+    ticks = simTb0OriginCount + (simNow - simTb0OriginNs) * CANSIM_ACLK_HZ / 1000000000ULL - simTb0Count;
+    if (!ticks)
+    {
+        simTb0R = simTb0Count;
+        return;
+    }
+    last = simTb0Count;
+    simTb0Count += ticks;
+    if ((simTb0Count >> 16) != (last >> 16))
+        TB0CTL |= TBIFG;
+    // CCR1 match somewhere in (last, count]
+    ccr = TB0CCR1;
+    if (ticks >= 0x10000 || ((uint16_t) (ccr - (uint16_t) last - 1) < ticks))
+        TB0CCTL1 |= CCIFG;
+    simTb0R = simTb0Count;
+}
+
+// Simulated time of the next TB0 interrupt, if enabled
+static uint64_t sim_tb0_next(void)
+{
+    uint64_t next = SIM_NO_EVENT, t;
+    uint16_t count;
+
+    sim_tb0_sync();
+    if (!(TB0CTL & (MC0|MC1)))
+        return next;
+    count = simTb0Count;
+    if (TB0CTL & TBIE)
+        next = sim_tb0_ns(simTb0Count + (0x10000 - count));
+    if (TB0CCTL1 & CCIE)
+    {
+        t = sim_tb0_ns(simTb0Count + (uint16_t) (TB0CCR1 - count - 1) + 1);
+        if (t < next)
+            next = t;
+    }
+    return next;
+}
+
+// P1.2 follows nINT of controller 0, a falling edge sets P1IFG.2 (P1IES)
+static void sim_pins_update(void)
+{
+    SIM_DEVICE* dev = &simDevices[0];
+    uint8_t level;
+
+    sim_refresh(dev);
+    level = dev->stats.nInt ? SIM_NINT_PIN : 0;
+    if ((P1IN & SIM_NINT_PIN) && !level && (P1IES & SIM_NINT_PIN))
+        P1IFG |= SIM_NINT_PIN;
+    else if (!(P1IN & SIM_NINT_PIN) && level && !(P1IES & SIM_NINT_PIN))
+        P1IFG |= SIM_NINT_PIN;
+    P1IN = (P1IN & ~SIM_NINT_PIN) | level;
+}
+
+// Bus events (end of frame, bus-off recovery) up to ns, in order
+static void sim_run_until(uint64_t ns)
+{
+    SIM_DEVICE* due;
+    uint64_t next;
+    uint8_t index, recover, integrated;
+
+    for (;;)
+    {
+        due = NULL;
+        recover = 0;
+        integrated = 0;
+        next = ns;
+        for (index = 0; index < DRV_CANFDSPI_INDEX_COUNT; index++)
+        {
+            SIM_DEVICE* dev = &simDevices[index];
+            sim_bus_start(dev);
+            if (dev->modeAtNs <= next)
+            {
+                due = dev;
+                next = dev->modeAtNs;
+                integrated = 1;
+            }
+            if (dev->txChannel >= 0 && dev->txEndNs <= next)
+            {
+                due = dev;
+                next = dev->txEndNs;
+                recover = 0;
+                integrated = 0;
+            }
+            if (dev->tec > 255 && dev->recoverAtNs && dev->recoverAtNs <= next)
+            {
+                due = dev;
+                next = dev->recoverAtNs;
+                recover = 1;
+                integrated = 0;
+            }
+        }
+        if (!due)
+            break;
+        if (next > simNow)
+            simNow = next;
+        if (integrated)
+            sim_mode_set(due, due->modeRequest);
+        else if (recover)
+        {
+            due->tec = 0;
+            due->rec = 0;
+            due->recoverAtNs = 0;
+        }
+        else
+            sim_bus_complete(due);
+        sim_bus_start(due);
+    }
+    if (ns > simNow)
+        simNow = ns;
+    sim_tb0_sync();
+    sim_pins_update();
+}
+
+static uint64_t sim_next_event(void)
+{
+    uint64_t next = sim_tb0_next();
+    uint8_t index;
+
+    for (index = 0; index < DRV_CANFDSPI_INDEX_COUNT; index++)
+    {
+        SIM_DEVICE* dev = &simDevices[index];
+        if (dev->modeAtNs < next)
+            next = dev->modeAtNs;
+        if (dev->txChannel >= 0 && dev->txEndNs < next)
+            next = dev->txEndNs;
+        if (dev->tec > 255 && dev->recoverAtNs && dev->recoverAtNs < next)
+            next = dev->recoverAtNs;
+    }
+    return next;
+}
+
+// MCU: interrupt handlers run with GIE cleared, no nesting
+static void sim_isr(void (*isr)(void))
+{
+    uint8_t gie = simGie;
+    simGie = 0;
+    simInIsr = 1;
+    isr();
+    simInIsr = 0;
+    simGie = gie;
+}
+
+// Transaction queue, as the eUSCI_A0 ISR runs it: the callback comes before the tail moves on
+static void sim_queue_run(void)
+{
+    DRV_SPI_TRANSACTION* t;
+    uint16_t position;
+    uint8_t inIsr = simInIsr;
+    uint8_t rxByte, txByte;
+
+    simInIsr = 1;
+    while ((simQueueHead - simQueueTail) & SIM_QUEUE_SEQUENCE_MASK)
+    {
+        t = &simQueue[simQueueTail % DRV_SPI_TRANSACTION_QUEUE_LENGTH];
+        sim_session_begin(t->spiSlaveDeviceIndex);
+        for (position = 0; position < t->headerSize + t->dataSize; position++)
+        {
+            if (position < t->headerSize)
+                txByte = t->header[position];
+            else
+                txByte = t->txData != NULL ? t->txData[position - t->headerSize] : 0;
+            rxByte = sim_session_byte(txByte);
+            if (position >= t->headerSize && t->rxData != NULL)
+                t->rxData[position - t->headerSize] = rxByte;
+        }
+        sim_session_end();
+        if (t->callback != NULL)
+            t->callback(t);
+        simQueueTail = (simQueueTail + 1) & SIM_QUEUE_SEQUENCE_MASK;
+    }
+    simInIsr = inIsr;
+    simWake = 1;
+}
+
+// Run whatever interrupts are pending, if they can run
+static void sim_dispatch(void)
+{
+    uint8_t again = 1;
+
+    if (!simGie || simInIsr)
+        return;
+    while (again)
+    {
+        again = 0;
+        if ((simQueueHead - simQueueTail) & SIM_QUEUE_SEQUENCE_MASK)
+        {
+            sim_queue_run();
+            again = 1;
+            continue;
+        }
+        sim_tb0_sync();
+        if ((P1IFG & P1IE & SIM_NINT_PIN) && Port1_ISR)
+        {
+            P1IV = P1IV_P1IFG2;
+            P1IFG &= ~SIM_NINT_PIN;
+            sim_isr(Port1_ISR);
+            again = 1;
+        }
+        else if ((TB0CCTL1 & (CCIE|CCIFG)) == (CCIE|CCIFG) && Timer0_B1_ISR)
+        {
+            TB0IV = TB0IV_TBCCR1;
+            TB0CCTL1 &= ~CCIFG;
+            sim_isr(Timer0_B1_ISR);
+            again = 1;
+        }
+        else if ((TB0CTL & (TBIE|TBIFG)) == (TBIE|TBIFG) && Timer0_B1_ISR)
+        {
+            TB0IV = TB0IV_TBIFG;
+            TB0CTL &= ~TBIFG;
+            sim_isr(Timer0_B1_ISR);
+            again = 1;
+        }
+    }
+}
+
+void CANSIM_McuCycles(uint32_t cycles)
+{
+    sim_run_until(simNow + (uint64_t) cycles * 1000000000ULL / simSmclkHz);
+    sim_dispatch();
+}
+
+// LPM: time jumps from event to event until an ISR exits the low power mode
+void CANSIM_McuSleep(uint16_t bits)
+{
+    uint64_t limit = simNow + CANSIM_SLEEP_LIMIT_NS, next;
+
+    if (bits & GIE)
+        simGie = 1;
+    if (!(bits & CPUOFF))
+    {
+        sim_dispatch();
+        return;
+    }
+    simWake = 0;
+    sim_dispatch();
+    while (!simWake)
+    {
+        next = sim_next_event();
+        if (next == SIM_NO_EVENT || next > limit)
+        {
+            if (!simSleepWarned)
+                fprintf(stderr, "cansim: MCU sleeps with nothing left to wake it up, giving up\n");
+            simSleepWarned = 1;
+            sim_run_until(limit);
+            break;
+        }
+        sim_run_until(next);
+        sim_dispatch();
+    }
+    simWake = 0;
+}
+
+void CANSIM_McuExitSleep(void) {simWake = 1;}
+
+void CANSIM_McuInterrupts(uint16_t state)
+{
+    simGie = (state & GIE) != 0;
+    sim_dispatch();
+}
+
+uint16_t CANSIM_McuInterruptState(void) {return simGie ? GIE : 0;}
+
+volatile uint16_t* CANSIM_TB0R(void)
+{
+    sim_tb0_sync();
+    return &simTb0R;
+}
+
+// Simulation control
+
+void CANSIM_Initialize(void)
+{
+    uint8_t index;
+
+    simNow = 0;
+    simHold = 0;
+    simSession.device = -1;
+    simQueueHead = simQueueTail = 0;
+    simSmclkHz = CANSIM_SMCLK_RESET_HZ;
+    simClockDivider = 1;
+    simGie = simInIsr = simWake = 0;
+    simTb0Count = simTb0OriginCount = 0;
+    simTb0OriginNs = 0;
+    for (index = 0; index < DRV_CANFDSPI_INDEX_COUNT; index++)
+    {
+        memset(&simDevices[index], 0, sizeof(SIM_DEVICE));
+        sim_reset(&simDevices[index]);
+    }
+    P1IN |= SIM_NINT_PIN;
+    sim_pins_update();
+    // UCA0 is never busy here, so polled UART writes don't wait
+    UCA0IFG = UCTXIFG;
+}
+
+uint64_t CANSIM_TimeNs(void) {return simNow;}
+
+void CANSIM_Advance(uint64_t ns)
+{
+    sim_run_until(simNow + ns);
+    sim_dispatch();
+}
+
+void CANSIM_BusIdle(uint64_t maxNs)
+{
+    uint64_t limit = simNow + maxNs, next;
+    uint8_t index, busy;
+
+    for (;;)
+    {
+        busy = 0;
+        sim_run_until(simNow);
+        sim_dispatch();
+        for (index = 0; index < DRV_CANFDSPI_INDEX_COUNT; index++)
+            if (simDevices[index].txChannel >= 0)
+                busy = 1;
+        if (!busy)
+            break;
+        next = sim_next_event();
+        if (next > limit)
+        {
+            sim_run_until(limit);
+            break;
+        }
+        sim_run_until(next);
+    }
+    sim_dispatch();
+}
+
+void CANSIM_BusHold(bool hold)
+{
+    simHold = hold;
+    sim_run_until(simNow);
+}
+
+int8_t CANSIM_BusInject(uint8_t index, const CANSIM_FRAME* frame)
+{
+    int8_t result;
+    if (index >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    sim_run_until(simNow);
+    result = sim_receive(&simDevices[index], frame, simNow);
+    sim_pins_update();
+    sim_dispatch();
+    return result;
+}
+
+uint8_t CANSIM_BusLog(uint8_t index, CANSIM_FRAME* frames, uint8_t maxFrames)
+{
+    SIM_DEVICE* dev;
+    uint32_t first;
+    uint8_t n;
+
+    if (index >= DRV_CANFDSPI_INDEX_COUNT)
+        return 0;
+    dev = &simDevices[index];
+    first = dev->logCount > CANSIM_BUS_LOG_LENGTH ? dev->logCount - CANSIM_BUS_LOG_LENGTH : 0;
+    for (n = 0; n < maxFrames && first + n < dev->logCount; n++)
+        frames[n] = dev->log[(first + n) % CANSIM_BUS_LOG_LENGTH];
+    return n;
+}
+
+void CANSIM_ErrorCountsSet(uint8_t index, uint16_t tec, uint8_t rec, uint64_t recoverNs)
+{
+    SIM_DEVICE* dev;
+    if (index >= DRV_CANFDSPI_INDEX_COUNT)
+        return;
+    dev = &simDevices[index];
+    dev->tec = tec;
+    dev->rec = rec;
+    dev->recoverAtNs = 0;
+    if (tec > 255)
+    {
+        dev->txChannel = -1;
+        dev->reg[cREGADDR_CiINT + 1] |= SIM_INT_CERRIF >> 8;
+        if (recoverNs)
+            dev->recoverAtNs = simNow + recoverNs;
+    }
+    sim_run_until(simNow);
+    sim_dispatch();
+}
+
+void CANSIM_CrcCorruptNext(uint8_t index)
+{
+    if (index < DRV_CANFDSPI_INDEX_COUNT)
+        simDevices[index].crcCorrupt = 1;
+}
+
+void CANSIM_SpiStatsGet(uint8_t index, CANSIM_SPI_STATS* stats)
+{
+    if (index < DRV_CANFDSPI_INDEX_COUNT)
+        *stats = simDevices[index].spi;
+}
+
+void CANSIM_SpiStatsReset(void)
+{
+    uint8_t index;
+    for (index = 0; index < DRV_CANFDSPI_INDEX_COUNT; index++)
+        memset(&simDevices[index].spi, 0, sizeof(CANSIM_SPI_STATS));
+}
+
+void CANSIM_DeviceStatsGet(uint8_t index, CANSIM_DEVICE_STATS* stats)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT)
+        return;
+    sim_refresh(&simDevices[index]);
+    *stats = simDevices[index].stats;
+}
+
+uint8_t CANSIM_Peek(uint8_t index, uint16_t address)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT)
+        return 0;
+    sim_refresh(&simDevices[index]);
+    return sim_read(&simDevices[index], address);
+}
+
+uint32_t CANSIM_PeekWord(uint8_t index, uint16_t address)
+{
+    return CANSIM_Peek(index, address) | ((uint32_t) CANSIM_Peek(index, address + 1) << 8)
+            | ((uint32_t) CANSIM_Peek(index, address + 2) << 16) | ((uint32_t) CANSIM_Peek(index, address + 3) << 24);
+}
+
+// DRV_SPI stand-in, same API and queue semantics as drv_spi.c
+
+// Blocking transfers let queued transactions finish first (unless called from a callback)
+static void sim_blocking_begin(void)
+{
+    if (!simInIsr)
+        sim_queue_run();
+}
+
+static void sim_blocking_end(void)
+{
+    sim_dispatch();
+}
+
+void DRV_SPI_Initialize(void)
+{
+    initializeSPI();
+}
+
+int8_t DRV_SPI_DeviceConfigure(uint8_t spiSlaveDeviceIndex, const DRV_SPI_DEVICE* device)
+{
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    simDevices[spiSlaveDeviceIndex].spiClockDivider = device->clockDivider;
+    return 0;
+}
+
+void DRV_SPI_ClockConfigure(uint32_t smclkHz)
+{
+    simSmclkHz = smclkHz ? smclkHz : 1;
+    simClockDivider = (uint16_t) ((smclkHz + 8500000 - 1) / 8500000);
+    if (simClockDivider == 0)
+        simClockDivider = 1;
+}
+
+uint16_t DRV_SPI_ClockDivider(void) {return simClockDivider;}
+
+void initializeSPI()
+{
+    simBusMode = DRV_SPI_BUS_SPI;
+}
+
+void transmitMasterSPI(unsigned int txData)
+{
+    if (simSession.device >= 0)
+        simSpiLatch = sim_session_byte(txData);
+}
+
+void receiveMasterSPI(uint8_t *rxData, unsigned int position)
+{
+    rxData[position] = simSpiLatch;
+}
+
+int8_t DRV_SPI_TransferData(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+    uint16_t position;
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    sim_blocking_begin();
+    sim_session_begin(spiSlaveDeviceIndex);
+    for (position = 0; position < spiTransferSize; position++)
+        SpiRxData[position] = sim_session_byte(SpiTxData[position]);
+    sim_session_end();
+    sim_blocking_end();
+    return 0;
+}
+
+int8_t DRV_SPI_TransferDataRead(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize, uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+    if (DRV_SPI_TransferReadBegin(spiSlaveDeviceIndex, SpiTxHeader, headerSize))
+        return -1;
+    DRV_SPI_TransferReadContinue(SpiRxData, spiTransferSize);
+    DRV_SPI_TransferReadEnd();
+    return 0;
+}
+
+int8_t DRV_SPI_TransferDataWrite(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize, const uint8_t *SpiTxData, uint16_t spiTransferSize)
+{
+    if (DRV_SPI_TransferWriteBegin(spiSlaveDeviceIndex, SpiTxHeader, headerSize))
+        return -1;
+    if (SpiTxData != NULL)
+        DRV_SPI_TransferWriteContinue(SpiTxData, spiTransferSize);
+    DRV_SPI_TransferWriteEnd();
+    return 0;
+}
+
+int8_t DRV_SPI_TransferWriteBegin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize)
+{
+    uint16_t position;
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    sim_blocking_begin();
+    sim_session_begin(spiSlaveDeviceIndex);
+    for (position = 0; position < headerSize; position++)
+        sim_session_byte(SpiTxHeader[position]);
+    return 0;
+}
+
+void DRV_SPI_TransferWriteContinue(const uint8_t *SpiTxData, uint16_t spiTransferSize)
+{
+    uint16_t position;
+    for (position = 0; position < spiTransferSize; position++)
+        sim_session_byte(SpiTxData != NULL ? SpiTxData[position] : 0);
+}
+
+void DRV_SPI_TransferWriteFill(uint8_t value, uint16_t spiTransferSize)
+{
+    while (spiTransferSize--)
+        sim_session_byte(value);
+}
+
+void DRV_SPI_TransferWriteEnd(void)
+{
+    sim_session_end();
+    sim_blocking_end();
+}
+
+int8_t DRV_SPI_TransferReadBegin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize)
+{
+    return DRV_SPI_TransferWriteBegin(spiSlaveDeviceIndex, SpiTxHeader, headerSize);
+}
+
+void DRV_SPI_TransferReadContinue(uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+    uint16_t position;
+    uint8_t rxByte;
+    for (position = 0; position < spiTransferSize; position++)
+    {
+        rxByte = sim_session_byte(0);
+        if (SpiRxData != NULL)
+            SpiRxData[position] = rxByte;
+    }
+}
+
+void DRV_SPI_TransferReadEnd(void)
+{
+    DRV_SPI_TransferWriteEnd();
+}
+
+// No DMA on the host: the transfer is done when this returns, the callback included
+int8_t DRV_SPI_TransferDataDma(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize, DRV_SPI_TRANSFER_CALLBACK callback)
+{
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT || spiTransferSize == 0)
+        return -2;
+    DRV_SPI_TransferData(spiSlaveDeviceIndex, SpiTxData, SpiRxData, spiTransferSize);
+    if (callback != NULL)
+        callback(spiSlaveDeviceIndex);
+    return 0;
+}
+
+uint8_t DRV_SPI_TransferBusy(void) {return 0;}
+
+void DRV_SPI_TransferWait(void) {}
+
+DRV_SPI_TRANSACTION_HANDLE DRV_SPI_TransactionSubmit(DRV_SPI_TRANSACTION* transaction)
+{
+    DRV_SPI_TRANSACTION_HANDLE handle;
+
+    if (transaction->headerSize > DRV_SPI_TRANSACTION_HEADER_LENGTH)
+        return -2;
+    if (transaction->headerSize + transaction->dataSize == 0)
+        return -2;
+    if (transaction->spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -2;
+    if (((simQueueHead - simQueueTail) & SIM_QUEUE_SEQUENCE_MASK) >= DRV_SPI_TRANSACTION_QUEUE_LENGTH)
+        return -1;
+    handle = simQueueHead;
+    simQueue[handle % DRV_SPI_TRANSACTION_QUEUE_LENGTH] = *transaction;
+    simQueueHead = (simQueueHead + 1) & SIM_QUEUE_SEQUENCE_MASK;
+    // The ISR runs it as soon as interrupts allow
+    sim_dispatch();
+    return handle;
+}
+
+DRV_SPI_TRANSACTION_STATUS DRV_SPI_TransactionStatusGet(DRV_SPI_TRANSACTION_HANDLE handle)
+{
+    uint16_t age;
+    sim_dispatch();
+    age = (handle - simQueueTail) & SIM_QUEUE_SEQUENCE_MASK;
+    if (age >= ((simQueueHead - simQueueTail) & SIM_QUEUE_SEQUENCE_MASK))
+        return DRV_SPI_TRANSACTION_COMPLETE;
+    return (age == 0) ? DRV_SPI_TRANSACTION_ACTIVE : DRV_SPI_TRANSACTION_QUEUED;
+}
+
+uint8_t DRV_SPI_TransactionQueueCount(void)
+{
+    sim_dispatch();
+    return (simQueueHead - simQueueTail) & SIM_QUEUE_SEQUENCE_MASK;
+}
+
+void DRV_SPI_TransactionQueueFlush(void)
+{
+    if (!simInIsr)
+        sim_queue_run();
+}
+
+void DRV_SPI_BusCapture(DRV_SPI_BUS_MODE mode) {simBusMode = mode;}
+
+DRV_SPI_BUS_MODE DRV_SPI_BusMode(void) {return simBusMode;}
+
+// UART telemetry goes to stdout
+uint16_t DRV_SPI_UartWrite(const uint8_t* data, uint16_t size)
+{
+    return fwrite(data, 1, size, stdout);
+}
+
+void DRV_SPI_UartFlush(void)
+{
+    fflush(stdout);
+}
+
+void DRV_SPI_UartSelect(void)
+{
+    simBusMode = DRV_SPI_BUS_UART;
+}
+
+void DRV_SPI_UartClockConfigure(uint16_t brw, uint16_t mctlw)
+{
+    (void) brw;
+    (void) mctlw;
+}
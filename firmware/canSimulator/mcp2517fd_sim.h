@@ -0,0 +1,127 @@
+#ifndef _MCP2517FD_SIM_H
+#define _MCP2517FD_SIM_H
+
+// Host-side behavioural model of the MCP2517FD behind the DRV_SPI API
+//
+// mcp2517fd_sim.c replaces drv_spi.c: drv_canfdspi_api.c and the mcp2517.h routines run unmodified
+// on top of it. Every chip select is decoded as a SPI instruction (RESET, READ, WRITE, READ_CRC,
+// WRITE_CRC, WRITE_SAFE) against a model of the controller registers, the SFRs and the 2 KB message
+// RAM. FIFOs, TXQ and TEF follow the head/tail/UINC/TXREQ rules of the datasheet, frames take bus
+// time at the nominal/data bit rates and the operation mode follows REQOP, out of Configuration Mode
+// after CANSIM_INTEGRATION_BITS. Until then CiFIFOUA and CiTEFUA read past the end of RAM.
+//
+// The MCU side is modelled as far as the firmware leans on it (msp430.h in this directory): P1.2
+// follows nINT and calls Port1_ISR on its falling edge, Timer B0 counts simulated time and calls
+// Timer0_B1_ISR, LPM0/LPM3 sleeps advance time to the next event, queued SPI transactions run as if
+// from the eUSCI_A0 ISR.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "../earlyConfigurationAndTests/mcp251x/canfdspi/drv_canfdspi_register.h"
+#include "../earlyConfigurationAndTests/mcp251x/spi/drv_spi.h"
+
+// Simulated clocks
+// MCLK = SMCLK follows DRV_SPI_ClockConfigure (configureClockProfile), 1Mhz out of reset
+#define CANSIM_SMCLK_RESET_HZ   1000000
+#define CANSIM_ACLK_HZ          32768       // Timer B0 tick, TIMEBASE_TICK_HZ in helper.h
+#define CANSIM_SYSCLK_HZ        20000000    // controller SYSCLK, TBC prescaler input
+#define CANSIM_OSC_START_NS     100000      // oscillator start-up after Sleep Mode
+#define CANSIM_INTEGRATION_BITS 11          // recessive nominal bits from REQOP to OPMOD leaving Configuration Mode
+#define CANSIM_SPI_SETUP_NS     2000        // driver and CS overhead per transfer at 24Mhz, on top of SCK time
+
+// An MCU sleep with nothing left to wake it gives up after this much simulated time
+#define CANSIM_SLEEP_LIMIT_NS   10000000000ULL
+
+// Bit rates of basicCANConfiguration (CAN_500K_2M)
+#define CANSIM_NOMINAL_BPS      500000
+#define CANSIM_DATA_BPS         2000000
+
+// Frames remembered by the bus log
+#define CANSIM_BUS_LOG_LENGTH   64
+
+//! A frame on the bus, as sent by the controller or injected by the host
+
+typedef struct {
+    uint32_t id;            // 11 or 29 bits
+    uint8_t ide;
+    uint8_t fdf;
+    uint8_t brs;
+    uint8_t dlc;
+    uint8_t seq;            // sent frames: SEQ of the object
+    uint8_t data[MAX_DATA_BYTES];
+    uint64_t sofNs;         // start of frame, simulated time
+} CANSIM_FRAME;
+
+//! SPI traffic counters, per controller
+
+typedef struct {
+    uint32_t transactions;  // chip select assertions
+    uint32_t bytes;         // bytes clocked, instruction and address included
+    uint32_t instructions[16];  // per instruction nibble
+    uint32_t crcErrors;     // WRITE_CRC/WRITE_SAFE refused
+    uint64_t busyNs;        // SCK time
+} CANSIM_SPI_STATS;
+
+//! Model state of one controller that the host may want to look at
+
+typedef struct {
+    uint32_t framesSent;
+    uint32_t framesReceived;    // accepted into a RX FIFO
+    uint32_t framesRejected;    // no filter matched
+    uint32_t rxOverflows;
+    uint32_t tefOverflows;
+    uint8_t nInt;               // level of nINT, 0: asserted
+} CANSIM_DEVICE_STATS;
+
+//! Reset simulated time, the controllers (power on) and the counters
+
+void CANSIM_Initialize(void);
+
+//! Simulated time
+
+uint64_t CANSIM_TimeNs(void);
+
+//! Let simulated time pass; frames on the bus complete and interrupts run (if enabled)
+
+void CANSIM_Advance(uint64_t ns);
+
+//! Run the bus until nothing is left to transmit, or maxNs passed
+
+void CANSIM_BusIdle(uint64_t maxNs);
+
+//! Hold back transmissions (contention: frames stay in their FIFOs) or release them
+
+void CANSIM_BusHold(bool hold);
+
+//! Put a frame on the bus, as sent by another node; it is received at the current time
+
+int8_t CANSIM_BusInject(uint8_t index, const CANSIM_FRAME* frame);
+
+//! Frames this controller sent, oldest first; returns how many were copied
+
+uint8_t CANSIM_BusLog(uint8_t index, CANSIM_FRAME* frames, uint8_t maxFrames);
+
+//! Error counters as the protocol engine would have them; tec > 255 is bus-off
+//! A bus-off controller recovers after recoverNs of bus idle, 0 keeps it off until reset
+
+void CANSIM_ErrorCountsSet(uint8_t index, uint16_t tec, uint8_t rec, uint64_t recoverNs);
+
+//! Corrupt the CRC of the next WRITE_CRC/WRITE_SAFE of a controller (it must refuse it)
+
+void CANSIM_CrcCorruptNext(uint8_t index);
+
+//! SPI counters
+
+void CANSIM_SpiStatsGet(uint8_t index, CANSIM_SPI_STATS* stats);
+void CANSIM_SpiStatsReset(void);
+
+//! Device counters and nINT
+
+void CANSIM_DeviceStatsGet(uint8_t index, CANSIM_DEVICE_STATS* stats);
+
+//! Direct access to the model address space (registers, RAM, SFRs); no side effects, no counting
+
+uint8_t CANSIM_Peek(uint8_t index, uint16_t address);
+uint32_t CANSIM_PeekWord(uint8_t index, uint16_t address);
+
+#endif  // _MCP2517FD_SIM_H
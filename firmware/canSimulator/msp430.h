@@ -0,0 +1,150 @@
+#ifndef _CANSIM_MSP430_H
+#define _CANSIM_MSP430_H
+
+// Host stand-in for the TI msp430.h, just what helper.h, mcp2517.h and the CAN driver touch
+// Registers are plain variables (mcp2517fd_sim.c) except TB0R, which counts simulated time; the
+// intrinsics go to the MCU model of mcp2517fd_sim.c. Bit values are those of the FR5738.
+
+#include <stdint.h>
+
+// Intrinsics
+#define __interrupt
+#define __even_in_range(value, range)   (value)
+#define __no_operation()                ((void) 0)
+#define __delay_cycles(cycles)          CANSIM_McuCycles(cycles)
+#define __get_interrupt_state()         CANSIM_McuInterruptState()
+#define __set_interrupt_state(state)    CANSIM_McuInterrupts(state)
+#define __enable_interrupt()            CANSIM_McuInterrupts(GIE)
+#define __disable_interrupt()           CANSIM_McuInterrupts(0)
+#define __bis_SR_register(bits)         CANSIM_McuSleep(bits)
+#define __bic_SR_register_on_exit(bits) CANSIM_McuExitSleep()
+
+void CANSIM_McuCycles(uint32_t cycles);
+void CANSIM_McuSleep(uint16_t bits);
+void CANSIM_McuExitSleep(void);
+void CANSIM_McuInterrupts(uint16_t state);
+uint16_t CANSIM_McuInterruptState(void);
+volatile uint16_t* CANSIM_TB0R(void);
+
+// Registers
+extern volatile uint16_t PM5CTL0, WDTCTL, SFRIFG1, FRCTL0;
+extern volatile uint16_t CSCTL0, CSCTL1, CSCTL2, CSCTL3, CSCTL4, CSCTL5;
+extern volatile uint8_t CSCTL0_H;
+extern volatile uint16_t TA0CTL, TA0EX0, TA0CCTL1, TA0CCR1, TA0IV, TA0R;
+extern volatile uint16_t TB0CTL, TB0EX0, TB0IV, TB0CCTL1, TB0CCR1;
+#define TB0R (*CANSIM_TB0R())
+extern volatile uint16_t UCA0CTLW0, UCA0BRW, UCA0MCTLW, UCA0STATW, UCA0IFG, UCA0IE, UCA0TXBUF, UCA0RXBUF;
+extern volatile uint8_t UCA0CTL1;
+extern volatile uint16_t UCB0CTLW0, UCB0BRW, UCB0STATW;
+extern volatile uint8_t UCB0CTL1;
+extern volatile uint8_t P1IN, P1OUT, P1DIR, P1SEL0, P1SEL1, P1IE, P1IES, P1IFG;
+extern volatile uint16_t P1IV;
+extern volatile uint8_t P2IN, P2OUT, P2DIR, P2SEL0, P2SEL1;
+extern volatile uint16_t PJOUT, PJDIR, PJSEL0, PJSEL1;
+
+// Status register
+#define GIE             0x0008
+#define CPUOFF          0x0010
+#define SCG0            0x0040
+#define SCG1            0x0080
+#define LPM0_bits       (CPUOFF)
+#define LPM3_bits       (SCG1|SCG0|CPUOFF)
+
+#define BIT0            0x0001
+#define BIT1            0x0002
+#define BIT2            0x0004
+#define BIT3            0x0008
+#define BIT4            0x0010
+#define BIT5            0x0020
+#define BIT6            0x0040
+#define BIT7            0x0080
+
+// PMM, WDT, SFR, FRAM
+#define LOCKLPM5        0x0001
+#define WDTPW           0x5A00
+#define WDTHOLD         0x0080
+#define OFIFG           0x0002
+#define FRCTLPW         0xA500
+#define NAUTO           0x0008
+#define NACCESS_0       0x0000
+#define NACCESS_1       0x0010
+#define NACCESS_2       0x0020
+#define NPRECHG_0       0x0000
+#define NPRECHG_1       0x0100
+
+// CS
+#define CSKEY           0xA500
+#define DCOFSEL0        0x0002
+#define DCOFSEL1        0x0004
+#define DCOFSEL_3       0x0006
+#define DCORSEL         0x0080
+#define SELA_0          0x0000
+#define SELA_3          0x0300
+#define SELS_3          0x0030
+#define SELM_3          0x0003
+#define SELA__XT1CLK    0x0000
+#define SELA__DCOCLK    0x0300
+#define SELS__DCOCLK    0x0030
+#define SELM__DCOCLK    0x0003
+#define DIVM_0          0x0000
+#define DIVA__1         0x0000
+#define DIVA__32        0x0500
+#define DIVS__1         0x0000
+#define DIVS__8         0x0030
+#define DIVM__1         0x0000
+#define DIVM__8         0x0003
+#define XT1OFF          0x0001
+#define XT1BYPASS       0x0010
+#define XTS             0x0020
+#define XT1DRIVE0       0x0040
+#define XT1DRIVE1       0x0080
+#define XT1OFFG         0x0001
+
+// Timer A / Timer B
+#define TASSEL__ACLK    0x0100
+#define TASSEL__SMCLK   0x0200
+#define TBSSEL__ACLK    0x0100
+#define MC0             0x0010
+#define MC1             0x0020
+#define MC__CONTINUOUS  0x0020
+#define ID0             0x0040
+#define ID1             0x0080
+#define ID__1           0x0000
+#define ID__4           0x0080
+#define ID__8           0x00C0
+#define TACLR           0x0004
+#define TBCLR           0x0004
+#define TBIE            0x0002
+#define TBIFG           0x0001
+#define CM_3            0xC000
+#define CCIS_0          0x0000
+#define SCS             0x0800
+#define CAP             0x0100
+#define CCIE            0x0010
+#define CCIFG           0x0001
+#define TB0IV_TBCCR1    0x0002
+#define TB0IV_TBIFG     0x000E
+
+// eUSCI
+#define UCSWRST         0x0001
+#define UCSYNC          0x0100
+#define UCMST           0x0800
+#define UCMODE0         0x0200
+#define UCMODE_0        0x0000
+#define UCMODE_3        0x0600
+#define UCSSEL_2        0x0080
+#define UCSSEL__SMCLK   0x0080
+#define UC7BIT          0x1000
+#define UCPEN           0x8000
+#define UCOS16          0x0001
+#define UCLISTEN        0x0080
+#define UCBUSY          0x0001
+#define UCBBUSY         0x0010
+#define UCRXIFG         0x0001
+#define UCTXIFG         0x0002
+
+// Port 1
+#define P1IV_P1IFG2     0x0006
+#define P1IV_P1IFG7     0x0010
+
+#endif  // _CANSIM_MSP430_H
@@ -0,0 +1,2 @@
+// Host stand-in, everything is in msp430.h
+#include "msp430.h"
@@ -0,0 +1,235 @@
+// Host run of drv_spi.c against the eUSCI_A0/DMA register model (uca0_sim.c)
+//
+// Build and run from this directory, once polled and once with the DMA transfers:
+//   gcc -std=gnu99 -Wall -Wno-unknown-pragmas -I. -o spiSim main.c uca0_sim.c ../../earlyConfigurationAndTests/mcp251x/spi/drv_spi.c
+//   gcc -std=gnu99 -Wall -Wno-unknown-pragmas -DSPI_USE_DMA -I. -o spiSimDma main.c uca0_sim.c ../../earlyConfigurationAndTests/mcp251x/spi/drv_spi.c
+//   ./spiSim && ./spiSimDma
+//
+// Every transfer shape is checked byte for byte against what the slave saw and answered, one frame per
+// CS assertion: the blocking transfers, the split and streamed ones (their DMA segments with
+// SPI_USE_DMA), a DMA transfer with queued work behind it, the transaction queue and the UART sharing
+// UCA0 with SPI. Prints one line per step, exits with 1 on a mismatch or a model error.
+
+#include <stdio.h>
+#include <string.h>
+#include "uca0_sim.h"
+#include "../../earlyConfigurationAndTests/mcp251x/spi/drv_spi.h"
+
+static uint8_t failures = 0;
+
+// Callbacks seen, in order
+static uint8_t calls[8];
+static uint8_t callCount = 0;
+
+static void dmaDone(uint8_t spiSlaveDeviceIndex)
+{
+    if (callCount < sizeof(calls))
+        calls[callCount++] = 0x80 | spiSlaveDeviceIndex;
+}
+
+static void transactionDone(DRV_SPI_TRANSACTION* transaction)
+{
+    if (callCount < sizeof(calls))
+        calls[callCount++] = *(uint8_t*) transaction->context;
+}
+
+static void report(const char* step, uint8_t ok)
+{
+    printf("%-14s %s, %u frames, %lu ticks\n", step, ok ? "ok" : "FAIL", SPISIM_FrameCount(),
+           (unsigned long) SPISIM_Ticks());
+    if (!ok)
+        failures++;
+    SPISIM_LogReset();
+}
+
+// Frame carries exactly these bytes
+static uint8_t frameIs(uint8_t frame, const uint8_t* expected, uint16_t size)
+{
+    const uint8_t* mosi;
+    return SPISIM_Frame(frame, &mosi) == size && memcmp(mosi, expected, size) == 0;
+}
+
+// Bytes are what the slave answered from a position of the frame on
+static uint8_t misoIs(uint8_t frame, uint16_t position, const uint8_t* rx, uint16_t size)
+{
+    for (uint16_t i = 0; i < size; i++)
+        if (rx[i] != SPISIM_SlaveMiso(frame, position + i))
+            return 0;
+    return 1;
+}
+
+// Same register sequence as initializeUART in helper.h
+static void uartInitialize(void)
+{
+    UCA0CTLW0 = UCSWRST;
+    P2SEL1 &= ~(BIT0|BIT1);
+    P2SEL0 |= (BIT0|BIT1);
+    UCA0CTLW0 |= (UCMODE0|UCSSEL__SMCLK);
+    UCA0CTLW0 &= ~(UCSYNC|UCPEN|UC7BIT);
+    UCA0BRW = 6;
+    UCA0MCTLW = 0x2081;
+    UCA0STATW |= UCLISTEN;
+    UCA0CTLW0 &= ~UCSWRST;
+    DRV_SPI_BusCapture(DRV_SPI_BUS_UART);
+}
+
+int main(void)
+{
+    static const uint8_t text[] = "UART between transfers\n";
+    static const uint8_t polled[] = "polled\n";
+    uint8_t tx[64], rx[64], expected[96], header[3] = {0x30, 0x04, 0x5C};
+    uint8_t r1[4], r2[16], r3[2], queueRx[8], ids[5] = {0, 1, 2, 3, 4};
+    DRV_SPI_TRANSACTION transactions[5];
+    DRV_SPI_TRANSACTION_HANDLE handles[5];
+    const uint8_t* uart;
+    uint16_t uartLength;
+    uint8_t i, ok;
+
+    for (i = 0; i < sizeof(tx); i++)
+        tx[i] = (uint8_t) (5 * i + 1);
+
+    SPISIM_Initialize();
+    uartInitialize();
+    DRV_SPI_ClockConfigure(24000000);
+    DRV_SPI_Initialize();
+    __enable_interrupt();
+    report("initialize", (P2OUT & BIT2) && (P2DIR & BIT2) && DRV_SPI_BusMode() == DRV_SPI_BUS_SPI
+           && UCA0BRW == 3 && (UCA0CTLW0 & (UCSYNC|UCMST|UCSWRST)) == (UCSYNC|UCMST));
+
+    // Whole transfers, short (polled even with SPI_USE_DMA) and long
+    ok = DRV_SPI_TransferData(DRV_CANFDSPI_INDEX_0, tx, rx, 3) == 0 && frameIs(0, tx, 3) && misoIs(0, 0, rx, 3);
+    ok &= DRV_SPI_TransferData(DRV_CANFDSPI_INDEX_0, tx, rx, 40) == 0 && frameIs(1, tx, 40) && misoIs(1, 0, rx, 40);
+    report("transfer", ok && (P2OUT & BIT2));
+
+    // Split read: header, then dummy bytes under the same CS
+    memset(expected, 0, sizeof(expected));
+    memcpy(expected, header, 2);
+    ok = DRV_SPI_TransferDataRead(DRV_CANFDSPI_INDEX_0, header, 2, rx, 4) == 0 && frameIs(0, expected, 6)
+         && misoIs(0, 2, rx, 4);
+    ok &= DRV_SPI_TransferDataRead(DRV_CANFDSPI_INDEX_0, header, 2, rx, 64) == 0 && frameIs(1, expected, 66)
+          && misoIs(1, 2, rx, 64);
+    report("read", ok);
+
+    // Split write, then a read that must not see what the write left in RXBUF
+    memcpy(expected, header, 2);
+    memcpy(expected + 2, tx, 30);
+    ok = DRV_SPI_TransferDataWrite(DRV_CANFDSPI_INDEX_0, header, 2, tx, 30) == 0 && frameIs(0, expected, 32);
+    ok &= DRV_SPI_TransferDataWrite(DRV_CANFDSPI_INDEX_0, header, 2, tx, 5) == 0 && frameIs(1, expected, 7);
+    ok &= DRV_SPI_TransferDataRead(DRV_CANFDSPI_INDEX_0, header, 2, rx, 4) == 0 && misoIs(2, 2, rx, 4);
+    report("write", ok);
+
+    // Streamed write: data, fill, zeros and data again, one CS assertion
+    memcpy(expected, header, 3);
+    memcpy(expected + 3, tx, 10);
+    memset(expected + 13, 0xA5, 12);
+    memset(expected + 25, 0, 9);
+    memcpy(expected + 34, tx + 10, 3);
+    ok = DRV_SPI_TransferWriteBegin(DRV_CANFDSPI_INDEX_0, header, 3) == 0;
+    DRV_SPI_TransferWriteContinue(tx, 10);
+    DRV_SPI_TransferWriteFill(0xA5, 12);
+    DRV_SPI_TransferWriteContinue(NULL, 9);
+    DRV_SPI_TransferWriteContinue(tx + 10, 3);
+    ok &= !(P2OUT & BIT2);
+    DRV_SPI_TransferWriteEnd();
+    report("stream write", ok && frameIs(0, expected, 37) && (P2OUT & BIT2));
+
+    // Streamed read: short, dropped, long and short segments
+    memset(expected, 0, sizeof(expected));
+    memcpy(expected, header, 2);
+    ok = DRV_SPI_TransferReadBegin(DRV_CANFDSPI_INDEX_0, header, 2) == 0;
+    DRV_SPI_TransferReadContinue(r1, sizeof(r1));
+    DRV_SPI_TransferReadContinue(NULL, 10);
+    DRV_SPI_TransferReadContinue(r2, sizeof(r2));
+    DRV_SPI_TransferReadContinue(r3, sizeof(r3));
+    DRV_SPI_TransferReadEnd();
+    report("stream read", ok && frameIs(0, expected, 34) && misoIs(0, 2, r1, 4) && misoIs(0, 16, r2, 16)
+           && misoIs(0, 32, r3, 2) && (P2OUT & BIT2));
+
+    // DMA transfer in flight: a queued transaction waits for it, a second DMA transfer is refused
+    memset(transactions, 0, sizeof(transactions));
+    transactions[0].header[0] = 0x30;
+    transactions[0].header[1] = 0x10;
+    transactions[0].headerSize = 2;
+    transactions[0].rxData = queueRx;
+    transactions[0].dataSize = 6;
+    transactions[0].callback = transactionDone;
+    transactions[0].context = &ids[0];
+    callCount = 0;
+    ok = DRV_SPI_TransferDataDma(DRV_CANFDSPI_INDEX_0, tx, rx, 24, dmaDone) == 0 && DRV_SPI_TransferBusy();
+    handles[0] = DRV_SPI_TransactionSubmit(&transactions[0]);
+    ok &= handles[0] >= 0 && DRV_SPI_TransactionStatusGet(handles[0]) == DRV_SPI_TRANSACTION_ACTIVE;
+    ok &= DRV_SPI_TransferDataDma(DRV_CANFDSPI_INDEX_0, tx, rx, 8, dmaDone) == -1;
+    DRV_SPI_TransferWait();
+    DRV_SPI_TransactionQueueFlush();
+    memset(expected, 0, sizeof(expected));
+    memcpy(expected, transactions[0].header, 2);
+    report("dma", ok && frameIs(0, tx, 24) && misoIs(0, 0, rx, 24) && frameIs(1, expected, 8)
+           && misoIs(1, 2, queueRx, 6) && callCount == 2 && calls[0] == 0x80 && calls[1] == 0
+           && DRV_SPI_TransactionStatusGet(handles[0]) == DRV_SPI_TRANSACTION_COMPLETE);
+
+    // Queue: filled with interrupts off, then a blocking transfer has to wait for all of it
+    for (i = 0; i < 5; i++)
+    {
+        transactions[i] = transactions[0];
+        transactions[i].header[1] = 0x20 + i;
+        transactions[i].context = &ids[i];
+    }
+    transactions[0].rxData = NULL;
+    transactions[0].txData = tx;
+    transactions[0].dataSize = 5;
+    transactions[1].rxData = queueRx;
+    transactions[1].dataSize = 8;
+    transactions[2].headerSize = 1;
+    transactions[2].rxData = NULL;
+    transactions[2].dataSize = 0;
+    transactions[3].txData = tx + 8;
+    transactions[3].rxData = r1;
+    transactions[3].dataSize = 4;
+    callCount = 0;
+    __disable_interrupt();
+    ok = 1;
+    for (i = 0; i < 5; i++)
+        handles[i] = DRV_SPI_TransactionSubmit(&transactions[i]);
+    ok &= handles[3] >= 0 && handles[4] == -1 && DRV_SPI_TransactionQueueCount() == 4;
+    ok &= DRV_SPI_TransactionStatusGet(handles[0]) == DRV_SPI_TRANSACTION_ACTIVE
+          && DRV_SPI_TransactionStatusGet(handles[1]) == DRV_SPI_TRANSACTION_QUEUED;
+    __enable_interrupt();
+    ok &= DRV_SPI_TransferData(DRV_CANFDSPI_INDEX_0, tx, rx, 16) == 0 && DRV_SPI_TransactionQueueCount() == 0;
+    memcpy(expected, transactions[0].header, 2);
+    memcpy(expected + 2, tx, 5);
+    ok &= frameIs(0, expected, 7);
+    memset(expected, 0, sizeof(expected));
+    memcpy(expected, transactions[1].header, 2);
+    ok &= frameIs(1, expected, 10) && misoIs(1, 2, queueRx, 8);
+    ok &= frameIs(2, transactions[2].header, 1);
+    memcpy(expected, transactions[3].header, 2);
+    memcpy(expected + 2, tx + 8, 4);
+    ok &= frameIs(3, expected, 6) && misoIs(3, 2, r1, 4);
+    ok &= frameIs(4, tx, 16) && misoIs(4, 0, rx, 16);
+    report("queue", ok && callCount == 4 && calls[0] == 0 && calls[1] == 1 && calls[2] == 2 && calls[3] == 3
+           && DRV_SPI_TransactionStatusGet(handles[3]) == DRV_SPI_TRANSACTION_COMPLETE);
+
+    // UART bytes go out between SPI transfers and queued transactions
+    ok = DRV_SPI_UartWrite(text, sizeof(text) - 1) == sizeof(text) - 1 && DRV_SPI_BusMode() == DRV_SPI_BUS_UART;
+    SPISIM_Run(30);
+    ok &= DRV_SPI_TransferData(DRV_CANFDSPI_INDEX_0, tx, rx, 16) == 0 && DRV_SPI_BusMode() == DRV_SPI_BUS_UART;
+    SPISIM_Run(30);
+    handles[0] = DRV_SPI_TransactionSubmit(&transactions[1]);
+    DRV_SPI_TransactionQueueFlush();
+    ok &= handles[0] >= 0;
+    DRV_SPI_UartFlush();
+    ok &= frameIs(0, tx, 16) && misoIs(0, 0, rx, 16) && misoIs(1, 2, queueRx, 8);
+    // With interrupts off the flush polls
+    __disable_interrupt();
+    ok &= DRV_SPI_UartWrite(polled, sizeof(polled) - 1) == sizeof(polled) - 1;
+    DRV_SPI_UartFlush();
+    __enable_interrupt();
+    uartLength = SPISIM_UartLog(&uart);
+    ok &= uartLength == sizeof(text) + sizeof(polled) - 2 && memcmp(uart, text, sizeof(text) - 1) == 0
+          && memcmp(uart + sizeof(text) - 1, polled, sizeof(polled) - 1) == 0;
+    ok &= DRV_SPI_TransferData(DRV_CANFDSPI_INDEX_0, tx, rx, 12) == 0 && frameIs(2, tx, 12) && misoIs(2, 0, rx, 12);
+    report("uart", ok);
+
+    printf("model errors %u, RXBUF overruns %u\n", SPISIM_Errors(), SPISIM_Overruns());
+    return failures || SPISIM_Errors() ? 1 : 0;
+}
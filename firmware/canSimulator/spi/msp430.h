@@ -0,0 +1,123 @@
+#ifndef _SPISIM_MSP430_H
+#define _SPISIM_MSP430_H
+
+// Host stand-in for the TI msp430.h, just what drv_spi.c touches
+// eUSCI_A0 and the DMA controller are modelled by uca0_sim.c: the registers the model has to see being
+// accessed go through its functions, every access advances it by one tick. The rest are plain variables.
+// Bit values are those of the FR5738.
+
+#include <stdint.h>
+
+// Intrinsics
+#define __interrupt
+#define __even_in_range(value, range)   (value)
+#define __no_operation()                ((void) 0)
+#define __get_interrupt_state()         SPISIM_McuInterruptState()
+#define __set_interrupt_state(state)    SPISIM_McuInterrupts(state)
+#define __enable_interrupt()            SPISIM_McuInterrupts(GIE)
+#define __disable_interrupt()           SPISIM_McuInterrupts(0)
+#define __bis_SR_register(bits)         SPISIM_McuSleep(bits)
+#define __bic_SR_register_on_exit(bits) SPISIM_McuExitSleep()
+#define __data16_write_addr(address, value) SPISIM_DmaAddressWrite(address, value)
+
+// drv_spi.c cuts register addresses to 16 bits for __data16_write_addr, as the FR5738 takes them
+#pragma GCC diagnostic ignored "-Wpointer-to-int-cast"
+
+void SPISIM_McuSleep(uint16_t bits);
+void SPISIM_McuExitSleep(void);
+void SPISIM_McuInterrupts(uint16_t state);
+uint16_t SPISIM_McuInterruptState(void);
+void SPISIM_DmaAddressWrite(unsigned short address, unsigned long value);
+
+// Registers
+typedef enum {
+    SPISIM_UCA0CTLW0,
+    SPISIM_UCA0BRW,
+    SPISIM_UCA0MCTLW,
+    SPISIM_UCA0STATW,
+    SPISIM_UCA0IFG,
+    SPISIM_UCA0IE,
+    SPISIM_UCA0TXBUF,
+    SPISIM_UCA0RXBUF
+} SPISIM_REGISTER;
+
+volatile uint16_t* SPISIM_Register(SPISIM_REGISTER reg);
+uint16_t SPISIM_Uca0Iv(void);
+uint16_t SPISIM_DmaIv(void);
+
+#define UCA0CTLW0       (*SPISIM_Register(SPISIM_UCA0CTLW0))
+#define UCA0CTL1        (*(volatile uint8_t*) SPISIM_Register(SPISIM_UCA0CTLW0))  // low byte, holds UCSWRST
+#define UCA0BRW         (*SPISIM_Register(SPISIM_UCA0BRW))
+#define UCA0MCTLW       (*SPISIM_Register(SPISIM_UCA0MCTLW))
+#define UCA0STATW       (*SPISIM_Register(SPISIM_UCA0STATW))
+#define UCA0IFG         (*SPISIM_Register(SPISIM_UCA0IFG))
+#define UCA0IE          (*SPISIM_Register(SPISIM_UCA0IE))
+#define UCA0TXBUF       (*SPISIM_Register(SPISIM_UCA0TXBUF))
+#define UCA0RXBUF       (*SPISIM_Register(SPISIM_UCA0RXBUF))
+#define UCA0IV          SPISIM_Uca0Iv()
+#define DMAIV           SPISIM_DmaIv()
+
+extern volatile uint16_t DMACTL0, DMA0CTL, DMA0SZ, DMA1CTL, DMA1SZ;
+extern volatile unsigned long DMA0SA, DMA0DA, DMA1SA, DMA1DA;
+extern volatile uint8_t P1SEL0, P1SEL1, P2OUT, P2DIR, P2SEL0, P2SEL1;
+
+// Status register
+#define GIE             0x0008
+#define CPUOFF          0x0010
+#define LPM0_bits       (CPUOFF)
+
+#define BIT0            0x0001
+#define BIT1            0x0002
+#define BIT2            0x0004
+#define BIT3            0x0008
+#define BIT4            0x0010
+#define BIT5            0x0020
+#define BIT6            0x0040
+#define BIT7            0x0080
+
+// eUSCI
+#define UCSWRST         0x0001
+#define UCSSEL__SMCLK   0x0080
+#define UCSYNC          0x0100
+#define UCMODE0         0x0200
+#define UCMODE_0        0x0000
+#define UCMST           0x0800
+#define UC7BIT          0x1000
+#define UCMSB           0x2000
+#define UCCKPL          0x4000
+#define UCCKPH          0x8000
+#define UCPEN           0x8000
+#define UCOS16          0x0001
+#define UCBUSY          0x0001
+#define UCOE            0x0020
+#define UCLISTEN        0x0080
+#define UCRXIFG         0x0001
+#define UCTXIFG         0x0002
+#define UCRXIE          0x0001
+#define UCTXIE          0x0002
+#define USCI_SPI_UCRXIFG        0x0002
+#define USCI_SPI_UCTXIFG        0x0004
+#define USCI_UART_UCRXIFG       0x0002
+#define USCI_UART_UCTXIFG       0x0004
+#define USCI_UART_UCTXCPTIFG    0x0008
+
+// DMA
+#define DMADT_0         0x0000
+#define DMADSTINCR_0    0x0000
+#define DMADSTINCR_3    0x0C00
+#define DMASRCINCR_0    0x0000
+#define DMASRCINCR_3    0x0300
+#define DMADSTBYTE      0x0080
+#define DMASRCBYTE      0x0040
+#define DMAEN           0x0010
+#define DMAIFG          0x0008
+#define DMAIE           0x0004
+#define DMAIV_DMA0IFG   0x0002
+#define DMAIV_DMA1IFG   0x0004
+#define DMAIV_DMA2IFG   0x0006
+
+// Interrupt vectors, the model calls the ISRs directly
+#define DMA_VECTOR      0
+#define USCI_A0_VECTOR  0
+
+#endif  // _SPISIM_MSP430_H
@@ -0,0 +1,430 @@
+// eUSCI_A0, DMA and SPI slave model for drv_spi.c, see uca0_sim.h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "msp430.h"
+#include "uca0_sim.h"
+
+// ISRs of drv_spi.c
+void DMA_ISR(void);
+void USCI_A0_ISR(void);
+
+// DMA trigger sources of the FR573x (DMAxTSEL)
+#define SIM_TRIGGER_UCA0RXIFG   14
+#define SIM_TRIGGER_UCA0TXIFG   15
+
+// TXBUF reads back this until the driver writes it, so the next access can tell a write happened
+#define SIM_TXBUF_UNWRITTEN     0xFFFF
+
+// Registers of msp430.h
+volatile uint16_t DMACTL0, DMA0CTL, DMA0SZ, DMA1CTL, DMA1SZ;
+volatile unsigned long DMA0SA, DMA0DA, DMA1SA, DMA1DA;
+volatile uint8_t P1SEL0, P1SEL1, P2OUT, P2DIR, P2SEL0, P2SEL1;
+
+static volatile uint16_t simRegisters[SPISIM_UCA0RXBUF + 1];
+#define simCtlw0    simRegisters[SPISIM_UCA0CTLW0]
+#define simStatw    simRegisters[SPISIM_UCA0STATW]
+#define simIfg      simRegisters[SPISIM_UCA0IFG]
+#define simIe       simRegisters[SPISIM_UCA0IE]
+#define simTxbuf    simRegisters[SPISIM_UCA0TXBUF]
+#define simRxbuf    simRegisters[SPISIM_UCA0RXBUF]
+
+// eUSCI_A0: TXBUF, shift register and a RXBUF read that takes effect on the next access
+static uint8_t simTxFull = 0;
+static uint8_t simTxByte;
+static uint8_t simShiftTicks = 0;       // left on the byte in the shift register, 0: idle
+static uint8_t simShiftSpi;
+static uint8_t simShiftMiso;
+static uint8_t simRxRead = 0;
+
+// DMA channels 0 and 1, latched when DMAEN is set
+typedef struct {
+    volatile uint16_t* ctl;
+    volatile unsigned long* sa;
+    volatile unsigned long* da;
+    volatile uint16_t* sz;
+    uint8_t armed;
+    unsigned long source;
+    unsigned long destination;
+    uint16_t size;
+} SIM_DMA_CHANNEL;
+
+static SIM_DMA_CHANNEL simDma[2] = {
+    {&DMA0CTL, &DMA0SA, &DMA0DA, &DMA0SZ},
+    {&DMA1CTL, &DMA1SA, &DMA1DA, &DMA1SZ},
+};
+
+// CPU
+static uint8_t simGie = 0;
+static uint8_t simWake = 0;
+static uint32_t simTicks = 0;
+
+// Slave and UART logs
+static uint8_t simMosi[SPISIM_MOSI_LENGTH];
+static uint16_t simMosiLength = 0;
+static struct {
+    uint16_t start;
+    uint16_t length;
+} simFrames[SPISIM_FRAME_LENGTH];
+static uint8_t simFrameCount = 0;
+static uint8_t simCsReleased = 1;       // CS went high since the last byte, the next one opens a frame
+static uint8_t simUart[SPISIM_UART_LENGTH];
+static uint16_t simUartLength = 0;
+
+static uint16_t simErrors = 0;
+static uint16_t simOverruns = 0;
+
+static void sim_error(const char* what)
+{
+    if (simErrors < 10)
+        printf("model: %s (tick %lu)\n", what, (unsigned long) simTicks);
+    simErrors++;
+}
+
+static void sim_dma_trigger(uint8_t trigger);
+
+static void sim_tx_write(uint8_t value)
+{
+    if (simCtlw0 & UCSWRST)
+        return;
+    if (simTxFull)
+        sim_error("TXBUF written while full");
+    simTxFull = 1;
+    simTxByte = value;
+    simIfg &= ~UCTXIFG;
+}
+
+static uint8_t sim_rx_read(void)
+{
+    simIfg &= ~UCRXIFG;
+    simStatw &= ~UCOE;
+    return (uint8_t) simRxbuf;
+}
+
+// TXBUF moves to the shift register, the slave sees the byte
+static void sim_shift_start(void)
+{
+    uint8_t cs = (P2OUT & BIT2) == 0;
+
+    simShiftSpi = (simCtlw0 & UCSYNC) != 0;
+    simShiftTicks = simShiftSpi ? SPISIM_SPI_BYTE_TICKS : SPISIM_UART_BYTE_TICKS;
+    simTxFull = 0;
+    if (simShiftSpi)
+    {
+        if (!cs)
+            sim_error("SPI byte clocked with CS high");
+        else if (simMosiLength < SPISIM_MOSI_LENGTH)
+        {
+            if (simCsReleased && simFrameCount < SPISIM_FRAME_LENGTH)
+            {
+                simFrames[simFrameCount].start = simMosiLength;
+                simFrames[simFrameCount].length = 0;
+                simFrameCount++;
+            }
+            simCsReleased = 0;
+            simShiftMiso = SPISIM_SlaveMiso(simFrameCount - 1, simFrames[simFrameCount - 1].length);
+            simMosi[simMosiLength++] = simTxByte;
+            simFrames[simFrameCount - 1].length++;
+        }
+    }
+    else
+    {
+        if (cs)
+            sim_error("UART byte sent with CS asserted");
+        if (simUartLength < SPISIM_UART_LENGTH)
+            simUart[simUartLength++] = simTxByte;
+    }
+    simIfg |= UCTXIFG;
+    sim_dma_trigger(SIM_TRIGGER_UCA0TXIFG);
+}
+
+// Last bit in: the slave's answer lands in RXBUF (the UART side receives nothing)
+static void sim_shift_end(void)
+{
+    if (!simShiftSpi)
+        return;
+    if (simIfg & UCRXIFG)
+    {
+        simStatw |= UCOE;
+        simOverruns++;
+        if (simDma[0].armed)
+            sim_error("RXBUF overrun while DMA channel 0 is armed");
+        simRxbuf = simShiftMiso;
+        return;
+    }
+    simRxbuf = simShiftMiso;
+    simIfg |= UCRXIFG;
+    sim_dma_trigger(SIM_TRIGGER_UCA0RXIFG);
+}
+
+// One byte per trigger edge, channel 0 first
+static void sim_dma_trigger(uint8_t trigger)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        SIM_DMA_CHANNEL* channel = &simDma[i];
+        uint8_t select = (i == 0) ? (DMACTL0 & 0x1F) : ((DMACTL0 >> 8) & 0x1F);
+        uint8_t value;
+
+        if (!channel->armed || select != trigger)
+            continue;
+        if (channel->source == (unsigned long) &simRxbuf)
+            value = sim_rx_read();
+        else
+            value = *(uint8_t*) channel->source;
+        if (channel->destination == (unsigned long) &simTxbuf)
+            sim_tx_write(value);
+        else
+            *(uint8_t*) channel->destination = value;
+        if ((*channel->ctl & DMASRCINCR_3) == DMASRCINCR_3)
+            channel->source++;
+        if ((*channel->ctl & DMADSTINCR_3) == DMADSTINCR_3)
+            channel->destination++;
+        if (--channel->size == 0)
+        {
+            channel->armed = 0;
+            *channel->ctl = (*channel->ctl & ~DMAEN) | DMAIFG;
+        }
+    }
+}
+
+// Setting DMAEN latches addresses and size, clearing it stops the channel
+static void sim_dma_arm(void)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        SIM_DMA_CHANNEL* channel = &simDma[i];
+        if (!(*channel->ctl & DMAEN))
+            channel->armed = 0;
+        else if (!channel->armed)
+        {
+            if (*channel->sz == 0)
+                sim_error("DMA channel armed with size 0");
+            channel->armed = 1;
+            channel->source = *channel->sa;
+            channel->destination = *channel->da;
+            channel->size = *channel->sz;
+        }
+    }
+}
+
+static void sim_isr(void (*isr)(void))
+{
+    uint8_t gie = simGie;
+    simGie = 0;
+    isr();
+    simGie = gie;
+}
+
+static void sim_dispatch(void)
+{
+    uint8_t again = 1;
+    while (simGie && again)
+    {
+        again = 0;
+        if ((DMA0CTL & (DMAIFG|DMAIE)) == (DMAIFG|DMAIE) || (DMA1CTL & (DMAIFG|DMAIE)) == (DMAIFG|DMAIE))
+        {
+            sim_isr(DMA_ISR);
+            again = 1;
+        }
+        else if (simIe & simIfg & (UCRXIE|UCTXIE))
+        {
+            sim_isr(USCI_A0_ISR);
+            again = 1;
+        }
+    }
+}
+
+// One tick: apply the driver's last access, move the shift register, raise interrupts
+static void sim_step(void)
+{
+    if (simTxbuf != SIM_TXBUF_UNWRITTEN)
+    {
+        sim_tx_write((uint8_t) simTxbuf);
+        simTxbuf = SIM_TXBUF_UNWRITTEN;
+    }
+    if (simRxRead)
+    {
+        sim_rx_read();
+        simRxRead = 0;
+    }
+    if (++simTicks > SPISIM_TICK_LIMIT)
+    {
+        printf("model: no progress after %lu ticks, giving up\n", (unsigned long) simTicks);
+        exit(2);
+    }
+    if (P2OUT & BIT2)
+    {
+        if (simShiftTicks && simShiftSpi)
+            sim_error("CS released mid-byte");
+        simCsReleased = 1;
+    }
+    sim_dma_arm();
+    if (simCtlw0 & UCSWRST)
+    {
+        // Reset: shifting stops, flags and enables as the user's guide lists them
+        if (simShiftTicks || simTxFull)
+            sim_error("UCSWRST set mid-byte");
+        simShiftTicks = 0;
+        simTxFull = 0;
+        simIe &= ~(UCRXIE|UCTXIE);
+        simIfg = UCTXIFG;
+        simStatw &= ~(UCBUSY|UCOE);
+        return;
+    }
+    if (simShiftTicks && --simShiftTicks == 0)
+        sim_shift_end();
+    if (!simShiftTicks && simTxFull)
+        sim_shift_start();
+    if (simShiftTicks || simTxFull)
+        simStatw |= UCBUSY;
+    else
+        simStatw &= ~UCBUSY;
+    sim_dispatch();
+}
+
+volatile uint16_t* SPISIM_Register(SPISIM_REGISTER reg)
+{
+    sim_step();
+    // Reading RXBUF clears UCRXIFG and UCOE, unless the access only took its address (DMA setup)
+    if (reg == SPISIM_UCA0RXBUF)
+        simRxRead = 1;
+    return &simRegisters[reg];
+}
+
+// Reading the vector clears the flag it reports
+uint16_t SPISIM_Uca0Iv(void)
+{
+    sim_step();
+    if (simIe & simIfg & UCRXIE)
+    {
+        simIfg &= ~UCRXIFG;
+        return USCI_SPI_UCRXIFG;
+    }
+    if (simIe & simIfg & UCTXIE)
+    {
+        simIfg &= ~UCTXIFG;
+        return USCI_SPI_UCTXIFG;
+    }
+    return 0;
+}
+
+uint16_t SPISIM_DmaIv(void)
+{
+    sim_step();
+    if ((DMA0CTL & (DMAIFG|DMAIE)) == (DMAIFG|DMAIE))
+    {
+        DMA0CTL &= ~DMAIFG;
+        return DMAIV_DMA0IFG;
+    }
+    if ((DMA1CTL & (DMAIFG|DMAIE)) == (DMAIFG|DMAIE))
+    {
+        DMA1CTL &= ~DMAIFG;
+        return DMAIV_DMA1IFG;
+    }
+    return 0;
+}
+
+// __data16_write_addr gets the register address cut to 16 bits, as the FR5738 has it
+void SPISIM_DmaAddressWrite(unsigned short address, unsigned long value)
+{
+    volatile unsigned long* registers[] = {&DMA0SA, &DMA0DA, &DMA1SA, &DMA1DA};
+    uint8_t found = 0;
+
+    if (value == (unsigned long) &simRxbuf)
+        simRxRead = 0;
+    for (uint8_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++)
+    {
+        if ((unsigned short) (uintptr_t) registers[i] == address)
+        {
+            *registers[i] = value;
+            found++;
+        }
+    }
+    if (found != 1)
+        sim_error("__data16_write_addr to an unknown DMA address register");
+}
+
+void SPISIM_McuSleep(uint16_t bits)
+{
+    simWake = 0;
+    SPISIM_McuInterrupts(bits & GIE);
+    if (bits & CPUOFF)
+    {
+        if (!simGie)
+            sim_error("LPM0 entered with interrupts disabled");
+        while (!simWake)
+            sim_step();
+    }
+    simWake = 0;
+}
+
+void SPISIM_McuExitSleep(void) {simWake = 1;}
+
+void SPISIM_McuInterrupts(uint16_t state)
+{
+    simGie = (state & GIE) != 0;
+    sim_dispatch();
+}
+
+uint16_t SPISIM_McuInterruptState(void) {return simGie ? GIE : 0;}
+
+// Simulation control
+
+void SPISIM_Initialize(void)
+{
+    memset((void*) simRegisters, 0, sizeof(simRegisters));
+    simCtlw0 = UCSWRST;
+    simIfg = UCTXIFG;
+    simTxbuf = SIM_TXBUF_UNWRITTEN;
+    simTxFull = 0;
+    simShiftTicks = 0;
+    simRxRead = 0;
+    DMACTL0 = DMA0CTL = DMA0SZ = DMA1CTL = DMA1SZ = 0;
+    simDma[0].armed = simDma[1].armed = 0;
+    P2OUT = P2DIR = P2SEL0 = P2SEL1 = P1SEL0 = P1SEL1 = 0;
+    simGie = 0;
+    simTicks = 0;
+    simErrors = 0;
+    simOverruns = 0;
+    SPISIM_LogReset();
+}
+
+void SPISIM_LogReset(void)
+{
+    simMosiLength = 0;
+    simFrameCount = 0;
+    simCsReleased = 1;
+    simUartLength = 0;
+}
+
+void SPISIM_Run(uint32_t ticks)
+{
+    while (ticks--)
+        sim_step();
+}
+
+uint32_t SPISIM_Ticks(void) {return simTicks;}
+
+uint8_t SPISIM_SlaveMiso(uint8_t frame, uint16_t position) {return (uint8_t) (0x5A + 17 * frame + 3 * position);}
+
+uint8_t SPISIM_FrameCount(void) {return simFrameCount;}
+
+uint16_t SPISIM_Frame(uint8_t frame, const uint8_t** mosi)
+{
+    if (frame >= simFrameCount)
+        return 0;
+    *mosi = &simMosi[simFrames[frame].start];
+    return simFrames[frame].length;
+}
+
+uint16_t SPISIM_UartLog(const uint8_t** bytes)
+{
+    *bytes = simUart;
+    return simUartLength;
+}
+
+uint16_t SPISIM_Errors(void) {return simErrors;}
+
+uint16_t SPISIM_Overruns(void) {return simOverruns;}
@@ -0,0 +1,65 @@
+#ifndef _UCA0_SIM_H
+#define _UCA0_SIM_H
+
+// Host-side register model of eUSCI_A0, DMA channels 0/1 and the SPI slave behind P2.2, for drv_spi.c
+//
+// drv_spi.c runs unmodified against msp430.h in this directory. Time moves one tick per register
+// access: TXBUF is double buffered, a byte shifts for a few ticks, then lands in RXBUF with UCRXIFG
+// (UCOE if the previous one was not read). UCRXIFG/UCTXIFG rising edges trigger the DMA channels
+// selected in DMACTL0; channel interrupts and the eUSCI_A0 interrupts call DMA_ISR/USCI_A0_ISR while
+// GIE is set, and LPM0 sleeps tick until an ISR exits them.
+//
+// The slave logs every byte clocked while its CS is low, one frame per CS assertion, and answers with
+// SPISIM_SlaveMiso. With UCSYNC clear, bytes go to the UART log instead. What the driver must never
+// do is counted as an error and printed: clock SPI with CS high, send UART with CS low, release CS or
+// reset UCA0 mid-byte, overwrite a full TXBUF, overrun RXBUF while DMA channel 0 drains it.
+
+#include <stdint.h>
+
+// Ticks a byte takes on the wire
+#define SPISIM_SPI_BYTE_TICKS   3
+#define SPISIM_UART_BYTE_TICKS  12
+
+// A run longer than this is a driver hang, the model gives up and exits
+#define SPISIM_TICK_LIMIT       2000000
+
+// Log sizes
+#define SPISIM_MOSI_LENGTH      4096
+#define SPISIM_FRAME_LENGTH     64
+#define SPISIM_UART_LENGTH      256
+
+//! Reset UCA0, DMA, the logs and the error counters
+
+void SPISIM_Initialize(void);
+
+//! Forget the logged frames and UART bytes
+
+void SPISIM_LogReset(void);
+
+//! Let time pass, interrupts run if enabled
+
+void SPISIM_Run(uint32_t ticks);
+
+//! Ticks since SPISIM_Initialize
+
+uint32_t SPISIM_Ticks(void);
+
+//! Byte the slave answers at a position of a frame
+
+uint8_t SPISIM_SlaveMiso(uint8_t frame, uint16_t position);
+
+//! Frames logged; MOSI bytes and length of one of them
+
+uint8_t SPISIM_FrameCount(void);
+uint16_t SPISIM_Frame(uint8_t frame, const uint8_t** mosi);
+
+//! Bytes sent in UART mode
+
+uint16_t SPISIM_UartLog(const uint8_t** bytes);
+
+//! Driver misuse seen by the model, and RXBUF overruns (expected after polled writes)
+
+uint16_t SPISIM_Errors(void);
+uint16_t SPISIM_Overruns(void);
+
+#endif  // _UCA0_SIM_H
@@ -0,0 +1,24 @@
+// Generated by can_filter_compiler.py from ./canFilters.txt, don't edit
+//
+// FIFO 2 standard: 1 filters, 16 IDs accepted, 0 extra
+
+#define CAN_FILTER_COUNT 1
+
+// CiFLTCON0..7
+const uint32_t canFilterControl[8] =
+{
+    0x00000082,
+    0x00000000,
+    0x00000000,
+    0x00000000,
+    0x00000000,
+    0x00000000,
+    0x00000000,
+    0x00000000
+};
+
+// CiFLTOBJ, CiMASK per filter
+const uint32_t canFilterObjects[2] =
+{
+    0x00000300, 0x400007F0
+};
@@ -0,0 +1,175 @@
+# Quick & dirty script -> compiles accepted CAN IDs per RX FIFO into MCP2517FD filter/mask register images
+
+# one rule per line: destination FIFO, 'x' for extended (29 bit) IDs, then IDs and/or ranges
+# ex rule line          ------>   '2 0x300-0x30F 0x123'
+#                                  ^ FIFO  ^ range   ^ single ID
+# ex extended rule      ------>   '3 x 0x18FF0000-0x18FF00FF'
+
+# each range is cut into aligned blocks that one filter/mask pair matches exactly; while there are more
+# blocks than filters, the two blocks of a FIFO whose merge accepts the fewest extra IDs are merged.
+# a merge never reaches IDs of another FIFO. extra IDs (over-acceptance) are reported and end up in the
+# MCU: it has to drop them in software.
+
+# output is canFilters.h, written by DRV_CANFDSPI_FilterTableWrite in 3 SPI accesses (see mcp2517.h)
+
+import sys
+
+filter_rules_file = "./canFilters.txt"
+c_header_file = "./canFilters.h"
+filters_total = 32
+
+standard_width = 11
+extended_width = 29
+
+def parse_id_range(token):
+    if "-" in token:
+        first, last = token.split("-")
+        return int(first, 0), int(last, 0)
+    return int(token, 0), int(token, 0)
+
+def parse(file_name):
+    rules = []
+    with open(file_name) as file:
+        for line in file.read().splitlines():
+            line = line.split("#")[0].split()
+            if not line:
+                continue
+            fifo = int(line[0], 0)
+            extended = len(line) > 1 and line[1] == "x"
+            for token in line[2 if extended else 1:]:
+                first, last = parse_id_range(token)
+                rules.append((fifo, extended, first, last))
+    return rules
+
+def merge_ranges(ranges):
+    ranges = sorted(ranges)
+    merged = [list(ranges[0])]
+    for first, last in ranges[1:]:
+        if first <= merged[-1][1] + 1:
+            merged[-1][1] = max(merged[-1][1], last)
+        else:
+            merged.append([first, last])
+    return merged
+
+# block: (id, mask), mask bits set = must match
+def blocks_from_range(first, last, width):
+    full = (1 << width) - 1
+    blocks = []
+    while first <= last:
+        size = first & -first if first else 1 << width
+        while size > last - first + 1:
+            size >>= 1
+        blocks.append((first, full & ~(size - 1)))
+        first += size
+    return blocks
+
+def block_size(block, width):
+    return 1 << (width - bin(block[1]).count("1"))
+
+def blocks_intersection(a, b, width):
+    if (a[0] ^ b[0]) & a[1] & b[1]:
+        return 0
+    return 1 << (width - bin(a[1] | b[1]).count("1"))
+
+def block_contains(outer, inner):
+    return (inner[1] & outer[1]) == outer[1] and ((inner[0] ^ outer[0]) & outer[1]) == 0
+
+def block_merge(a, b):
+    mask = a[1] & b[1] & ~(a[0] ^ b[0])
+    return (a[0] & mask, mask)
+
+def compile_filters(rules, filters):
+    groups = {}
+    for fifo, extended, first, last in rules:
+        groups.setdefault((fifo, extended), []).append((first, last))
+
+    exact = {}
+    for key, ranges in groups.items():
+        width = extended_width if key[1] else standard_width
+        exact[key] = []
+        for first, last in merge_ranges(ranges):
+            exact[key] += blocks_from_range(first, last, width)
+
+    for key in exact:
+        for other in exact:
+            if key[1] != other[1] or key[0] >= other[0]:
+                continue
+            width = extended_width if key[1] else standard_width
+            for a in exact[key]:
+                for b in exact[other]:
+                    if blocks_intersection(a, b, width):
+                        sys.exit("FIFO %d and FIFO %d both accept IDs around 0x%X" % (key[0], other[0], a[0]))
+
+    current = dict((key, list(blocks)) for key, blocks in exact.items())
+    while sum(len(blocks) for blocks in current.values()) > filters:
+        best = None
+        for key, blocks in current.items():
+            width = extended_width if key[1] else standard_width
+            for i in range(len(blocks)):
+                for j in range(i + 1, len(blocks)):
+                    merged = block_merge(blocks[i], blocks[j])
+                    if any(blocks_intersection(merged, b, width) for other, others in exact.items()
+                           if other != key and other[1] == key[1] for b in others):
+                        continue
+                    extra = block_size(merged, width) - sum(blocks_intersection(merged, b, width) for b in exact[key])
+                    if best is None or extra < best[0]:
+                        best = (extra, key, merged)
+        if best is None:
+            sys.exit("cannot fit the rules into %d filters without accepting IDs of another FIFO" % filters)
+        extra, key, merged = best
+        current[key] = [b for b in current[key] if not block_contains(merged, b)] + [merged]
+
+    report = []
+    for key, blocks in sorted(current.items()):
+        width = extended_width if key[1] else standard_width
+        accepted = sum(block_size(b, width) for b in exact[key])
+        extra = sum(block_size(b, width) - sum(blocks_intersection(b, e, width) for e in exact[key]) for b in blocks)
+        report.append((key, len(blocks), accepted, extra))
+    return current, report
+
+# REG_CiFLTOBJ / REG_CiMASK / REG_CiFLTCON_BYTE layouts (drv_canfdspi_register.h)
+def filter_object(block, extended):
+    if extended:
+        sid, eid = block[0] >> 18, block[0] & 0x3FFFF
+        return sid | (eid << 11) | (1 << 30)
+    return block[0]
+
+def filter_mask(block, extended):
+    if extended:
+        return (block[1] >> 18) | ((block[1] & 0x3FFFF) << 11) | (1 << 30)
+    return block[1] | (1 << 30)
+
+def main():
+    file_name = sys.argv[1] if len(sys.argv) > 1 else filter_rules_file
+    filters = int(sys.argv[2]) if len(sys.argv) > 2 else filters_total
+    blocks, report = compile_filters(parse(file_name), filters)
+
+    entries = []
+    for key in sorted(blocks):
+        for block in sorted(blocks[key]):
+            entries.append((key[0], key[1], block))
+
+    control = [0] * (filters_total // 4)
+    objects = []
+    for i, (fifo, extended, block) in enumerate(entries):
+        control[i // 4] |= (0x80 | fifo) << (8 * (i % 4))
+        objects += [filter_object(block, extended), filter_mask(block, extended)]
+
+    lines = ["// Generated by can_filter_compiler.py from %s, don't edit" % file_name, "//"]
+    for (fifo, extended), count, accepted, extra in report:
+        line = "// FIFO %d %s: %d filters, %d IDs accepted, %d extra" % (fifo, "extended" if extended else "standard",
+                                                                       count, accepted, extra)
+        lines.append(line)
+        print(line[3:])
+    lines += ["", "#define CAN_FILTER_COUNT %d" % len(entries), "",
+              "// CiFLTCON0..7",
+              "const uint32_t canFilterControl[%d] =" % len(control), "{",
+              ",\n".join("    0x%08X" % word for word in control), "};", "",
+              "// CiFLTOBJ, CiMASK per filter",
+              "const uint32_t canFilterObjects[%d] =" % max(len(objects), 1), "{"]
+    lines.append(",\n".join("    0x%08X, 0x%08X" % (objects[i], objects[i + 1]) for i in range(0, len(objects), 2)) or "    0")
+    lines += ["};", ""]
+    with open(c_header_file, "w") as out_file:
+        out_file.write("\n".join(lines))
+
+main()
@@ -9,12 +9,13 @@
 //#define PHASE_SHIFT_DELAY               0x96
 #define PHASE_SHIFT_DELAY               0x96
 #define MINIMUM_TRIGGER_DELAY           0x05
-#define PERIOD_IN_MICROSEC              0x0F // 1/(2^16) -> aclk
+#define PERIOD_IN_MICROSEC              0x01 // Timer A ticks at TIMER_TICK_HZ (1Mhz from SMCLK)
 #define SPEED_OF_SOUND_FACTOR           0x3A   // 2*(1/speedofSound) (microsec/cm)
 //#define CALIBRATION_BOARD_1             0x45
 // Globals
 unsigned char currentCaptureStep, badPhase, retryCount = 0;
 unsigned int fallingEdgeTimestamp, risingEdgeTimestamp, timeDifference;
+unsigned long echoCaptureMicros; // timebaseMicros() at the echo's falling edge
 
 unsigned int captureDistance();
 void clearTimerACounter() {TA0CTL = TACLR;}
@@ -72,6 +73,7 @@ __interrupt void Timer0_A1_ISR(void)
         {
             // Capture the timer value during echo's falling edge (ranging stops)
             fallingEdgeTimestamp = TA0CCR1;
+            echoCaptureMicros = timebaseMicros();
             currentCaptureStep = STEP_3;
         }
 }
@@ -3,6 +3,7 @@
 
 #include <msp430.h>
 #include <msp430fr5738.h>
+#include "./mcp251x/spi/drv_spi.h"
 
 // General
 #define MAX_BYTE            0xFF
@@ -15,9 +16,24 @@
 #define LOG_SWITCH          BIT4
 #define TOF_ENABLE          BIT0
 #define CAN_STBY            BIT3
+#define CAN_INT             BIT2
 #define CHIP_SELECT         BIT2
 // Flag(s)
 #define RAM_PATCH_FLAG      0x00
+// Clock Profiles
+#define CLOCK_PROFILE_LOW_POWER       0x00 // MCLK = SMCLK = 1Mhz (power-on behaviour of configureClocks)
+#define CLOCK_PROFILE_BALANCED        0x01 // MCLK = SMCLK = 8Mhz, no FRAM wait states
+#define CLOCK_PROFILE_MAX_THROUGHPUT  0x02 // MCLK = SMCLK = 24Mhz, manual FRAM wait states (NACCESS 2, NPRECHG 1)
+// Peripheral Rates (dividers are derived from these and the active profile)
+#define I2C_BAUDRATE        100000
+#define UART_BAUDRATE       9600
+#define TIMER_TICK_HZ       1000000 // Timer A tick (from SMCLK) assumed by PERIOD_IN_MICROSEC in hcsr04.h
+#define TIMEBASE_TICK_HZ    32768  // Timer B0 tick: ACLK = XT1 watch crystal, keeps running in LPM3
+#define XT1_START_ATTEMPTS  200    // fault checks while the crystal starts, a few ms apart
+#define DELAY_REFERENCE_HZ  1000000 // delay() counts are calibrated against a 1Mhz MCLK
+// FRCTL0 wait states (slau272 table 5-1): NAUTO hands them to NACCESS/NPRECHG, clear lets the controller pick
+#define FRAM_WAIT(access, precharge) (NAUTO|NACCESS_##access|NPRECHG_##precharge)
+#define FRAM_WAIT_AUTO      0
 
 /*
  * Pins Taken Directly From the Schematic:
@@ -41,12 +57,37 @@
  * PJ.5 Crystal 1
  */
 
+typedef struct
+{
+    unsigned int dcoSelect;        // CSCTL1: DCORSEL + DCOFSEL
+    unsigned int dividers;         // CSCTL3: DIVA + DIVS + DIVM
+    unsigned int framWaitStates;   // FRCTL0 without the password: FRAM_WAIT or FRAM_WAIT_AUTO
+    unsigned int timerInputDivider;// TA0CTL ID
+    unsigned int timerExDivider;   // TA0EX0 TAIDEX
+    unsigned long mclkHz;
+    unsigned long smclkHz;         // ACLK = XT1 in every profile, the timebase doesn't follow the profile
+} ClockProfile;
+
+// One table drives the CS module and every peripheral divider
+const ClockProfile clockProfiles[] =
+{
+    // DCO 8Mhz, MCLK / 8, SMCLK / 8 -> Timer A / 1 = 1Mhz
+    {DCOFSEL_3,         (DIVA__1|DIVS__8|DIVM__8), FRAM_WAIT_AUTO,  ID__1, 0, 1000000,  1000000},
+    // DCO 8Mhz, MCLK / 1, SMCLK / 1 -> Timer A / 8 = 1Mhz
+    {DCOFSEL_3,         (DIVA__1|DIVS__1|DIVM__1), FRAM_WAIT(0, 0), ID__8, 0, 8000000,  8000000},
+    // DCO 24Mhz, MCLK / 1, SMCLK / 1 -> Timer A / 8 / 3 = 1Mhz
+    {DCORSEL|DCOFSEL_3, (DIVA__1|DIVS__1|DIVM__1), FRAM_WAIT(2, 1), ID__8, 2, 24000000, 24000000}
+};
+unsigned char activeClockProfile = CLOCK_PROFILE_LOW_POWER;
+
 char isGpioEnabled() {return (!((PM5CTL0 && LOCKLPM5) == 1));}
 char areClocksConfigured() {return ((PJSEL0 && BIT4) == 1 || (CSCTL1 && (DCOFSEL0 + DCOFSEL1)) == 1);}
 
 void delay(unsigned long cycles)
 {
-    for (unsigned int i = 0; i < cycles; i++)
+    // Scale so a delay lasts as long as it did at 1Mhz, whatever the profile
+    cycles *= (clockProfiles[activeClockProfile].mclkHz / DELAY_REFERENCE_HZ);
+    for (unsigned long i = 0; i < cycles; i++)
         __delay_cycles(1);
 }
 
@@ -133,13 +174,170 @@ void configureAclkWithDCO()
     CSCTL0_H = 0;
 }
 
+// XT1 in low frequency mode for the 32768 Hz watch crystal on PJ.4/PJ.5, the ACLK source of every profile
+// Until it runs (and whenever it faults) the CS module falls back to VLO: the timebase runs slow, never stops
+void configureAclkWithWatchCrystal()
+{
+    unsigned int attempts = XT1_START_ATTEMPTS;
+
+    PJSEL1 &= ~(BIT4|BIT5);
+    PJSEL0 |= (BIT4|BIT5);
+    // Unlock CS registers
+    CSCTL0 = CSKEY;
+    // Low frequency mode, no bypass, full drive for start-up
+    CSCTL4 = (CSCTL4 & ~(XTS|XT1BYPASS|XT1OFF)) | XT1DRIVE0 | XT1DRIVE1;
+    do
+    {
+        CSCTL5 &= ~XT1OFFG; // Local fault flag
+        SFRIFG1 &= ~OFIFG; // Global fault flag
+        delay(1000);
+    } while ((CSCTL5 & XT1OFFG) != 0 && --attempts);
+    // Lowest drive once it oscillates
+    CSCTL4 &= ~(XT1DRIVE0|XT1DRIVE1);
+    // Re-lock CS registers
+    CSCTL0_H = 0;
+}
+
 void configureClocks(char aclk, char smclkAndMclk)
 {
     if (aclk == ON) {configureAclkWithDCO();}
     if (smclkAndMclk == ON) {configureSmclkAndMclk();}
 }
 
-void configureTimerControl() {TA0CTL = (TASSEL__ACLK|MC__CONTINUOUS|ID_2);}
+void configureTimerControl()
+{
+    TA0EX0 = clockProfiles[activeClockProfile].timerExDivider;
+    TA0CTL = (TASSEL__SMCLK|MC__CONTINUOUS|clockProfiles[activeClockProfile].timerInputDivider);
+}
+
+/*
+ * MCU timebase: Timer B0 counts TIMEBASE_TICK_HZ from ACLK = XT1, which runs in LPM3 with the DCO off and
+ * doesn't move with the clock profile. The overflow interrupt extends it to 32 bits. timebaseMicros wraps
+ * after ~71 minutes, and skips once when the tick count wraps (~36 hours).
+ */
+volatile unsigned long timebaseBase = 0; // ticks folded in by overflows
+
+void timebaseStart()
+{
+    TB0EX0 = 0;
+    TB0CTL = (TBSSEL__ACLK|MC__CONTINUOUS|ID__1|TBCLR|TBIE);
+}
+
+void initializeTimebase()
+{
+    configureAclkWithWatchCrystal();
+    timebaseBase = 0;
+    timebaseStart();
+}
+
+unsigned long timebaseTicks()
+{
+    unsigned short interrupts = __get_interrupt_state();
+    __disable_interrupt();
+    unsigned int count = TB0R;
+    unsigned long ticks = timebaseBase + count;
+    // Overflow not serviced yet: the count already wrapped
+    if ((TB0CTL & TBIFG) && count < 0x8000)
+        ticks += 0x10000;
+    __set_interrupt_state(interrupts);
+    return ticks;
+}
+
+unsigned long timebaseMicros() {return (unsigned long) ((unsigned long long) timebaseTicks() * 1000000 / TIMEBASE_TICK_HZ);}
+unsigned long timebaseTicksFromMicros(unsigned long us) {return (unsigned long) ((unsigned long long) us * TIMEBASE_TICK_HZ / 1000000);}
+
+/*
+ * LPM3 alarm: ACLK (XT1) keeps running in LPM3, so does the timebase. TB0CCR1 matches the low 16 bits
+ * of the count (timebaseBase only moves by whole overflows), the ISR ends the sleep once the full
+ * 32 bit tick count is there.
+ */
+volatile unsigned long timebaseAlarmTicks;
+
+// Sleep in LPM3 until the timebase reaches ticks, or another interrupt ends the sleep
+// Returns 1 when the alarm went off (or ticks is too close to sleep), 0 when woken early
+unsigned char timebaseSleepUntil(unsigned long ticks)
+{
+    unsigned char alarm = 1;
+    unsigned short interrupts = __get_interrupt_state();
+    __disable_interrupt();
+    // Closer than 2 ticks the compare could be missed, and cost a whole timer period
+    if ((long) (ticks - timebaseTicks()) >= 2)
+    {
+        timebaseAlarmTicks = ticks;
+        TB0CCR1 = (unsigned int) (ticks - timebaseBase);
+        TB0CCTL1 = CCIE;
+        // GIE and LPM3 are set in the same instruction so the ISR can't slip in between
+        __bis_SR_register(LPM3_bits|GIE);
+        __disable_interrupt();
+        alarm = !(TB0CCTL1 & CCIE);
+        TB0CCTL1 = 0;
+    }
+    __set_interrupt_state(interrupts);
+    return alarm;
+}
+
+// Timer0_B1 overflow and alarm, Interrupt Handler
+#pragma vector = TIMER0_B1_VECTOR
+__interrupt void Timer0_B1_ISR(void)
+{
+    switch (__even_in_range(TB0IV, TB0IV_TBIFG))
+    {
+        case TB0IV_TBCCR1:
+            // Low 16 bits match: done, or another lap
+            if ((long) (timebaseTicks() - timebaseAlarmTicks) >= 0)
+            {
+                TB0CCTL1 &= ~CCIE;
+                __bic_SR_register_on_exit(LPM3_bits);
+            }
+            break;
+        case TB0IV_TBIFG:
+            timebaseBase += 0x10000;
+            break;
+        default:
+            break;
+    }
+}
+
+// I2C clock divider for I2C_BAUDRATE from SMCLK
+unsigned int i2cClockDivider()
+{
+    unsigned long smclk = clockProfiles[activeClockProfile].smclkHz;
+    return (unsigned int) ((smclk + I2C_BAUDRATE - 1) / I2C_BAUDRATE);
+}
+
+// UCBRSx for the fractional part of N = SMCLK / baud (slau272 UCBRSx table)
+unsigned char uartModulationPattern(unsigned int fractionPermille)
+{
+    static const unsigned int fraction[] = {0, 53, 72, 84, 100, 125, 143, 167, 215, 222, 250, 300, 334, 358, 375,
+                                            400, 429, 438, 500, 572, 600, 625, 643, 667, 700, 715, 750, 786, 800,
+                                            833, 846, 857, 875, 900, 917, 929};
+    static const unsigned char pattern[] = {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x11, 0x21, 0x22, 0x44, 0x25,
+                                            0x49, 0x4A, 0x52, 0x92, 0x53, 0x55, 0xAA, 0x6B, 0xAD, 0xB5, 0xB6, 0xD6,
+                                            0xB7, 0xBB, 0xDD, 0xED, 0xEE, 0xBF, 0xDF, 0xEF, 0xF7, 0xFB, 0xFD, 0xFE};
+    unsigned char i = sizeof(fraction) / sizeof(fraction[0]) - 1;
+    while (i > 0 && fraction[i] > fractionPermille)
+        i--;
+    return pattern[i];
+}
+
+// UART baud rate registers for UART_BAUDRATE from SMCLK (oversampling when N >= 16)
+void uartClockDividers(unsigned int* brw, unsigned int* mctlw)
+{
+    unsigned long smclk = clockProfiles[activeClockProfile].smclkHz;
+    unsigned long n = smclk / UART_BAUDRATE;
+    unsigned int fractionPermille = (unsigned int) (((smclk % UART_BAUDRATE) * 1000) / UART_BAUDRATE);
+    unsigned int mctl = ((unsigned int) uartModulationPattern(fractionPermille)) << 8;
+
+    if (n >= 16)
+    {
+        // UCBRF = fractional part of N / 16, in sixteenths
+        *brw = (unsigned int) (n / 16);
+        mctl |= ((unsigned int) (n % 16) << 4) | UCOS16;
+    }
+    else
+        *brw = (unsigned int) n;
+    *mctlw = mctl;
+}
 
 void initializeUltrasound()
 {
@@ -174,8 +372,8 @@ void initializeI2C()
     // Keep all the default values except the fields below...
     // (UCMode 3:I2C) (Master Mode) (UCSSEL 1:ACLK, 2,3:SMCLK)
     UCB0CTLW0 |= (UCMODE_3 | UCMST | UCSSEL_2 | UCSYNC); // looks fine but ensure aclk is proper frequency
-    // Clock divider = 10 (SMCLK @ ~1Mhz / 8 = ~100 Khz)
-    UCB0BRW = 10;
+    // Clock divider from the active clock profile (SMCLK / divider = ~100 Khz)
+    UCB0BRW = i2cClockDivider();
     // Exit reset mode
     UCB0CTL1 &= ~UCSWRST;
 }
@@ -186,7 +384,8 @@ void initializeI2C()
 // Initial clock: SMCLK @ 1.048 MHz with oversampling
 void initializeUART(void)
 {
-    UCA0CTLW0 |= UCSWRST;
+    // Start from the reset value, UCA0 may have been set up for SPI first
+    UCA0CTLW0 = UCSWRST;
     // Divert pins to UART functionality
     P2SEL1 &= ~(BIT0|BIT1);
     P2SEL0 |= (BIT0|BIT1);
@@ -194,21 +393,32 @@ void initializeUART(void)
     // Use SMCLK clock; leave other settings default
     UCA0CTLW0 |= (UCMODE0|UCSSEL__SMCLK);
     UCA0CTLW0 &= ~(UCSYNC|UCPEN|UC7BIT);
-    // Configure the clock dividers and modulators
-    // UCBR=6, UCBRF=13, UCBRS=0x22, UCOS16=1 (oversampling)
-    UCA0BRW = 8;
-    UCA0MCTLW = (UCBRS5|UCBRS6|UCBRS7);
+    // Configure the clock dividers and modulators from the active clock profile
+    // (SMCLK @ 1Mhz: UCBR=6, UCBRF=8, UCBRS=0x20, UCOS16=1)
+    unsigned int brw, mctlw;
+    uartClockDividers(&brw, &mctlw);
+    UCA0BRW = brw;
+    UCA0MCTLW = mctlw;
     // listen mode
     UCA0STATW |= UCLISTEN;
     // Exit the reset state (so transmission/reception can begin)
     UCA0CTLW0 &= ~UCSWRST;
+    // Hand UCA0 to the SPI driver's arbiter, SPI can now be initialized alongside
+    DRV_SPI_BusCapture(DRV_SPI_BUS_UART);
 }
 
 void uartWriteByte(unsigned char byte)
 {
-    // Wait for any ongoing transmission to complete
+    if (__get_interrupt_state() & GIE)
+    {
+        // Wait for room in the telemetry buffer; it drains between SPI transfers
+        while (!DRV_SPI_UartWrite(&byte, 1)) {}
+        return;
+    }
+    // With interrupts off the ISR never drains the buffer: send what it holds, then this byte, by polling
+    DRV_SPI_UartFlush();
+    DRV_SPI_UartSelect();
     while ((UCA0IFG & UCTXIFG) == 0) {}
-    // Write the byte to the transmit buffer
     UCA0TXBUF = byte;
 }
 
@@ -216,12 +426,76 @@ void uartWriteByte(unsigned char byte)
 unsigned char uartReadChar(void)
 {
     unsigned char byte;
+    // Keep SPI off the pins while we listen
+    DRV_SPI_UartSelect();
     // Return NULL if no byte received
     while ((UCA0IFG & UCRXIFG) == 0) {}
     byte = UCA0RXBUF;
     return byte;
 }
 
+// Reprogram the CS module for a profile and recompute SPI, I2C, UART and Timer A dividers
+// Waits for eUSCI traffic to finish; call between ultrasound captures. ACLK and the timebase stay on XT1
+void configureClockProfile(unsigned char profile)
+{
+    const ClockProfile* next = &clockProfiles[profile];
+    const ClockProfile* previous = &clockProfiles[activeClockProfile];
+    char i2cEnabled = !(UCB0CTLW0 & UCSWRST);
+    char uartOrSpiEnabled = !(UCA0CTLW0 & UCSWRST);
+    char spiMode = (UCA0CTLW0 & UCSYNC) != 0;
+
+    // Let in-flight SPI/UART/I2C bytes leave before their clock changes
+    DRV_SPI_TransactionQueueFlush();
+    DRV_SPI_TransferWait();
+    DRV_SPI_UartFlush();
+    while (uartOrSpiEnabled && (UCA0STATW & UCBUSY)) {}
+    while (i2cEnabled && (UCB0STATW & UCBBUSY)) {}
+    UCA0CTLW0 |= UCSWRST;
+    UCB0CTLW0 |= UCSWRST;
+
+    // Going faster: add FRAM wait states before MCLK goes up
+    if (next->mclkHz > previous->mclkHz)
+        FRCTL0 = FRCTLPW|next->framWaitStates;
+
+    // Unlock CS registers
+    CSCTL0 = CSKEY;
+    // Slow everything down while the DCO moves so MCLK never overshoots the FRAM settings
+    CSCTL3 = (DIVA__1|DIVS__8|DIVM__8);
+    CSCTL1 = next->dcoSelect;
+    // ACLK = XT1, SMCLK and MCLK = DCO
+    CSCTL2 = (SELA__XT1CLK|SELS__DCOCLK|SELM__DCOCLK);
+    CSCTL3 = next->dividers;
+    // Re-lock CS registers
+    CSCTL0_H = 0;
+
+    // Going slower: drop FRAM wait states once MCLK is down
+    if (next->mclkHz <= previous->mclkHz)
+        FRCTL0 = FRCTLPW|next->framWaitStates;
+
+    activeClockProfile = profile;
+
+    // Recompute peripheral dividers
+    DRV_SPI_ClockConfigure(next->smclkHz);
+    UCB0BRW = i2cClockDivider();
+    unsigned int brw, mctlw;
+    uartClockDividers(&brw, &mctlw);
+    // Keeps the cached UART image current even while SPI holds UCA0
+    DRV_SPI_UartClockConfigure(brw, mctlw);
+    if (uartOrSpiEnabled && spiMode)
+        UCA0BRW = DRV_SPI_ClockDivider();
+    if (TA0CTL & (MC0|MC1))
+    {
+        // TAIDEX/ID only take effect after TACLR
+        TA0EX0 = next->timerExDivider;
+        TA0CTL = (TA0CTL & ~(ID0|ID1)) | next->timerInputDivider | TACLR;
+    }
+
+    if (uartOrSpiEnabled)
+        UCA0CTLW0 &= ~UCSWRST;
+    if (i2cEnabled)
+        UCB0CTLW0 &= ~UCSWRST;
+}
+
 /*
  * SPI Initialization & transfer functions found under MCP25xx API
  */
@@ -21,6 +21,24 @@ unsigned char selfTest();
  * |   1     |   FAIL      |  init tof comm  |
  */
 
+/*
+ * RAM budget (MSP430FR5738: 1 KB SRAM; FRAM holds code, constants and canConfigSnapshot)
+ * Static RAM with DRV_CANFDSPI_INDEX_COUNT 1, small data model (2 byte data pointers, 4 byte code pointers):
+ *
+ *   drv_spi.c            161  transaction queue 72 (4 x 18), UART ring 32, bus images 24, CS 10, state 23
+ *   drv_canfdspi_api.c   219  SPI buffers 168 (2 x 84), staged registers 32 (4 x 8), FIFO shadows 17 (2 x 8 + 1)
+ *   mcp2517.h RX          94  canRxRing 80 (4 x 20), status and chain state 14
+ *   mcp2517.h TX          84  canTxSlots 36, drop counters 8, canPackFrame 32, pack state 8
+ *   mcp2517.h TEF        160  latency stats 110 (5 x 22), canTefInFlight 40 (4 x 10), state 10
+ *   mcp2517.h rest        78  timebase sync 21, bus recovery 34, power 18, canRamInitMicros 4, canSetupApplied 1
+ *   helper.h, hcsr04.h    28  timebase 9, echo capture 19
+ *                       ----
+ *                        824  + 160 stack (linker setting, no heap linked) = 984, 40 bytes spare
+ *
+ * The TMF8805 command tables are const (FRAM). Growing a depth above costs RAM the stack needs: check the
+ * .bss/.data/.stack sizes in Debug/testBoard_linkInfo.xml after a change.
+ */
+
 
 unsigned int readDistanceFromUltrasound() {return captureDistance();}
 
@@ -114,11 +132,12 @@ int main(void)
     if(!selfTest())
         return OFF;
 
-    configureClocks(ON, ON);
+    configureClockProfile(CLOCK_PROFILE_MAX_THROUGHPUT);
     canStbyState(OFF);
 
     initializeUART();
     initializeUltrasound();
+    initializeTimebase();
     while(1)
     {
         //uartWriteByte(0x55);
@@ -134,7 +153,7 @@ int main(void)
     //DRV_SPI_Initialize();
     //if (startTof())
         //initializeTof();
-    basicCANConfiguration();
+    canConfigure(); // or basicCANConfiguration();
     delay(10000);
     initializeRAMAndSelectNormalMode();
     delay(10000);
@@ -146,10 +165,28 @@ int main(void)
         delay(1000);
     }
     readMessageFromTEF();
-    //filterConfigurationToMatchAStandardFrameRange();
+    //filterConfigurationToMatchAStandardFrameRange(); // or canFilterConfigure();
     //while(1)
         //receiveCANMessage();
+    // or, interrupt-driven (canRxInterruptEnable() before initializeRAMAndSelectNormalMode()):
+    //CAN_RX_FRAME frame;
+    //while(1)
+    //{
+        //canRxWait();
+        //while (canRxRingGet(&frame))
+            //;
+    //}
     //configureTBC();
+    // scheduler: canTxSubmit() per message, then every few ms (retries a full channel, drops late messages)
+    //canTxService((uint16_t) (timebaseMicros() / 1000));
+    // latency: canTefInitialize() once, canSyncSample() about every second, and per echo
+    //canPackAdd(CAN_PACK_ULTRASOUND, (uint8_t*) &distance, 2, echoCaptureMicros, 0);
+    //canPackService(timebaseMicros());
+    //canTefService();
+    // bus errors: canBusInitialize() once, then every few ms
+    //canBusService(timebaseMicros());
+    // between measurement cycles, once the frames are out
+    //canPowerSleep(50000);
     //_low_power_mode_0();
      */
 }
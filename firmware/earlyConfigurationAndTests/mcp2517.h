@@ -8,6 +8,10 @@
 #include "./mcp251x/canfdspi/drv_canfdspi_api.h"
 #include "./mcp251x/spi/drv_spi.h"
 
+// Bump with any change to the registers basicCANConfiguration leaves behind (including one in a driver
+// routine it calls): the FRAM snapshot of an older configuration is then captured again
+#define CAN_CONFIG_VERSION 2
+
 void basicCANConfiguration()
 {
     // Reset Device
@@ -19,19 +23,19 @@ void basicCANConfiguration()
     oscCtrl.ClkOutDivide = OSC_CLKO_DIV1;
     DRV_CANFDSPI_OscillatorControlSet(DRV_CANFDSPI_INDEX_0, oscCtrl);
     // Input/Output use nINT0 and nINT1
-    //DRV_CANFDSPI_GpioModeConfigure(DRV_CANFDSPI_INDEX_0, GPIO_MODE_INT, GPIO_MODE_INT);
+    DRV_CANFDSPI_GpioModeConfigure(DRV_CANFDSPI_INDEX_0, GPIO_MODE_INT, GPIO_MODE_INT);
     // CAN Configuration: ISO_CRC, enable TEF, enable TXQ
     CAN_CONFIG canConfig;
     DRV_CANFDSPI_ConfigureObjectReset(&canConfig);
     canConfig.IsoCrcEnable = 0;
-    canConfig.StoreInTEF = 0;
+    canConfig.StoreInTEF = 1;
     canConfig.TXQEnable = 1;
     DRV_CANFDSPI_Configure(DRV_CANFDSPI_INDEX_0, &canConfig);
     // Bit Time Configuration: 500K/2M 80% sample point
     DRV_CANFDSPI_BitTimeConfigure(DRV_CANFDSPI_INDEX_0, CAN_500K_2M, CAN_SSP_MODE_AUTO, CAN_SYSCLK_20M);
-    // TEF Configuration: 12 messages, time stamping enabled
+    // TEF Configuration: 4 messages (TXQ + FIFO 1 in flight), time stamping enabled
     CAN_TEF_CONFIG tefConfig;
-    tefConfig.FifoSize = 1; // = 11;
+    tefConfig.FifoSize = 3; // = 11;
     tefConfig.TimeStampEnable = 1;
     DRV_CANFDSPI_TefConfigure(DRV_CANFDSPI_INDEX_0, &tefConfig);
     // TXQ Configuration: 8 messages, 32 byte maximum payload, high priority
@@ -41,13 +45,13 @@ void basicCANConfiguration()
     txqConfig.FifoSize = 1; // = 7;
     txqConfig.PayLoadSize = CAN_PLSIZE_8;
     DRV_CANFDSPI_TransmitQueueConfigure(DRV_CANFDSPI_INDEX_0, &txqConfig);
-    // FIFO 1: Transmit FIFO; 5 messages, 64 byte maximum payload, low priority
+    // FIFO 1: Transmit FIFO; 2 messages (CAN_TEF_IN_FLIGHT), 32 byte maximum payload (CAN_PACK_PAYLOAD), low priority
     CAN_TX_FIFO_CONFIG txfConfig;
-    txfConfig.FifoSize = 4;
-    txfConfig.PayLoadSize = CAN_PLSIZE_8;
+    txfConfig.FifoSize = 1;
+    txfConfig.PayLoadSize = CAN_PLSIZE_32;
     txfConfig.TxPriority = 0;
     DRV_CANFDSPI_TransmitChannelConfigure(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH1, &txfConfig);
-    // FIFO 2: Receive FIFO; 16 messages, 64 byte maximum payload, time stamping enabled
+    // FIFO 2: Receive FIFO; 16 messages, 8 byte maximum payload (canRxRing is sized on it), time stamping enabled
     CAN_RX_FIFO_CONFIG rxfConfig;
     rxfConfig.FifoSize = 15;
     rxfConfig.PayLoadSize = CAN_PLSIZE_8;
@@ -55,40 +59,116 @@ void basicCANConfiguration()
     DRV_CANFDSPI_ReceiveChannelConfigure(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH2, &rxfConfig);
 }
 
+/*
+ * Configuration snapshot
+ *
+ * The register image basicCANConfiguration leaves behind is kept in FRAM (PERSISTENT) with the
+ * CRC of the configuration it came from (CAN_CONFIG_VERSION and the image layout) and of the image
+ * itself. canConfigure restores it in five bursts instead of running the setters again; another
+ * configuration or a damaged image runs the setters and captures a new one. Rebuilding the same
+ * configuration keeps the snapshot. FRAM needs no unlocking on the FR5738 (MPU off).
+ */
+
+typedef struct
+{
+    uint16_t config;    // canConfigId() it was captured with
+    uint16_t crc;       // CRC16 of image
+    CAN_CONFIG_IMAGE image;
+} CAN_CONFIG_SNAPSHOT;
+
+#pragma PERSISTENT(canConfigSnapshot)
+CAN_CONFIG_SNAPSHOT canConfigSnapshot = {0};
+
+uint16_t canConfigId()
+{
+    uint16_t id[2] = {CAN_CONFIG_VERSION, sizeof(CAN_CONFIG_IMAGE)};
+    return DRV_CANFDSPI_CalculateCRC16((uint8_t*) id, sizeof(id));
+}
+
+// Same as basicCANConfiguration, from the snapshot when there is a good one
+// Returns 1 when restored, 0 when configured and captured
+uint8_t canConfigure()
+{
+    uint16_t config = canConfigId();
+
+    if (canConfigSnapshot.config == config
+            && canConfigSnapshot.crc == DRV_CANFDSPI_CalculateCRC16((uint8_t*) &canConfigSnapshot.image, sizeof(CAN_CONFIG_IMAGE)))
+    {
+        DRV_CANFDSPI_Reset(DRV_CANFDSPI_INDEX_0);
+        if (DRV_CANFDSPI_ConfigurationRestore(DRV_CANFDSPI_INDEX_0, &canConfigSnapshot.image) == 0)
+            return 1;
+    }
+
+    basicCANConfiguration();
+    // Invalid while the image is being written
+    canConfigSnapshot.config = 0;
+    if (DRV_CANFDSPI_ConfigurationCapture(DRV_CANFDSPI_INDEX_0, &canConfigSnapshot.image))
+        return 0;
+    canConfigSnapshot.crc = DRV_CANFDSPI_CalculateCRC16((uint8_t*) &canConfigSnapshot.image, sizeof(CAN_CONFIG_IMAGE));
+    canConfigSnapshot.config = config;
+    return 0;
+}
+
+// Wait for a mode, further down
+int8_t canPowerModeWait(CAN_OPERATION_MODE mode);
+
+// Time the last RAM initialization took, timebase microseconds
+unsigned long canRamInitMicros;
+
 // Now device is ready to transition to Normal Mode
 // Enable ECC, Initialize RAM, select Normal Mode
 void initializeRAMAndSelectNormalMode()
 {
+    unsigned long start;
+
     // Enable Ecc
     int8_t err = DRV_CANFDSPI_EccEnable(DRV_CANFDSPI_INDEX_0);
     if (err == -1 || err == -2)
         ledState(ON);
-    // Initialize RAM
+    // Initialize RAM: 2 KB at the SCK of the clock profile main selected, timed on its own
+    start = timebaseMicros();
     DRV_CANFDSPI_RamInit(DRV_CANFDSPI_INDEX_0, 0xff);
-    // Configuration Done: Select Normal Mode
+    canRamInitMicros = timebaseMicros() - start;
+    // Configuration Done: Select Normal Mode, and wait for it (11 recessive bits on the bus)
     DRV_CANFDSPI_OperationModeSelect(DRV_CANFDSPI_INDEX_0, CAN_NORMAL_MODE);
+    if (canPowerModeWait(CAN_NORMAL_MODE))
+        ledState(ON);
 }
 
+// Transmit classes of the scheduler, further down; they are also the TEF classes
+typedef enum
+{
+    CAN_TX_CLASS_ALERT,      // obstacle alert
+    CAN_TX_CLASS_RANGE,      // periodic range sample
+    CAN_TX_CLASS_DIAGNOSTIC,
+    CAN_TX_CLASS_COUNT
+} CAN_TX_CLASS;
+
+// Transmit completion tracking, further down
+uint8_t canTefNextSeq(uint8_t txClass);
+void canTefLoaded(uint8_t txClass, uint32_t captureUs);
+void canTefComplete(const CAN_TEF_MSGOBJ* tefObj);
+
 void transmitMessageFromTXFIFO()
 {
-    // Assemble transmit message: CAN FD Base Frame with BRS, 64 data bytes
-    CAN_TX_MSGOBJ txObj;
-    uint8_t txd[4];
+    // Assemble transmit message in place, in the driver's SPI buffer: CAN FD Base Frame with BRS, 4 data bytes
+    uint8_t *txd;
+    CAN_TX_MSGOBJ* txObj = DRV_CANFDSPI_TransmitObjectGet(DRV_CANFDSPI_INDEX_0, &txd);
 
     // Initialize ID and Control bits
-    txObj.word[0] = 0;
-    txObj.word[1] = 0;
+    txObj->word[0] = 0;
+    txObj->word[1] = 0;
 
-    txObj.bF.id.SID = 0x300; // Standard or Base ID
-    txObj.bF.id.EID = 0;
+    txObj->bF.id.SID = 0x300; // Standard or Base ID
+    txObj->bF.id.EID = 0;
 
-    txObj.bF.ctrl.FDF = 1; // CAN FD frame
-    txObj.bF.ctrl.BRS = 1; // Switch bit rate
-    txObj.bF.ctrl.IDE = 0; // Standard frame
-    txObj.bF.ctrl.RTR = 0; // Not a remote frame request
-    txObj.bF.ctrl.DLC = CAN_DLC_4; // 4 data bytes
-    // Sequence: doesn't get transmitted, but will be stored in TEF
-    txObj.bF.ctrl.SEQ = 1;
+    txObj->bF.ctrl.FDF = 1; // CAN FD frame
+    txObj->bF.ctrl.BRS = 1; // Switch bit rate
+    txObj->bF.ctrl.IDE = 0; // Standard frame
+    txObj->bF.ctrl.RTR = 0; // Not a remote frame request
+    txObj->bF.ctrl.DLC = CAN_DLC_4; // 4 data bytes
+    // Sequence: doesn't get transmitted, but will be stored in TEF (canTefComplete)
+    txObj->bF.ctrl.SEQ = canTefNextSeq(CAN_TX_CLASS_DIAGNOSTIC); // same SID as the scheduler's diagnostics
 
     // Initialize transmit data
     uint8_t i;
@@ -96,20 +176,16 @@ void transmitMessageFromTXFIFO()
         txd[i] = 0xAA;
     }
 
-    // Check that FIFO is not full
-    CAN_TX_FIFO_EVENT txFlags;
     bool flush = true;
 
+    // Load message and transmit; the driver checks for room itself (-6: FIFO full, try again later)
     int8_t err;
-    err = DRV_CANFDSPI_TransmitChannelEventGet(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH1, &txFlags);
-    if (txFlags & CAN_TX_FIFO_NOT_FULL_EVENT)
-    {
-        // Load message and transmit
-        err = DRV_CANFDSPI_TransmitChannelLoad(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH1, &txObj, txd,
-               /*DRV_CANFDSPI_DlcToDataBytes(txObj.bF.ctrl.DLC)*/4, flush);
-    }
+    err = DRV_CANFDSPI_TransmitObjectLoad(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH1,
+           /*DRV_CANFDSPI_DlcToDataBytes(txObj->bF.ctrl.DLC)*/4, flush);
 
-    if (err < 0)
+    if (err == 0)
+        canTefLoaded(CAN_TX_CLASS_DIAGNOSTIC, 0);
+    else if (err != -6)
         ledState(ON);
 }
 
@@ -117,7 +193,6 @@ void readMessageFromTEF()
 {
     // TEF Object
     CAN_TEF_MSGOBJ tefObj;
-    uint32_t id;
 
     // Check that TEF is not empty
     CAN_TEF_FIFO_EVENT tefFlags;
@@ -127,16 +202,24 @@ void readMessageFromTEF()
     {
         // Read message and UINC
         DRV_CANFDSPI_TefMessageGet(DRV_CANFDSPI_INDEX_0, &tefObj);
-        // Process Message
-        //Nop();
-        //Nop();
-        id = tefObj.bF.id.EID;
+        // Process Message: back to the frame it completes
+        canTefComplete(&tefObj);
     }
 }
 
+// What bring-up programmed on top of the configuration snapshot, for canBusRestart to do again
+#define CAN_SETUP_FILTER_RANGE  0x01    // filterConfigurationToMatchAStandardFrameRange
+#define CAN_SETUP_FILTER_TABLE  0x02    // canFilterConfigure
+#define CAN_SETUP_TBC           0x04    // configureTBC
+
+uint8_t canSetupApplied = 0;
+
 void filterConfigurationToMatchAStandardFrameRange()
 {
+    canSetupApplied = (canSetupApplied & ~CAN_SETUP_FILTER_TABLE) | CAN_SETUP_FILTER_RANGE;
     // Configure Filter 0: match SID = 0x300-0x30F, Standard frames only
+    // Disable, object and mask go out in one staged transaction (ascending address: disable first)
+    DRV_CANFDSPI_StagedBegin(DRV_CANFDSPI_INDEX_0);
     // Disable Filter 0
     DRV_CANFDSPI_FilterDisable(DRV_CANFDSPI_INDEX_0, CAN_FILTER0);
 
@@ -157,47 +240,989 @@ void filterConfigurationToMatchAStandardFrameRange()
     mObj.MIDE = 1; // match IDE bit
 
     DRV_CANFDSPI_FilterMaskConfigure(DRV_CANFDSPI_INDEX_0, CAN_FILTER0, &mObj);
+    DRV_CANFDSPI_StagedCommit(DRV_CANFDSPI_INDEX_0);
 
-    // Link Filter to RX FIFO 2, and enable filter
+    // Link Filter to RX FIFO 2, and enable filter: after the object, in a transaction of its own
     bool filterEnable = true;
     DRV_CANFDSPI_FilterToFifoLink(DRV_CANFDSPI_INDEX_0, CAN_FILTER0, CAN_FIFO_CH2, filterEnable);
 
 }
 
-void receiveCANMessage()
+// Accepted IDs per RX FIFO, compiled from canFilters.txt by can_filter_compiler.py
+#include "canFilters.h"
+
+// Program the compiled filters; replaces filterConfigurationToMatchAStandardFrameRange
+void canFilterConfigure()
 {
-    // Receive Message Object
-    CAN_RX_MSGOBJ rxObj;
-    uint8_t rxd[MAX_DATA_BYTES];
+    canSetupApplied = (canSetupApplied & ~CAN_SETUP_FILTER_RANGE) | CAN_SETUP_FILTER_TABLE;
+    if (DRV_CANFDSPI_FilterTableWrite(DRV_CANFDSPI_INDEX_0, canFilterControl, canFilterObjects, CAN_FILTER_COUNT))
+        ledState(ON);
+}
 
-    // Check that FIFO is not empty
-    CAN_RX_FIFO_EVENT rxFlags;
+// Messages pulled per drain, CH2 has an 8 byte payload
+#define CAN_RX_DRAIN_DEPTH 4
+#define CAN_RX_DRAIN_BYTES 8
 
-    DRV_CANFDSPI_ReceiveChannelEventGet(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH2, &rxFlags);
+void receiveCANMessage()
+{
+    // Receive Message Objects
+    CAN_RX_MSGOBJ rxObj[CAN_RX_DRAIN_DEPTH];
+    uint8_t rxd[CAN_RX_DRAIN_DEPTH * CAN_RX_DRAIN_BYTES];
+    uint8_t nReceived, i;
 
-    if (rxFlags & CAN_RX_FIFO_NOT_EMPTY_EVENT)
+    // Empty the FIFO, a full batch means there may be more
+    do
     {
-        // Read message and UINC
-        DRV_CANFDSPI_ReceiveMessageGet(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH2, &rxObj, rxd, MAX_DATA_BYTES);
+        if (DRV_CANFDSPI_ReceiveMessageDrain(DRV_CANFDSPI_INDEX_0, CAN_FIFO_CH2, rxObj, rxd, CAN_RX_DRAIN_BYTES, CAN_RX_DRAIN_DEPTH, &nReceived))
+            return;
 
-        // Process message
-        if (rxObj.bF.id.SID==0x300 && rxObj.bF.ctrl.IDE==0)
+        // Process messages
+        for (i = 0; i < nReceived; i++)
         {
-            //Nop();
-            //Nop();
-            return;
+            if (rxObj[i].bF.id.SID==0x300 && rxObj[i].bF.ctrl.IDE==0)
+            {
+                //Nop();
+                //Nop();
+            }
         }
-    }
+    } while (nReceived == CAN_RX_DRAIN_DEPTH);
 }
 
+// TBC increments every 1 us @ 20Mhz SYSCLK (basicCANConfiguration): 20-1 = 19
+#define CAN_TBC_PRESCALER 19
+
 void configureTBC()
 {
+    canSetupApplied |= CAN_SETUP_TBC;
     // Disable TBC
     DRV_CANFDSPI_TimeStampDisable(DRV_CANFDSPI_INDEX_0);
-    // COnfigure pre-scaler so TBC increments every 1 us @ 40Mhz Clock: 40-1 = 39
-    DRV_CANFDSPI_TimeStampPrescalerSet(DRV_CANFDSPI_INDEX_0, 39);
+    // COnfigure pre-scaler so TBC increments every 1 us
+    DRV_CANFDSPI_TimeStampPrescalerSet(DRV_CANFDSPI_INDEX_0, CAN_TBC_PRESCALER);
+    // Time stamp at start of frame
+    DRV_CANFDSPI_TimeStampModeConfigure(DRV_CANFDSPI_INDEX_0, CAN_TS_SOF);
     // Set TBC to zero
     DRV_CANFDSPI_TimeStampSet(DRV_CANFDSPI_INDEX_0, 0);
     // Enable TBC
     DRV_CANFDSPI_TimeStampEnable(DRV_CANFDSPI_INDEX_0);
 }
+
+/*
+ * Interrupt-driven reception
+ *
+ * nINT (P1.2) falls -> Port 1 ISR -> RX FIFO 2 is read through the SPI transaction queue, one object per pass:
+ * status + user address, object, UINC. The chain runs in the eUSCI_A0 ISR callbacks until the FIFO is empty
+ * and fills canRxRing, which the main loop empties with canRxRingGet. Single producer (ISRs), single
+ * consumer (main loop): only the producer moves head, only the consumer moves tail.
+ *
+ * The chain UINCs FIFO 2 behind the driver's shadow, don't mix it with ReceiveMessageGet/Drain on FIFO 2.
+ */
+
+#define CAN_RX_RING_LENGTH  4   // power of 2; FIFO 2 holds the backlog while the ring is full
+#define CAN_RX_RING_MASK    (CAN_RX_RING_LENGTH - 1)
+#define CAN_RX_CHANNEL      CAN_FIFO_CH2
+#define CAN_RX_PAYLOAD      8   // FIFO 2 configuration: 8 byte payload, time stamping enabled
+
+// Same layout as the object in MCP2517FD RAM, read in one go
+typedef struct
+{
+    CAN_RX_MSGOBJ obj;
+    uint8_t data[CAN_RX_PAYLOAD];
+} CAN_RX_FRAME;
+
+CAN_RX_FRAME canRxRing[CAN_RX_RING_LENGTH];
+volatile uint8_t canRxHead = 0;
+volatile uint8_t canRxTail = 0;
+volatile uint8_t canRxBusy = 0;    // chain in flight
+volatile uint8_t canRxAgain = 0;   // nINT fell while the chain was in flight
+volatile uint8_t canRxStalled = 0; // chain stopped on a full ring (or queue), canRxRingGet restarts it
+uint32_t canRxStatus[2];           // CiFIFOSTA, CiFIFOUA
+uint8_t canRxUinc;
+
+void canRxStatusRead();
+
+// Chain steps, called from the eUSCI_A0 ISR
+void canRxChainStop(uint8_t stalled)
+{
+    canRxBusy = 0;
+    canRxStalled = stalled;
+    if (canRxAgain && !stalled)
+        canRxStatusRead();
+}
+
+void canRxUincDone(DRV_SPI_TRANSACTION* transaction)
+{
+    // Object is complete and released in the controller: publish it
+    canRxHead = (canRxHead + 1) & CAN_RX_RING_MASK;
+    canRxStatusRead();
+}
+
+void canRxObjectDone(DRV_SPI_TRANSACTION* transaction)
+{
+    if (DRV_CANFDSPI_WriteByteArrayAsync(DRV_CANFDSPI_INDEX_0, cREGADDR_CiFIFOCON + (CAN_RX_CHANNEL * CiFIFO_OFFSET) + 1,
+            &canRxUinc, 1, canRxUincDone, NULL) < 0)
+        canRxChainStop(1);
+}
+
+void canRxStatusDone(DRV_SPI_TRANSACTION* transaction)
+{
+    REG_CiFIFOSTA ciFifoSta;
+    REG_CiFIFOUA ciFifoUa;
+
+    ciFifoSta.word = canRxStatus[0];
+    ciFifoUa.word = canRxStatus[1];
+
+    if (!ciFifoSta.rxBF.RxNotEmptyIF)
+    {
+        canRxChainStop(0);
+        return;
+    }
+    // No room: leave the rest in the controller FIFO
+    if (((canRxHead + 1) & CAN_RX_RING_MASK) == canRxTail)
+    {
+        canRxChainStop(1);
+        return;
+    }
+    if (DRV_CANFDSPI_ReadByteArrayAsync(DRV_CANFDSPI_INDEX_0, cRAMADDR_START + ciFifoUa.bF.UserAddress,
+            (uint8_t*) &canRxRing[canRxHead], sizeof(CAN_RX_FRAME), canRxObjectDone, NULL) < 0)
+        canRxChainStop(1);
+}
+
+// Start a pass; call with interrupts disabled or from an ISR
+void canRxStatusRead()
+{
+    canRxBusy = 1;
+    canRxAgain = 0;
+    if (DRV_CANFDSPI_ReadByteArrayAsync(DRV_CANFDSPI_INDEX_0, cREGADDR_CiFIFOSTA + (CAN_RX_CHANNEL * CiFIFO_OFFSET),
+            (uint8_t*) canRxStatus, sizeof(canRxStatus), canRxStatusDone, NULL) < 0)
+        canRxChainStop(1);
+}
+
+// Call after basicCANConfiguration, before selecting Normal Mode
+void canRxInterruptEnable()
+{
+    REG_CiFIFOCON ciFifoCon;
+    unsigned short interrupts;
+
+    ciFifoCon.word = 0;
+    ciFifoCon.rxBF.UINC = 1;
+    canRxUinc = ciFifoCon.byte[1];
+    canRxHead = canRxTail = 0;
+    canRxBusy = canRxAgain = canRxStalled = 0;
+    DRV_CANFDSPI_FifoShadowInvalidate(DRV_CANFDSPI_INDEX_0);
+
+    // Controller: FIFO 2 not empty -> RXIF -> nINT
+    DRV_CANFDSPI_ReceiveChannelEventEnable(DRV_CANFDSPI_INDEX_0, CAN_RX_CHANNEL, CAN_RX_FIFO_NOT_EMPTY_EVENT);
+    DRV_CANFDSPI_ModuleEventEnable(DRV_CANFDSPI_INDEX_0, CAN_RX_EVENT);
+
+    // P1.2 input, falling edge (IES first, changing it may set the flag)
+    P1DIR &= ~CAN_INT;
+    P1IES |= CAN_INT;
+    P1IFG &= ~CAN_INT;
+    P1IE |= CAN_INT;
+
+    // nINT already low: there is no edge to wait for
+    interrupts = __get_interrupt_state();
+    __disable_interrupt();
+    if (!(P1IN & CAN_INT) && !canRxBusy)
+        canRxStatusRead();
+    __set_interrupt_state(interrupts);
+}
+
+// Copy the oldest frame out of the ring; returns 0 when it is empty
+uint8_t canRxRingGet(CAN_RX_FRAME* frame)
+{
+    unsigned short interrupts;
+
+    if (canRxTail == canRxHead)
+        return 0;
+    *frame = canRxRing[canRxTail];
+    canRxTail = (canRxTail + 1) & CAN_RX_RING_MASK;
+
+    // Room again, pick up where the chain gave up
+    interrupts = __get_interrupt_state();
+    __disable_interrupt();
+    if (canRxStalled && !canRxBusy)
+        canRxStatusRead();
+    __set_interrupt_state(interrupts);
+    return 1;
+}
+
+// Sleep in LPM0 until a frame is in the ring
+void canRxWait()
+{
+    unsigned short interrupts = __get_interrupt_state();
+    __disable_interrupt();
+    while (canRxTail == canRxHead)
+    {
+        // GIE and LPM0 are set in the same instruction so the ISR can't slip in between
+        __bis_SR_register(LPM0_bits|GIE);
+        __disable_interrupt();
+    }
+    __set_interrupt_state(interrupts);
+}
+
+volatile uint8_t canPowerAsleep = 0;   // controller in Sleep Mode, see canPowerSleep
+volatile uint8_t canPowerBusWake = 0;
+
+// Port 1, Interrupt Handler (MCP2517FD nINT)
+#pragma vector = PORT1_VECTOR
+__interrupt void Port1_ISR(void)
+{
+    switch (__even_in_range(P1IV, P1IV_P1IFG7))
+    {
+        case P1IV_P1IFG2:
+            // Bus activity woke the controller, canPowerSleep takes it from here
+            if (canPowerAsleep)
+            {
+                canPowerBusWake = 1;
+                __bic_SR_register_on_exit(LPM3_bits);
+            }
+            else if (canRxBusy)
+                canRxAgain = 1;
+            else
+                canRxStatusRead();
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * Transmit scheduler
+ *
+ * Messages are submitted by class; each class has one pending slot on the MCU, a channel, a CAN ID and
+ * a deadline. canTxService loads pending messages highest priority first (canTxClasses order) and drops
+ * the ones whose deadline passed instead of sending them late. canTxSubmit only tries once: call
+ * canTxService from the main loop every few ms (like canBusService), it retries what a full channel
+ * refused and is the only place deadlines are checked.
+ *
+ * Alerts go through the TXQ (TxPriority 1), telemetry through FIFO 1 (TxPriority 0): the controller
+ * picks the TXQ first and a FIFO 1 full of telemetry never blocks an alert. A new periodic sample
+ * replaces a pending one; other classes refuse a message while their slot is taken. Only the MCU slot is
+ * superseded: a sample already loaded into FIFO 1 goes out as it is, ahead of the newer one.
+ *
+ * Time is whatever millisecond count the caller has, deadlines are compared wrap-safe on 16 bits.
+ */
+
+#define CAN_TX_PAYLOAD      8   // TXQ configuration: 8 byte payload
+
+typedef struct
+{
+    uint16_t sid;             // lower wins arbitration on the bus
+    CAN_FIFO_CHANNEL channel;
+    uint16_t deadlineMs;      // from submit to load
+    uint8_t supersede;        // a newer message replaces a pending one (in its slot, not in the channel)
+} CAN_TX_CLASS_CONFIG;
+
+typedef struct
+{
+    uint8_t pending;
+    uint8_t size;
+    uint16_t submittedMs;
+    uint8_t data[CAN_TX_PAYLOAD];
+} CAN_TX_SLOT;
+
+// Highest priority first
+const CAN_TX_CLASS_CONFIG canTxClasses[CAN_TX_CLASS_COUNT] =
+{
+    {0x080, CAN_TXQUEUE_CH0, 10,   0},
+    {0x200, CAN_FIFO_CH1,    100,  1},
+    {0x300, CAN_FIFO_CH1,    1000, 0}
+};
+
+CAN_TX_SLOT canTxSlots[CAN_TX_CLASS_COUNT];
+uint16_t canTxDropped[CAN_TX_CLASS_COUNT]; // deadline missed
+uint16_t canTxSuperseded;
+
+// Load pending messages by priority, drop the late ones
+void canTxService(uint16_t nowMs)
+{
+    CAN_TX_MSGOBJ txObj;
+    CAN_TX_SLOT* slot;
+    const CAN_TX_CLASS_CONFIG* config;
+    uint8_t i;
+    int8_t err;
+
+    for (i = 0; i < CAN_TX_CLASS_COUNT; i++)
+    {
+        slot = &canTxSlots[i];
+        config = &canTxClasses[i];
+        if (!slot->pending)
+            continue;
+        if ((uint16_t) (nowMs - slot->submittedMs) > config->deadlineMs)
+        {
+            slot->pending = 0;
+            canTxDropped[i]++;
+            continue;
+        }
+
+        txObj.word[0] = 0;
+        txObj.word[1] = 0;
+        txObj.bF.id.SID = config->sid;
+        txObj.bF.ctrl.FDF = 1;
+        txObj.bF.ctrl.BRS = 1;
+        txObj.bF.ctrl.DLC = slot->size; // 0..8: DLC is the byte count
+        txObj.bF.ctrl.SEQ = canTefNextSeq(i);
+
+        // -6: channel full, try again next time
+        err = DRV_CANFDSPI_TransmitChannelLoad(DRV_CANFDSPI_INDEX_0, config->channel, &txObj, slot->data, slot->size, true);
+        if (err == 0)
+        {
+            slot->pending = 0;
+            canTefLoaded(i, 0);
+        }
+        else if (err != -6)
+            ledState(ON);
+    }
+}
+
+// Queue a message of a class and try to send it right away
+// Returns 0 when queued, 1 when it replaced an older sample still in its slot, -1 when the slot is taken,
+// -2 on size
+int8_t canTxSubmit(CAN_TX_CLASS txClass, const uint8_t* data, uint8_t size, uint16_t nowMs)
+{
+    CAN_TX_SLOT* slot = &canTxSlots[txClass];
+    int8_t result = 0;
+    uint8_t i;
+
+    if (size > CAN_TX_PAYLOAD)
+        return -2;
+    if (slot->pending)
+    {
+        if (!canTxClasses[txClass].supersede)
+            return -1;
+        canTxSuperseded++;
+        result = 1;
+    }
+    for (i = 0; i < size; i++)
+        slot->data[i] = data[i];
+    slot->size = size;
+    slot->submittedMs = nowMs;
+    slot->pending = 1;
+
+    canTxService(nowMs);
+    return result;
+}
+
+/*
+ * Sample packer
+ *
+ * Range samples are packed into one CAN FD frame on FIFO 1 instead of a frame each, so the arbitration,
+ * header and CRC of a frame are paid once for up to 6 ultrasound samples. The frame goes out when it
+ * reaches CAN_PACK_FLUSH_BYTES, when its oldest sample is CAN_PACK_MAX_AGE_MS old (canPackService) or
+ * right away for an urgent sample. Frames are 32 bytes rather than the 64 CAN FD allows: canPackFrame
+ * and the SPI buffers have to fit the FR5738 RAM budget (main.c), and six samples already share the
+ * frame overhead. Samples are stamped with their capture time (timebaseMicros), the
+ * frame carries it in ms.
+ *
+ * Frame: [count][base time stamp, 2 bytes LE] then per sample [type << 4 | size][ms since base][data],
+ * zero padded up to the next DLC size.
+ */
+
+#define CAN_PACK_SID            0x210
+#define CAN_PACK_CHANNEL        CAN_FIFO_CH1
+#define CAN_PACK_PAYLOAD        32  // a DLC size, FIFO 1 payload size
+#define CAN_PACK_HEADER         3
+#define CAN_PACK_SAMPLE_MAX     15  // 4 bit size field
+#define CAN_PACK_FLUSH_BYTES    24
+#define CAN_PACK_MAX_AGE_MS     50  // < 256: the sample offset is one byte
+#define CAN_PACK_SEQ            CAN_TX_CLASS_COUNT // TEF class, past the scheduler classes
+
+typedef enum
+{
+    CAN_PACK_ULTRASOUND = 1,    // HC-SR04 echo
+    CAN_PACK_TOF = 2            // TMF8805 result (tmf8805.h)
+} CAN_PACK_SAMPLE;
+
+uint8_t canPackFrame[CAN_PACK_PAYLOAD];
+uint8_t canPackUsed = 0;        // 0: no frame open
+uint32_t canPackBaseUs;         // capture time of the oldest sample
+uint8_t canPackClosed = 0;      // frame is due, waiting for room in FIFO 1
+uint16_t canPackDropped;        // FIFO 1 full and no room left in the frame
+
+// Load the open frame into FIFO 1; returns 0 when sent (or empty), the TransmitChannelLoad error otherwise
+int8_t canPackFlush()
+{
+    CAN_TX_MSGOBJ txObj;
+    uint8_t size, i;
+    int8_t err;
+
+    if (!canPackUsed)
+        return 0;
+
+    txObj.word[0] = 0;
+    txObj.word[1] = 0;
+    txObj.bF.id.SID = CAN_PACK_SID;
+    txObj.bF.ctrl.FDF = 1;
+    txObj.bF.ctrl.BRS = 1;
+    txObj.bF.ctrl.DLC = DRV_CANFDSPI_DataBytesToDlc(canPackUsed);
+    txObj.bF.ctrl.SEQ = canTefNextSeq(CAN_PACK_SEQ);
+
+    // The receiver sees the whole DLC size, don't let it see stale bytes
+    size = DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) txObj.bF.ctrl.DLC);
+    for (i = canPackUsed; i < size; i++)
+        canPackFrame[i] = 0;
+
+    // -6: FIFO 1 full, the frame stays open and canPackService tries again
+    err = DRV_CANFDSPI_TransmitChannelLoad(DRV_CANFDSPI_INDEX_0, CAN_PACK_CHANNEL, &txObj, canPackFrame, size, true);
+    if (err == 0)
+    {
+        canPackUsed = canPackClosed = 0;
+        canTefLoaded(CAN_PACK_SEQ, canPackBaseUs);
+    }
+    else if (err != -6)
+        ledState(ON);
+    return err;
+}
+
+// Add a sample captured at captureUs; urgent samples go out with the frame right away
+// Returns 0 when packed, -1 when the frame couldn't be sent to make room, -2 on size
+int8_t canPackAdd(CAN_PACK_SAMPLE type, const uint8_t* data, uint8_t size, uint32_t captureUs, uint8_t urgent)
+{
+    uint16_t ms;
+    uint8_t i;
+
+    if (size > CAN_PACK_SAMPLE_MAX)
+        return -2;
+
+    // Sample doesn't fit or its offset would overflow: close the frame first
+    if (canPackUsed && (canPackUsed + 2 + size > CAN_PACK_PAYLOAD
+            || (int32_t) (captureUs - canPackBaseUs) > CAN_PACK_MAX_AGE_MS * 1000L))
+    {
+        if (canPackFlush())
+        {
+            canPackDropped++;
+            return -1;
+        }
+    }
+
+    if (!canPackUsed)
+    {
+        canPackBaseUs = captureUs;
+        ms = (uint16_t) (captureUs / 1000);
+        canPackFrame[0] = 0;
+        canPackFrame[1] = (uint8_t) ms;
+        canPackFrame[2] = (uint8_t) (ms >> 8);
+        canPackUsed = CAN_PACK_HEADER;
+    }
+
+    // A sample captured before the oldest one (ToF read after an echo) is stamped with the base
+    ms = 0;
+    if ((int32_t) (captureUs - canPackBaseUs) > 0)
+        ms = (uint16_t) ((captureUs - canPackBaseUs) / 1000);
+    canPackFrame[canPackUsed++] = (uint8_t) ((type << 4) | size);
+    canPackFrame[canPackUsed++] = (uint8_t) ms;
+    for (i = 0; i < size; i++)
+        canPackFrame[canPackUsed++] = data[i];
+    canPackFrame[0]++;
+
+    if (urgent || canPackUsed >= CAN_PACK_FLUSH_BYTES)
+    {
+        canPackClosed = 1;
+        canPackFlush();
+    }
+    return 0;
+}
+
+// Send the open frame once its oldest sample reaches the age threshold, or retry a due one
+void canPackService(uint32_t nowUs)
+{
+    if (canPackUsed && (canPackClosed || (int32_t) (nowUs - canPackBaseUs) >= CAN_PACK_MAX_AGE_MS * 1000L))
+        canPackFlush();
+}
+
+/*
+ * Timebase sync
+ *
+ * The MCP2517FD time base counter (configureTBC, 1 us) stamps RX and TEF objects; the MCU has
+ * timebaseMicros. canSyncSample reads the TBC between two MCU time stamps and keeps the pair as the
+ * reference; pairs at least CAN_SYNC_SPAN_US apart give the drift of the TBC against the MCU clock
+ * (the MCU side runs from XT1 at 32768 Hz, the TBC from the controller's crystal; each is off by its
+ * own tens of ppm). Call it from the main loop every second or so.
+ */
+
+#define CAN_SYNC_ROUND_TRIP_US  200     // longer: the read was interrupted, the sample is useless
+#define CAN_SYNC_SPAN_US        1000000 // shortest interval for a drift estimate (30.5 us ticks: 31 ppm)
+
+uint32_t canSyncMcuUs, canSyncCanUs;            // reference pair
+uint32_t canSyncDriftMcuUs, canSyncDriftCanUs;  // start of the drift interval
+int32_t canSyncDriftPpm = 0;                    // TBC rate over MCU rate, - 1
+uint8_t canSyncState = 0;                       // 0: no reference, 1: offset only, 2: offset and drift
+
+// Returns 0 on a new reference, -1 on SPI error, -2 when the sample was rejected
+int8_t canSyncSample()
+{
+    uint32_t before, after, tbc, mcu, span;
+    int32_t ppm;
+
+    before = timebaseMicros();
+    if (DRV_CANFDSPI_TimeStampGet(DRV_CANFDSPI_INDEX_0, &tbc))
+        return -1;
+    after = timebaseMicros();
+    if (after - before > CAN_SYNC_ROUND_TRIP_US)
+        return -2;
+    mcu = before + (after - before) / 2;
+
+    if (!canSyncState)
+    {
+        canSyncDriftMcuUs = mcu;
+        canSyncDriftCanUs = tbc;
+        canSyncState = 1;
+    }
+    span = mcu - canSyncDriftMcuUs;
+    if (span >= CAN_SYNC_SPAN_US)
+    {
+        ppm = (int32_t) (((int64_t) (int32_t) ((tbc - canSyncDriftCanUs) - span) * 1000000) / span);
+        // First estimate as is, then smoothed
+        if (canSyncState == 1)
+            canSyncDriftPpm = ppm;
+        else
+            canSyncDriftPpm += (ppm - canSyncDriftPpm) / 4;
+        canSyncDriftMcuUs = mcu;
+        canSyncDriftCanUs = tbc;
+        canSyncState = 2;
+    }
+    canSyncMcuUs = mcu;
+    canSyncCanUs = tbc;
+    return 0;
+}
+
+// MCU time of a TBC time stamp (RX and TEF objects); meaningless before the first canSyncSample
+uint32_t canSyncToMcu(uint32_t canUs)
+{
+    int32_t delta = (int32_t) (canUs - canSyncCanUs);
+    return canSyncMcuUs + (int32_t) (((int64_t) delta * 1000000) / (1000000 + canSyncDriftPpm));
+}
+
+// TBC time of an MCU time stamp
+uint32_t canSyncToCan(uint32_t mcuUs)
+{
+    int32_t delta = (int32_t) (mcuUs - canSyncMcuUs);
+    return canSyncCanUs + delta + (int32_t) (((int64_t) delta * canSyncDriftPpm) / 1000000);
+}
+
+/*
+ * Transmit completion tracking
+ *
+ * Every frame loaded by canTxService and canPackFlush gets a sequence number (SEQ, 7 bits on the
+ * MCP2517FD): its class (scheduler classes, then CAN_PACK_SEQ) in the low CAN_TEF_CLASS_BITS and the
+ * canTefInFlight slot holding its load time above. The TEF hands the SEQ back with the transmission
+ * time stamp, brought to MCU time by canSyncToMcu, so entries match whatever order the TXQ and FIFO 1
+ * send in.
+ *
+ * Per class: load to bus latency (canTefLoadToBus); packed frames also have capture to bus
+ * (canTefCaptureToBus, oldest sample). Histogram bucket i counts latencies below 2^i units of 2^shift us,
+ * the last one everything above. Buckets are byte counters: when one would overflow all of them halve,
+ * the histogram keeps its shape and leans to recent frames; count, min, max and total are exact.
+ */
+
+#define CAN_TEF_CLASS_BITS      2
+#define CAN_TEF_CLASSES         (CAN_PACK_SEQ + 1)
+#define CAN_TEF_IN_FLIGHT       4   // power of 2, >= TXQ + FIFO 1 depth, SEQ has 7 - CAN_TEF_CLASS_BITS bits for it
+#define CAN_LATENCY_BUCKETS     6
+#define CAN_LATENCY_SHIFT_BUS   8   // load to bus: 256 us units, top bucket from 4 ms
+#define CAN_LATENCY_SHIFT_SAMPLE 12 // capture to bus: 4.096 ms units, top bucket from 65 ms
+
+typedef struct
+{
+    uint32_t captureUs;
+    uint32_t loadUs;
+    uint8_t txClass;
+} CAN_TEF_STAMP;
+
+typedef struct
+{
+    uint16_t count;
+    uint8_t shift;
+    uint32_t minUs;
+    uint32_t maxUs;
+    uint32_t totalUs;       // stops with count at 0xFFFF
+    uint8_t histogram[CAN_LATENCY_BUCKETS];
+} CAN_LATENCY_STATS;
+
+CAN_TEF_STAMP canTefInFlight[CAN_TEF_IN_FLIGHT];
+uint8_t canTefPending = 0;              // one bit per canTefInFlight slot
+uint8_t canTefNext = 0;
+uint32_t canTefLoadUs;                  // stamped by canTefNextSeq, before the frame reaches the controller
+uint16_t canTefLost;                    // slot reused before its TEF entry, or no sync yet
+uint16_t canTefUnmatched;               // TEF entry without a loaded frame
+CAN_LATENCY_STATS canTefLoadToBus[CAN_TEF_CLASSES];
+CAN_LATENCY_STATS canTefCaptureToBus;
+
+void canLatencyClear(CAN_LATENCY_STATS* stats, uint8_t shift)
+{
+    uint8_t i;
+
+    stats->count = 0;
+    stats->shift = shift;
+    stats->minUs = 0xFFFFFFFF;
+    stats->maxUs = 0;
+    stats->totalUs = 0;
+    for (i = 0; i < CAN_LATENCY_BUCKETS; i++)
+        stats->histogram[i] = 0;
+}
+
+void canLatencyRecord(CAN_LATENCY_STATS* stats, uint32_t us)
+{
+    uint32_t units = us >> stats->shift;
+    uint8_t bucket = 0;
+    uint8_t i;
+
+    while (units && bucket < CAN_LATENCY_BUCKETS - 1)
+    {
+        units >>= 1;
+        bucket++;
+    }
+    if (stats->histogram[bucket] == 0xFF)
+        for (i = 0; i < CAN_LATENCY_BUCKETS; i++)
+            stats->histogram[i] >>= 1;
+    stats->histogram[bucket]++;
+    if (us < stats->minUs)
+        stats->minUs = us;
+    if (us > stats->maxUs)
+        stats->maxUs = us;
+    if (stats->count != 0xFFFF)
+    {
+        stats->count++;
+        stats->totalUs += us;
+    }
+}
+
+uint32_t canLatencyAverage(const CAN_LATENCY_STATS* stats) {return stats->count ? stats->totalUs / stats->count : 0;}
+
+// SEQ for the next frame of a class; call it right before the load, that's when the load time is taken
+uint8_t canTefNextSeq(uint8_t txClass)
+{
+    canTefLoadUs = timebaseMicros();
+    return (uint8_t) (txClass | (canTefNext << CAN_TEF_CLASS_BITS));
+}
+
+// The frame tagged by the last canTefNextSeq went into its channel
+void canTefLoaded(uint8_t txClass, uint32_t captureUs)
+{
+    CAN_TEF_STAMP* stamp = &canTefInFlight[canTefNext];
+
+    if (canTefPending & (1 << canTefNext))
+        canTefLost++;
+    stamp->captureUs = captureUs;
+    stamp->loadUs = canTefLoadUs;
+    stamp->txClass = txClass;
+    canTefPending |= 1 << canTefNext;
+    canTefNext = (canTefNext + 1) & (CAN_TEF_IN_FLIGHT - 1);
+}
+
+// Frames in flight won't show up in the TEF (controller restarted)
+void canTefForget()
+{
+    while (canTefPending)
+    {
+        canTefPending &= canTefPending - 1;
+        canTefLost++;
+    }
+}
+
+void canTefInitialize()
+{
+    uint8_t i;
+
+    canTefPending = canTefNext = 0;
+    canTefLost = canTefUnmatched = 0;
+    for (i = 0; i < CAN_TEF_CLASSES; i++)
+        canLatencyClear(&canTefLoadToBus[i], CAN_LATENCY_SHIFT_BUS);
+    canLatencyClear(&canTefCaptureToBus, CAN_LATENCY_SHIFT_SAMPLE);
+}
+
+// Latency from a to b; canSyncToMcu is good to a timebase tick or two, so b can come out just before a
+uint32_t canTefLatency(uint32_t aUs, uint32_t bUs) {return (int32_t) (bUs - aUs) > 0 ? bUs - aUs : 0;}
+
+// Match a TEF entry to its frame and record its latencies
+void canTefComplete(const CAN_TEF_MSGOBJ* tefObj)
+{
+    uint8_t txClass = tefObj->bF.ctrl.SEQ & ((1 << CAN_TEF_CLASS_BITS) - 1);
+    uint8_t slot = (tefObj->bF.ctrl.SEQ >> CAN_TEF_CLASS_BITS) & (CAN_TEF_IN_FLIGHT - 1);
+    CAN_TEF_STAMP* stamp = &canTefInFlight[slot];
+    uint32_t busUs;
+
+    if (!(canTefPending & (1 << slot)) || stamp->txClass != txClass)
+    {
+        canTefUnmatched++;
+        return;
+    }
+    canTefPending &= ~(1 << slot);
+    if (!canSyncState)
+    {
+        canTefLost++;
+        return;
+    }
+    busUs = canSyncToMcu(tefObj->bF.timeStamp);
+    canLatencyRecord(&canTefLoadToBus[txClass], canTefLatency(stamp->loadUs, busUs));
+    if (txClass == CAN_PACK_SEQ)
+        canLatencyRecord(&canTefCaptureToBus, canTefLatency(stamp->captureUs, busUs));
+}
+
+// Empty the TEF
+void canTefService()
+{
+    CAN_TEF_FIFO_EVENT tefFlags;
+    CAN_TEF_MSGOBJ tefObj;
+
+    while (!DRV_CANFDSPI_TefEventGet(DRV_CANFDSPI_INDEX_0, &tefFlags) && (tefFlags & CAN_TEF_FIFO_NOT_EMPTY_EVENT))
+    {
+        if (DRV_CANFDSPI_TefMessageGet(DRV_CANFDSPI_INDEX_0, &tefObj))
+            return;
+        canTefComplete(&tefObj);
+    }
+}
+
+/*
+ * Bus error recovery
+ *
+ * canBusService reads CiTREC and the operation mode (two short reads); call it from the main loop every
+ * few ms. Error passive episodes are only counted. On bus-off the controller recovers by itself after
+ * 128 x 11 recessive bits (2.8 ms @ 500K on an idle bus); if it is still off after CAN_BUS_OFF_WAIT_US,
+ * or it left Normal Mode (system error, controller reset), it is restarted: reset, configuration from
+ * the FRAM snapshot, RAM init and Normal Mode. Every restart doubles the wait for the next one, up to
+ * CAN_BUS_OFF_WAIT_MAX_US, so a shorted bus doesn't keep the SPI busy.
+ *
+ * Recovery time runs from the poll that saw the bus go down to the one that sees it back, so on a
+ * healthy bus it is bounded by the poll period + CAN_BUS_OFF_WAIT_US + one restart.
+ */
+
+#define CAN_BUS_OFF_WAIT_US     20000   // auto recovery, with margin for a busy bus
+#define CAN_BUS_OFF_WAIT_MAX_US 1000000
+
+typedef enum
+{
+    CAN_BUS_ACTIVE,
+    CAN_BUS_PASSIVE,
+    CAN_BUS_OFF
+} CAN_BUS_STATE;
+
+typedef struct
+{
+    uint16_t passiveEpisodes;
+    uint16_t busOffEpisodes;
+    uint16_t modeLost;          // left Normal Mode without being asked
+    uint16_t restarts;
+    uint32_t downtimeMs;
+    uint32_t lastRecoverUs;
+    uint32_t maxRecoverUs;
+} CAN_BUS_HEALTH;
+
+CAN_BUS_STATE canBusState = CAN_BUS_ACTIVE;
+CAN_BUS_HEALTH canBusHealth;
+uint32_t canBusDownUs;          // first poll that saw the bus down
+uint32_t canBusWaitStartUs;
+uint32_t canBusWaitUs;
+
+// Bring the controller back the way bring-up leaves it: snapshot, then the filters and TBC bring-up
+// programmed after it was captured (canSetupApplied)
+void canBusRestart()
+{
+    uint8_t rxInterrupts = (P1IE & CAN_INT) != 0;
+
+    // Let the RX chain finish, nINT goes away with the controller
+    P1IE &= ~CAN_INT;
+    DRV_SPI_TransactionQueueFlush();
+
+    canConfigure();
+    if (canSetupApplied & CAN_SETUP_FILTER_RANGE)
+        filterConfigurationToMatchAStandardFrameRange();
+    else if (canSetupApplied & CAN_SETUP_FILTER_TABLE)
+        canFilterConfigure();
+    if (rxInterrupts)
+        canRxInterruptEnable();
+    initializeRAMAndSelectNormalMode();
+
+    // TBC restarted from zero: take a new reference; the TX FIFOs are empty
+    canSyncState = 0;
+    if (canSetupApplied & CAN_SETUP_TBC)
+    {
+        configureTBC();
+        canSyncSample();
+    }
+    canTefForget();
+    canBusHealth.restarts++;
+}
+
+void canBusInitialize()
+{
+    canBusState = CAN_BUS_ACTIVE;
+    canBusHealth.passiveEpisodes = canBusHealth.busOffEpisodes = 0;
+    canBusHealth.modeLost = canBusHealth.restarts = 0;
+    canBusHealth.downtimeMs = 0;
+    canBusHealth.lastRecoverUs = canBusHealth.maxRecoverUs = 0;
+}
+
+// Returns the bus state, -1 on SPI error
+int8_t canBusService(uint32_t nowUs)
+{
+    uint8_t tec, rec;
+    CAN_ERROR_STATE flags;
+    CAN_OPERATION_MODE mode;
+    uint32_t downUs;
+    uint8_t entered;
+
+    if (DRV_CANFDSPI_ErrorCountStateGet(DRV_CANFDSPI_INDEX_0, &tec, &rec, &flags))
+        return -1;
+    mode = DRV_CANFDSPI_OperationModeGet(DRV_CANFDSPI_INDEX_0);
+    if (mode == CAN_INVALID_MODE)
+        return -1;
+
+    if (mode != CAN_NORMAL_MODE || (flags & CAN_TX_BUS_OFF_STATE))
+    {
+        entered = canBusState != CAN_BUS_OFF;
+        if (entered)
+        {
+            canBusState = CAN_BUS_OFF;
+            canBusDownUs = nowUs;
+            canBusWaitUs = CAN_BUS_OFF_WAIT_US;
+            canBusWaitStartUs = nowUs;
+            if (mode != CAN_NORMAL_MODE)
+                canBusHealth.modeLost++;
+            else
+                canBusHealth.busOffEpisodes++;
+        }
+        // Out of Normal Mode the controller won't come back by itself, don't wait for it
+        if ((entered && mode != CAN_NORMAL_MODE) || nowUs - canBusWaitStartUs >= canBusWaitUs)
+        {
+            canBusRestart();
+            canBusWaitStartUs = timebaseMicros();
+            canBusWaitUs = (canBusWaitUs < CAN_BUS_OFF_WAIT_MAX_US / 2) ? canBusWaitUs * 2 : CAN_BUS_OFF_WAIT_MAX_US;
+        }
+        return canBusState;
+    }
+
+    if (canBusState == CAN_BUS_OFF)
+    {
+        downUs = nowUs - canBusDownUs;
+        canBusHealth.lastRecoverUs = downUs;
+        if (downUs > canBusHealth.maxRecoverUs)
+            canBusHealth.maxRecoverUs = downUs;
+        canBusHealth.downtimeMs += downUs / 1000;
+    }
+    if (flags & (CAN_TX_BUS_PASSIVE_STATE|CAN_RX_BUS_PASSIVE_STATE))
+    {
+        if (canBusState == CAN_BUS_ACTIVE)
+            canBusHealth.passiveEpisodes++;
+        canBusState = CAN_BUS_PASSIVE;
+    }
+    else
+        canBusState = CAN_BUS_ACTIVE;
+    return canBusState;
+}
+
+/*
+ * Power manager
+ *
+ * canPowerSleep parks the node between measurement cycles: the MCP2517FD goes to Sleep Mode with the
+ * bus wake-up interrupt on, the transceiver to standby (it keeps watching the bus) and the MSP430 to
+ * LPM3 until the timebase alarm or nINT. Sleep Mode keeps the registers and the message RAM, so on the
+ * way back the controller only needs its oscillator and Normal Mode. Wake latency runs from the MCU
+ * waking up to the controller being back in Normal Mode with the transceiver on.
+ *
+ * Call it with the transmissions done (canPackFlush, canTxService); a pending one keeps the node awake.
+ */
+
+#define CAN_POWER_MIN_SLEEP_US  2000    // shorter isn't worth the way down and back
+#define CAN_POWER_TIMEOUT_US    3000    // for a mode change or the oscillator: a frame in progress, oscillator start-up
+
+typedef struct
+{
+    uint16_t sleeps;
+    uint16_t busWakes;      // woken by CAN bus activity
+    uint32_t sleptMs;
+    uint32_t lastWakeUs;
+    uint32_t maxWakeUs;
+} CAN_POWER_STATS;
+
+CAN_POWER_STATS canPowerStats;
+
+// Wait for the controller to reach a mode
+int8_t canPowerModeWait(CAN_OPERATION_MODE mode)
+{
+    uint32_t start = timebaseMicros();
+
+    while (DRV_CANFDSPI_OperationModeGet(DRV_CANFDSPI_INDEX_0) != mode)
+        if (timebaseMicros() - start > CAN_POWER_TIMEOUT_US)
+            return -1;
+    return 0;
+}
+
+// Sleep the controller, the transceiver and the MCU for durationUs, or until the bus wakes them
+// Returns 1 after the full time, 2 when woken by the bus (or another interrupt), 0 when it didn't sleep
+// -1 on SPI error, -2 when the controller didn't go to sleep, -3/-4 when it didn't come back
+int8_t canPowerSleep(uint32_t durationUs)
+{
+    uint32_t txRequests;
+    uint32_t sleepUs, wakeUs;
+    uint8_t rxInterrupts, alarm;
+    CAN_OSC_STATUS osc;
+    unsigned short interrupts;
+
+    if (durationUs < CAN_POWER_MIN_SLEEP_US)
+        return 0;
+    DRV_SPI_TransactionQueueFlush();
+    if (DRV_CANFDSPI_ReadWord(DRV_CANFDSPI_INDEX_0, cREGADDR_CiTXREQ, &txRequests))
+        return -1;
+    if (txRequests)
+        return 0;
+
+    // Controller: wake up on bus activity through nINT
+    if (DRV_CANFDSPI_ModuleEventClear(DRV_CANFDSPI_INDEX_0, CAN_BUS_WAKEUP_EVENT)
+            || DRV_CANFDSPI_ModuleEventEnable(DRV_CANFDSPI_INDEX_0, CAN_BUS_WAKEUP_EVENT)
+            || DRV_CANFDSPI_OperationModeSelect(DRV_CANFDSPI_INDEX_0, CAN_SLEEP_MODE))
+        return -1;
+    if (canPowerModeWait(CAN_SLEEP_MODE))
+        return -2;
+    canStbyState(ON);
+    DRV_SPI_UartFlush();
+
+    // MCU: nINT falling edge or the alarm, whichever comes first
+    rxInterrupts = (P1IE & CAN_INT) != 0;
+    canPowerBusWake = 0;
+    canPowerAsleep = 1;
+    P1IES |= CAN_INT;
+    P1IFG &= ~CAN_INT;
+    P1IE |= CAN_INT;
+    sleepUs = timebaseMicros();
+    alarm = (P1IN & CAN_INT) ? timebaseSleepUntil(timebaseTicks() + timebaseTicksFromMicros(durationUs)) : 0;
+    wakeUs = timebaseMicros();
+    canPowerAsleep = 0;
+    if (!rxInterrupts)
+        P1IE &= ~CAN_INT;
+
+    // Back: transceiver first, it has to be on when the controller joins the bus
+    canStbyState(OFF);
+    if (DRV_CANFDSPI_OscillatorEnable(DRV_CANFDSPI_INDEX_0))
+        return -1;
+    do
+    {
+        if (DRV_CANFDSPI_OscillatorStatusGet(DRV_CANFDSPI_INDEX_0, &osc))
+            return -1;
+        if (timebaseMicros() - wakeUs > CAN_POWER_TIMEOUT_US)
+            return -3;
+    } while (!osc.OscReady);
+    // Wakes up in Configuration Mode
+    if (DRV_CANFDSPI_OperationModeSelect(DRV_CANFDSPI_INDEX_0, CAN_NORMAL_MODE)
+            || DRV_CANFDSPI_ModuleEventClear(DRV_CANFDSPI_INDEX_0, CAN_BUS_WAKEUP_EVENT))
+        return -1;
+    if (canPowerModeWait(CAN_NORMAL_MODE))
+        return -4;
+
+    // Frames that came in while waking: the nINT edge is gone
+    interrupts = __get_interrupt_state();
+    __disable_interrupt();
+    if (rxInterrupts && !(P1IN & CAN_INT) && !canRxBusy)
+        canRxStatusRead();
+    __set_interrupt_state(interrupts);
+
+    canPowerStats.lastWakeUs = timebaseMicros() - wakeUs;
+    if (canPowerStats.lastWakeUs > canPowerStats.maxWakeUs)
+        canPowerStats.maxWakeUs = canPowerStats.lastWakeUs;
+    canPowerStats.sleptMs += (wakeUs - sleepUs) / 1000;
+    canPowerStats.sleeps++;
+    if (canPowerBusWake)
+        canPowerStats.busWakes++;
+    return alarm ? 1 : 2;
+}
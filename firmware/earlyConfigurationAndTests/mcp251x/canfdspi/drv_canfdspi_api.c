@@ -56,16 +56,67 @@
 #define CRCBASE    0xFFFF
 #define CRCUPPER   1
 
+// FIFO shadow flags
+#define FIFO_SHADOW_VALID       0x01
+#define FIFO_SHADOW_TX          0x02
+#define FIFO_SHADOW_TIMESTAMP   0x04
+#define FIFO_SHADOW_LAYOUT      0x08    // startAddress, objectSize and objectCount known, from a read while empty
+
+// In-place TX object: offset in spiTransmitBuffer, clear of the command bytes the Load path composes at 0..2
+#define TX_OBJECT_OFFSET        4
+
+// Batched TX load / RX drain: unused payload bytes clocked through to keep a RAM burst going, before starting
+// a new one (a new burst costs 2 command bytes plus CS set up/release)
+#define RAM_BURST_GAP_MAX       8
+
+//! FIFO shadow: static configuration plus a locally tracked user address
+//! Valid only while the user address can be trusted without reading CiFIFOUA
+
+typedef struct {
+    uint16_t userAddress;   // RAM address of the next object to load/read
+    uint16_t startAddress;  // RAM address of object 0
+    uint8_t objectSize;     // bytes per object in RAM
+    uint8_t objectCount;
+    uint8_t credit;         // TX: objects known to be free
+    uint8_t flags;
+} FIFO_SHADOW;
+
+//! Staged register: a register's value, which bytes of it are known and which are to be written
+
+typedef struct {
+    uint16_t address;       // register address, word aligned
+    uint8_t known;          // byte mask
+    uint8_t staged;         // byte mask
+    uint32_t value;
+} REG_STAGE;
+
 
 // *****************************************************************************
 // *****************************************************************************
 // Section: Variables
 
-//! SPI Transmit buffer
-uint8_t spiTransmitBuffer[SPI_DEFAULT_BUFFER_LENGTH];
+//! SPI Transmit buffer, one per controller
+//! Word aligned, in-place message objects are built in it (DRV_CANFDSPI_TransmitObjectGet)
+uint8_t spiTransmitBuffer[DRV_CANFDSPI_INDEX_COUNT][SPI_DEFAULT_BUFFER_LENGTH] __attribute__((aligned(4)));
+
+//! SPI Receive buffer, one per controller
+//! Word aligned, received objects are decoded in place (DRV_CANFDSPI_ReceiveObjectGet)
+uint8_t spiReceiveBuffer[DRV_CANFDSPI_INDEX_COUNT][SPI_DEFAULT_BUFFER_LENGTH] __attribute__((aligned(4)));
+
+//! FIFO shadows, FIFO1 to DRV_CANFDSPI_SHADOW_CHANNELS
+static FIFO_SHADOW fifoShadow[DRV_CANFDSPI_INDEX_COUNT][DRV_CANFDSPI_SHADOW_CHANNELS];
 
-//! SPI Receive buffer
-uint8_t spiReceiveBuffer[SPI_DEFAULT_BUFFER_LENGTH];
+//! A mode was requested and OPMOD has not been seen out of Configuration mode since: user addresses are not
+//! to be trusted yet
+static uint8_t fifoShadowModePending[DRV_CANFDSPI_INDEX_COUNT];
+
+//! Staged registers, sorted by address
+static REG_STAGE regStage[DRV_CANFDSPI_INDEX_COUNT][DRV_CANFDSPI_STAGE_LENGTH];
+static uint8_t regStageCount[DRV_CANFDSPI_INDEX_COUNT];
+static uint8_t regStageDepth[DRV_CANFDSPI_INDEX_COUNT];
+
+//! Payload bytes per CAN_FIFO_PLSIZE
+static const uint8_t fifoPayloadBytes[8] = {8, 12, 16, 20, 24, 32, 48, 64};
 
 //! Reverse order of bits in byte
 
@@ -133,11 +184,19 @@ int8_t DRV_CANFDSPI_Reset(CANFDSPI_MODULE_ID index)
     uint16_t spiTransferSize = 2;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) (cINSTRUCTION_RESET << 4);
-    spiTransmitBuffer[1] = 0;
+    spiTransmitBuffer[index][0] = (uint8_t) (cINSTRUCTION_RESET << 4);
+    spiTransmitBuffer[index][1] = 0;
+
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
+    DRV_CANFDSPI_StagedInvalidate(index);
+    fifoShadowModePending[index] = 1;
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
@@ -149,18 +208,18 @@ int8_t DRV_CANFDSPI_Reset(CANFDSPI_MODULE_ID index)
 
 int8_t DRV_CANFDSPI_ReadByte(CANFDSPI_MODULE_ID index, uint16_t address, uint8_t *rxd)
 {
-    uint16_t spiTransferSize = 3;
     int8_t spiTransferError = 0;
 
-    // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-    spiTransmitBuffer[2] = 0;
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    // Compose command
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
 
-    // Update data
-    *rxd = spiReceiveBuffer[2];
+    // Data is clocked in directly to rxd
+    spiTransferError = DRV_SPI_TransferDataRead(index, spiTransmitBuffer[index], 2, rxd, 1);
 
     return spiTransferError;
 }
@@ -170,38 +229,34 @@ int8_t DRV_CANFDSPI_WriteByte(CANFDSPI_MODULE_ID index, uint16_t address, uint8_
     uint16_t spiTransferSize = 3;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-    spiTransmitBuffer[2] = txd;
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][2] = txd;
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
 
 int8_t DRV_CANFDSPI_ReadWord(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t *rxd)
 {
-    uint8_t i;
-    uint32_t x;
-    uint16_t spiTransferSize = 6;
     int8_t spiTransferError = 0;
 
-    // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
-    if (spiTransferError) {
-        return spiTransferError;
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
     }
 
-    // Update data
-    *rxd = 0;
-    for (i = 2; i < 6; i++) {
-        x = (uint32_t) spiReceiveBuffer[i];
-        *rxd += x << ((i - 2)*8);
-    }
+    // Compose command
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
+
+    // Device and MCU are both little-endian: data is clocked in directly to rxd
+    spiTransferError = DRV_SPI_TransferDataRead(index, spiTransmitBuffer[index], 2, (uint8_t*) rxd, 4);
 
     return spiTransferError;
 }
@@ -212,42 +267,38 @@ int8_t DRV_CANFDSPI_WriteWord(CANFDSPI_MODULE_ID index, uint16_t address, uint32
     uint16_t spiTransferSize = 6;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
 
     // Split word into 4 bytes and add them to buffer
     for (i = 0; i < 4; i++) {
-        spiTransmitBuffer[i + 2] = (uint8_t) ((txd >> (i * 8)) & 0xFF);
+        spiTransmitBuffer[index][i + 2] = (uint8_t) ((txd >> (i * 8)) & 0xFF);
     }
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
 
 int8_t DRV_CANFDSPI_ReadHalfWord(CANFDSPI_MODULE_ID index, uint16_t address, uint16_t *rxd)
 {
-    uint8_t i;
-    uint32_t x;
-    uint16_t spiTransferSize = 4;
     int8_t spiTransferError = 0;
 
-    // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
-    if (spiTransferError) {
-        return spiTransferError;
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
     }
 
-    // Update data
-    *rxd = 0;
-    for (i = 2; i < 4; i++) {
-        x = (uint32_t) spiReceiveBuffer[i];
-        *rxd += x << ((i - 2)*8);
-    }
+    // Compose command
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
+
+    // Data is clocked in directly to rxd
+    spiTransferError = DRV_SPI_TransferDataRead(index, spiTransmitBuffer[index], 2, (uint8_t*) rxd, 2);
 
     return spiTransferError;
 }
@@ -258,16 +309,20 @@ int8_t DRV_CANFDSPI_WriteHalfWord(CANFDSPI_MODULE_ID index, uint16_t address, ui
     uint16_t spiTransferSize = 4;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
 
     // Split word into 2 bytes and add them to buffer
     for (i = 0; i < 2; i++) {
-        spiTransmitBuffer[i + 2] = (uint8_t) ((txd >> (i * 8)) & 0xFF);
+        spiTransmitBuffer[index][i + 2] = (uint8_t) ((txd >> (i * 8)) & 0xFF);
     }
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
@@ -278,17 +333,21 @@ int8_t DRV_CANFDSPI_WriteByteSafe(CANFDSPI_MODULE_ID index, uint16_t address, ui
     uint16_t spiTransferSize = 5;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE_SAFE << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-    spiTransmitBuffer[2] = txd;
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE_SAFE << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][2] = txd;
 
     // Add CRC
-    crcResult = DRV_CANFDSPI_CalculateCRC16(spiTransmitBuffer, 3);
-    spiTransmitBuffer[3] = (crcResult >> 8) & 0xFF;
-    spiTransmitBuffer[4] = crcResult & 0xFF;
+    crcResult = DRV_CANFDSPI_CalculateCRC16(spiTransmitBuffer[index], 3);
+    spiTransmitBuffer[index][3] = (crcResult >> 8) & 0xFF;
+    spiTransmitBuffer[index][4] = crcResult & 0xFF;
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
@@ -300,51 +359,49 @@ int8_t DRV_CANFDSPI_WriteWordSafe(CANFDSPI_MODULE_ID index, uint16_t address, ui
     uint16_t spiTransferSize = 8;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE_SAFE << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE_SAFE << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
 
     // Split word into 4 bytes and add them to buffer
     for (i = 0; i < 4; i++) {
-        spiTransmitBuffer[i + 2] = (uint8_t) ((txd >> (i * 8)) & 0xFF);
+        spiTransmitBuffer[index][i + 2] = (uint8_t) ((txd >> (i * 8)) & 0xFF);
     }
 
     // Add CRC
-    crcResult = DRV_CANFDSPI_CalculateCRC16(spiTransmitBuffer, 6);
-    spiTransmitBuffer[6] = (crcResult >> 8) & 0xFF;
-    spiTransmitBuffer[7] = crcResult & 0xFF;
+    crcResult = DRV_CANFDSPI_CalculateCRC16(spiTransmitBuffer[index], 6);
+    spiTransmitBuffer[index][6] = (crcResult >> 8) & 0xFF;
+    spiTransmitBuffer[index][7] = crcResult & 0xFF;
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
 
 int8_t DRV_CANFDSPI_ReadByteArray(CANFDSPI_MODULE_ID index, uint16_t address, uint8_t *rxd, uint16_t nBytes)
 {
-    uint16_t i;
     uint16_t spiTransferSize = nBytes + 2;
     int8_t spiTransferError = 0;
 
-    // Validate that length of array is sufficient to hold requested number of bytes
-    if (spiTransferSize > sizeof(spiTransmitBuffer)) {
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
         return -1;
     }
 
-    // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-
-    // Clear data
-    for (i = 2; i < spiTransferSize; i++) {
-        spiTransmitBuffer[i] = 0;
+    // Validate that length of array is sufficient to hold requested number of bytes
+    if (spiTransferSize > sizeof(spiTransmitBuffer[index])) {
+        return -1;
     }
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    // Compose command
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
 
-    // Update data
-    for (i = 0; i < nBytes; i++) {
-        rxd[i] = spiReceiveBuffer[i + 2];
-    }
+    // Data is clocked in directly to rxd
+    spiTransferError = DRV_SPI_TransferDataRead(index, spiTransmitBuffer[index], 2, rxd, nBytes);
 
     return spiTransferError;
 }
@@ -357,39 +414,39 @@ int8_t DRV_CANFDSPI_ReadByteArrayWithCRC(CANFDSPI_MODULE_ID index, uint16_t addr
     uint16_t spiTransferSize = nBytes + 5; //first two bytes for sending command & address, third for size, last two bytes for CRC
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Validate that length of array is sufficient to hold requested number of bytes
-    if (spiTransferSize > sizeof(spiTransmitBuffer)) {
+    if (spiTransferSize > sizeof(spiTransmitBuffer[index])) {
         return -1;
     }
 
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_READ_CRC << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_READ_CRC << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
     if (fromRam) {
-        spiTransmitBuffer[2] = nBytes >> 2;
+        spiTransmitBuffer[index][2] = nBytes >> 2;
     } else {
-        spiTransmitBuffer[2] = nBytes;
-    }
-
-    // Clear data
-    for (i = 3; i < spiTransferSize; i++) {
-        spiTransmitBuffer[i] = 0;
+        spiTransmitBuffer[index][2] = nBytes;
     }
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    // Data and CRC land after the command, where the CRC check below expects them
+    spiTransferError = DRV_SPI_TransferDataRead(index, spiTransmitBuffer[index], 3, &spiReceiveBuffer[index][3], nBytes + 2);
     if (spiTransferError) {
         return spiTransferError;
     }
 
     // Get CRC from controller
-    crcFromSpiSlave = (uint16_t) (spiReceiveBuffer[spiTransferSize - 2] << 8) + (uint16_t) (spiReceiveBuffer[spiTransferSize - 1]);
+    crcFromSpiSlave = (uint16_t) (spiReceiveBuffer[index][spiTransferSize - 2] << 8) + (uint16_t) (spiReceiveBuffer[index][spiTransferSize - 1]);
 
     // Use the receive buffer to calculate CRC
     // First three bytes need to be command
-    spiReceiveBuffer[0] = spiTransmitBuffer[0];
-    spiReceiveBuffer[1] = spiTransmitBuffer[1];
-    spiReceiveBuffer[2] = spiTransmitBuffer[2];
-    crcAtController = DRV_CANFDSPI_CalculateCRC16(spiReceiveBuffer, nBytes + 3);
+    spiReceiveBuffer[index][0] = spiTransmitBuffer[index][0];
+    spiReceiveBuffer[index][1] = spiTransmitBuffer[index][1];
+    spiReceiveBuffer[index][2] = spiTransmitBuffer[index][2];
+    crcAtController = DRV_CANFDSPI_CalculateCRC16(spiReceiveBuffer[index], nBytes + 3);
 
     // Compare CRC readings
     if (crcFromSpiSlave == crcAtController) {
@@ -401,7 +458,7 @@ int8_t DRV_CANFDSPI_ReadByteArrayWithCRC(CANFDSPI_MODULE_ID index, uint16_t addr
 
     // Update data
     for (i = 0; i < nBytes; i++) {
-        rxd[i] = spiReceiveBuffer[i + 3];
+        rxd[i] = spiReceiveBuffer[index][i + 3];
     }
 
     return spiTransferError;
@@ -409,25 +466,24 @@ int8_t DRV_CANFDSPI_ReadByteArrayWithCRC(CANFDSPI_MODULE_ID index, uint16_t addr
 
 int8_t DRV_CANFDSPI_WriteByteArray(CANFDSPI_MODULE_ID index, uint16_t address, uint8_t *txd, uint16_t nBytes)
 {
-    uint16_t i;
     uint16_t spiTransferSize = nBytes + 2;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Validate that length of array is sufficient to hold requested number of bytes
-    if (spiTransferSize > sizeof(spiTransmitBuffer)) {
+    if (spiTransferSize > sizeof(spiTransmitBuffer[index])) {
         return -1;
     }
 
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
-
-    // Add data
-    for (i = 0; i < nBytes; i++) {
-        spiTransmitBuffer[i+2] = txd[i];
-    }
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    // Data is clocked out directly from txd
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], 2, txd, nBytes);
 
     return spiTransferError;
 }
@@ -439,100 +495,557 @@ int8_t DRV_CANFDSPI_WriteByteArrayWithCRC(CANFDSPI_MODULE_ID index, uint16_t add
     uint16_t spiTransferSize = nBytes + 5;
     int8_t spiTransferError = 0;
 
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+
     // Validate that length of array is sufficient to hold requested number of bytes
-    if (spiTransferSize > sizeof(spiTransmitBuffer)) {
+    if (spiTransferSize > sizeof(spiTransmitBuffer[index])) {
         return -1;
     }
     // Compose command
-    spiTransmitBuffer[0] = (uint8_t) ((cINSTRUCTION_WRITE_CRC << 4) + ((address >> 8) & 0xF));
-    spiTransmitBuffer[1] = (uint8_t) (address & 0xFF);
+    spiTransmitBuffer[index][0] = (uint8_t) ((cINSTRUCTION_WRITE_CRC << 4) + ((address >> 8) & 0xF));
+    spiTransmitBuffer[index][1] = (uint8_t) (address & 0xFF);
     if (fromRam) {
-        spiTransmitBuffer[2] = nBytes >> 2;
+        spiTransmitBuffer[index][2] = nBytes >> 2;
     }
     else {
-        spiTransmitBuffer[2] = nBytes;
+        spiTransmitBuffer[index][2] = nBytes;
     }
 
     // Add data
     for (i = 0; i < nBytes; i++) {
-        spiTransmitBuffer[i + 3] = txd[i];
+        spiTransmitBuffer[index][i + 3] = txd[i];
     }
 
     // Add CRC
-    crcResult = DRV_CANFDSPI_CalculateCRC16(spiTransmitBuffer, spiTransferSize - 2);
-    spiTransmitBuffer[spiTransferSize - 2] = (uint8_t) ((crcResult >> 8) & 0xFF);
-    spiTransmitBuffer[spiTransferSize - 1] = (uint8_t) (crcResult & 0xFF);
+    crcResult = DRV_CANFDSPI_CalculateCRC16(spiTransmitBuffer[index], spiTransferSize - 2);
+    spiTransmitBuffer[index][spiTransferSize - 2] = (uint8_t) ((crcResult >> 8) & 0xFF);
+    spiTransmitBuffer[index][spiTransferSize - 1] = (uint8_t) (crcResult & 0xFF);
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], spiTransferSize, NULL, 0);
 
     return spiTransferError;
 }
 
 int8_t DRV_CANFDSPI_ReadWordArray(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t *rxd, uint16_t nWords)
 {
-    uint16_t i, j, n;
-    REG_t w;
-    uint16_t spiTransferSize = nWords * 4 + 2;
     int8_t spiTransferError = 0;
 
-    // Validate that length of array is sufficient to hold requested number of bytes
-    if (spiTransferSize > sizeof(spiTransmitBuffer)) {
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
         return -1;
     }
 
     // Compose command
-    spiTransmitBuffer[0] = (cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF);
-    spiTransmitBuffer[1] = address & 0xFF;
+    spiTransmitBuffer[index][0] = (cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF);
+    spiTransmitBuffer[index][1] = address & 0xFF;
+
+    // Device and MCU are both little-endian: words are clocked in directly to rxd
+    spiTransferError = DRV_SPI_TransferDataRead(index, spiTransmitBuffer[index], 2, (uint8_t*) rxd, nWords * 4);
 
-    // Clear data
-    for (i = 2; i < spiTransferSize; i++) {
-        spiTransmitBuffer[i] = 0;
+    return spiTransferError;
+}
+
+int8_t DRV_CANFDSPI_WriteWordArray(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t *txd, uint16_t nWords)
+{
+    int8_t spiTransferError = 0;
+
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
     }
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
-    if (spiTransferError) {
-        return spiTransferError;
+    // Compose command
+    spiTransmitBuffer[index][0] = (cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF);
+    spiTransmitBuffer[index][1] = address & 0xFF;
+
+    // Words are clocked out directly from txd
+    spiTransferError = DRV_SPI_TransferDataWrite(index, spiTransmitBuffer[index], 2, (const uint8_t*) txd, nWords * 4);
+
+    return spiTransferError;
+}
+
+DRV_SPI_TRANSACTION_HANDLE DRV_CANFDSPI_ReadByteArrayAsync(CANFDSPI_MODULE_ID index,
+        uint16_t address, uint8_t *rxd, uint16_t nBytes,
+        DRV_SPI_TRANSACTION_CALLBACK callback, void *context)
+{
+    DRV_SPI_TRANSACTION t;
+
+    // Compose command
+    t.spiSlaveDeviceIndex = index;
+    t.header[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((address >> 8) & 0xF));
+    t.header[1] = (uint8_t) (address & 0xFF);
+    t.headerSize = 2;
+
+    // Data is clocked in directly to rxd
+    t.txData = NULL;
+    t.rxData = rxd;
+    t.dataSize = nBytes;
+    t.callback = callback;
+    t.context = context;
+
+    return DRV_SPI_TransactionSubmit(&t);
+}
+
+DRV_SPI_TRANSACTION_HANDLE DRV_CANFDSPI_WriteByteArrayAsync(CANFDSPI_MODULE_ID index,
+        uint16_t address, uint8_t *txd, uint16_t nBytes,
+        DRV_SPI_TRANSACTION_CALLBACK callback, void *context)
+{
+    DRV_SPI_TRANSACTION t;
+
+    // Compose command
+    t.spiSlaveDeviceIndex = index;
+    t.header[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF));
+    t.header[1] = (uint8_t) (address & 0xFF);
+    t.headerSize = 2;
+
+    // Data is clocked out directly from txd
+    t.txData = txd;
+    t.rxData = NULL;
+    t.dataSize = nBytes;
+    t.callback = callback;
+    t.context = context;
+
+    return DRV_SPI_TransactionSubmit(&t);
+}
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: FIFO shadow
+
+static FIFO_SHADOW* fifo_shadow_get(CANFDSPI_MODULE_ID index, CAN_FIFO_CHANNEL channel)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return NULL;
+    }
+
+    if (channel == CAN_TXQUEUE_CH0 || channel > DRV_CANFDSPI_SHADOW_CHANNELS) {
+        return NULL;
+    }
+    return &fifoShadow[index][channel - 1];
+}
+
+void DRV_CANFDSPI_FifoShadowInvalidate(CANFDSPI_MODULE_ID index)
+{
+    uint8_t i;
+
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return;
+    }
+
+    for (i = 0; i < DRV_CANFDSPI_SHADOW_CHANNELS; i++) {
+        fifoShadow[index][i].flags = 0;
+    }
+}
+
+// Read CiFIFOCON/STA/UA in one access and decode them into fifo
+// Object 0 is located when the pointers meet (empty, or a full RX FIFO): FifoIndex then also indexes the user
+// address. Otherwise an RX shadow keeps the object 0 of an earlier read (FIFO_SHADOW_LAYOUT), and is only valid
+// with it; a failed access or a pointer mismatch drops FIFO_SHADOW_VALID but not the layout
+static int8_t fifo_shadow_read(CANFDSPI_MODULE_ID index, CAN_FIFO_CHANNEL channel, FIFO_SHADOW* fifo, REG_CiFIFOSTA* ciFifoSta)
+{
+    uint16_t a;
+    uint32_t fifoReg[3];
+    REG_CiFIFOCON ciFifoCon;
+    REG_CiFIFOUA ciFifoUa;
+    bool layout = (fifo->flags & FIFO_SHADOW_LAYOUT) != 0;
+    bool cache = true;
+    CAN_OPERATION_MODE mode;
+    uint16_t knownStart = layout ? fifo->startAddress : 0;
+    uint8_t knownSize = layout ? fifo->objectSize : 0;
+    uint8_t knownCount = layout ? fifo->objectCount : 0;
+
+    // Until OPMOD has left Configuration mode, serve the access but keep nothing: CiFIFOUA is not valid yet
+    if (fifoShadowModePending[index]) {
+        mode = DRV_CANFDSPI_OperationModeGet(index);
+        if (mode == CAN_INVALID_MODE) {
+            return -1;
+        }
+        if (mode == CAN_CONFIGURATION_MODE || mode == CAN_SLEEP_MODE) {
+            cache = false;
+        } else {
+            fifoShadowModePending[index] = 0;
+        }
     }
 
-    // Convert Byte array to Word array
-    n = 2;
-    for (i = 0; i < nWords; i++) {
-        w.word = 0;
-        for (j = 0; j < 4; j++, n++) {
-            w.byte[j] = spiReceiveBuffer[n];
+    // Get FIFO registers
+    a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
+
+    if (DRV_CANFDSPI_ReadWordArray(index, a, fifoReg, 3)) {
+        return -1;
+    }
+    ciFifoCon.word = fifoReg[0];
+    ciFifoSta->word = fifoReg[1];
+    ciFifoUa.word = fifoReg[2];
+
+    // Get address
+    #ifdef USERADDRESS_TIMES_FOUR
+    a = 4 * ciFifoUa.bF.UserAddress;
+    #else
+    a = ciFifoUa.bF.UserAddress;
+    #endif
+    fifo->userAddress = a + cRAMADDR_START;
+
+    fifo->objectCount = ciFifoCon.txBF.FifoSize + 1;
+    fifo->objectSize = 8 + fifoPayloadBytes[ciFifoCon.txBF.PayLoadSize];
+    fifo->credit = 0;
+    fifo->flags = 0;
+
+    if (ciFifoCon.txBF.TxEnable) {
+        fifo->flags |= FIFO_SHADOW_TX;
+        if (ciFifoSta->txBF.TxEmptyIF) {
+            fifo->flags |= FIFO_SHADOW_VALID;
+            fifo->credit = fifo->objectCount;
+        }
+    } else {
+        if (ciFifoCon.rxBF.RxTimeStampEnable) {
+            fifo->flags |= FIFO_SHADOW_TIMESTAMP;
+            fifo->objectSize += 4;
+        }
+        if (!ciFifoSta->rxBF.RxNotEmptyIF || ciFifoSta->rxBF.RxFullIF) {
+            fifo->flags |= FIFO_SHADOW_VALID;
+        } else if (layout && knownSize == fifo->objectSize && knownCount == fifo->objectCount
+                && fifo->userAddress >= knownStart && (fifo->userAddress - knownStart) % knownSize == 0
+                && fifo->userAddress < knownStart + knownSize * knownCount) {
+            // Same configuration, and the user address is one of its objects
+            fifo->startAddress = knownStart;
+            fifo->flags |= FIFO_SHADOW_VALID | FIFO_SHADOW_LAYOUT;
+            return 0;
         }
-        rxd[i] = w.word;
+    }
+    if (!cache) {
+        fifo->flags &= ~FIFO_SHADOW_VALID;
+    } else if (fifo->flags & FIFO_SHADOW_VALID) {
+        fifo->startAddress = fifo->userAddress - ciFifoSta->txBF.FifoIndex * fifo->objectSize;
+        fifo->flags |= FIFO_SHADOW_LAYOUT;
     }
 
-    return spiTransferError;
+    return 0;
 }
 
-int8_t DRV_CANFDSPI_WriteWordArray(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t *txd, uint16_t nWords)
+// TX credit ran short: count free objects again from the transmit pointer (one status read)
+static int8_t fifo_shadow_credit_refresh(CANFDSPI_MODULE_ID index, CAN_FIFO_CHANNEL channel, FIFO_SHADOW* fifo)
 {
-    uint16_t i, j, n;
-    REG_t w;
-    uint16_t spiTransferSize = nWords * 4 + 2;
-    int8_t spiTransferError = 0;
+    uint16_t a;
+    uint8_t userIndex;
+    uint8_t occupied;
+    REG_CiFIFOSTA ciFifoSta;
 
-    // Validate that length of array is sufficient to hold requested number of bytes
-    if (spiTransferSize > sizeof(spiTransmitBuffer)) {
+    a = cREGADDR_CiFIFOSTA + (channel * CiFIFO_OFFSET);
+    ciFifoSta.word = 0;
+    if (DRV_CANFDSPI_ReadByteArray(index, a, ciFifoSta.byte, 2)) {
         return -1;
     }
 
-    // Compose command
-    spiTransmitBuffer[0] = (cINSTRUCTION_WRITE << 4) + ((address >> 8) & 0xF);
-    spiTransmitBuffer[1] = address & 0xFF;
-
-    // Convert ByteArray to word array
-    n = 2;
-    for (i = 0; i < nWords; i++) {
-        w.word = txd[i];
-        for (j = 0; j < 4; j++, n++) {
-            spiTransmitBuffer[n] = w.byte[j];
+    if (ciFifoSta.txBF.TxEmptyIF) {
+        fifo->credit = fifo->objectCount;
+    } else if (!ciFifoSta.txBF.TxNotFullIF) {
+        fifo->credit = 0;
+    } else {
+        userIndex = (fifo->userAddress - fifo->startAddress) / fifo->objectSize;
+        occupied = (userIndex + fifo->objectCount - ciFifoSta.txBF.FifoIndex) % fifo->objectCount;
+        // Neither empty nor full, yet the pointers meet: our user address is off
+        if (occupied == 0) {
+            fifo->flags &= ~FIFO_SHADOW_VALID;
+            return -2;
+        }
+        fifo->credit = fifo->objectCount - occupied;
+    }
+
+    return 0;
+}
+
+// Shadow of a TX FIFO with its credit brought up to date when it is below wanted; fifoRead holds the registers
+// of an unshadowed channel. Without a valid shadow only the object at the user address is known to be free
+static FIFO_SHADOW* fifo_shadow_tx(CANFDSPI_MODULE_ID index, CAN_FIFO_CHANNEL channel, FIFO_SHADOW* fifoRead,
+        uint8_t wanted)
+{
+    REG_CiFIFOSTA ciFifoSta;
+    FIFO_SHADOW* fifo = fifo_shadow_get(index, channel);
+
+    if (fifo == NULL) {
+        fifo = fifoRead;
+        fifo->flags = 0;
+    }
+    if ((fifo->flags & FIFO_SHADOW_VALID) && fifo->credit < wanted) {
+        // -2: pointers disagree, the shadow was dropped and is read again below
+        if (fifo_shadow_credit_refresh(index, channel, fifo) == -1) {
+            return NULL;
+        }
+    }
+    if (!(fifo->flags & FIFO_SHADOW_VALID)) {
+        if (fifo_shadow_read(index, channel, fifo, &ciFifoSta)) {
+            return NULL;
+        }
+        if (ciFifoSta.txBF.TxNotFullIF && fifo->credit == 0) {
+            fifo->credit = 1;
+        }
+    }
+
+    return fifo;
+}
+
+// Fill level of a valid RX shadow from the status flags and FifoIndex; drops the shadow when they disagree
+static uint8_t fifo_shadow_rx_level(FIFO_SHADOW* fifo, REG_CiFIFOSTA* ciFifoSta)
+{
+    uint8_t userIndex, level;
+
+    if (!ciFifoSta->rxBF.RxNotEmptyIF) {
+        return 0;
+    }
+    if (ciFifoSta->rxBF.RxFullIF) {
+        return fifo->objectCount;
+    }
+    userIndex = (fifo->userAddress - fifo->startAddress) / fifo->objectSize;
+    level = (ciFifoSta->rxBF.FifoIndex + fifo->objectCount - userIndex) % fifo->objectCount;
+    // Neither empty nor full, yet the pointers meet: our user address is off
+    if (level == 0) {
+        fifo->flags &= ~FIFO_SHADOW_VALID;
+    }
+    return level;
+}
+
+// Number of objects waiting in a RX FIFO; with a valid shadow the user address and FifoIndex give it in one
+// status read. Otherwise the registers are read: exact once object 0 is known (or the FIFO is full), "at least
+// one" before that
+static FIFO_SHADOW* fifo_shadow_rx(CANFDSPI_MODULE_ID index, CAN_FIFO_CHANNEL channel, FIFO_SHADOW* fifoRead, uint8_t* level)
+{
+    uint16_t a;
+    REG_CiFIFOSTA ciFifoSta;
+    FIFO_SHADOW* fifo = fifo_shadow_get(index, channel);
+
+    if (fifo == NULL) {
+        fifo = fifoRead;
+        fifo->flags = 0;
+    }
+    if (fifo->flags & FIFO_SHADOW_VALID) {
+        a = cREGADDR_CiFIFOSTA + (channel * CiFIFO_OFFSET);
+        ciFifoSta.word = 0;
+        if (DRV_CANFDSPI_ReadByteArray(index, a, ciFifoSta.byte, 2)) {
+            return NULL;
         }
+        *level = fifo_shadow_rx_level(fifo, &ciFifoSta);
     }
+    if (!(fifo->flags & FIFO_SHADOW_VALID)) {
+        if (fifo_shadow_read(index, channel, fifo, &ciFifoSta)) {
+            return NULL;
+        }
+        if (fifo->flags & FIFO_SHADOW_VALID) {
+            *level = fifo_shadow_rx_level(fifo, &ciFifoSta);
+        } else {
+            // The user address is fresh, the read is served; the next one reads the registers again
+            *level = ciFifoSta.rxBF.RxNotEmptyIF ? 1 : 0;
+        }
+    }
+
+    return fifo;
+}
+
+// Follow the UINC we just wrote
+static void fifo_shadow_advance(FIFO_SHADOW* fifo)
+{
+    fifo->userAddress += fifo->objectSize;
+    if (fifo->userAddress >= fifo->startAddress + fifo->objectSize * fifo->objectCount) {
+        fifo->userAddress = fifo->startAddress;
+    }
+}
 
-    spiTransferError = DRV_SPI_TransferData(index, spiTransmitBuffer, spiReceiveBuffer, spiTransferSize);
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Staged register transactions
+
+// Registers only software changes: their values stay known between transactions
+static bool reg_stage_cacheable(uint16_t address)
+{
+    return (address >= cREGADDR_CiFLTCON && address < cREGADDR_CiFLTOBJ + CAN_FILTER_TOTAL * CiFILTER_OFFSET)
+            || address == cREGADDR_ECCCON;
+}
+
+// Entry of a register, inserted in address order when missing; NULL when full
+static REG_STAGE* reg_stage_get(CANFDSPI_MODULE_ID index, uint16_t address)
+{
+    REG_STAGE* stage;
+    uint8_t count;
+    uint8_t i, j;
+
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return NULL;
+    }
+    stage = regStage[index];
+    count = regStageCount[index];
+
+    for (i = 0; i < count && stage[i].address < address; i++);
+    if (i < count && stage[i].address == address) {
+        return &stage[i];
+    }
+
+    // Full: make room by dropping a known value that isn't staged
+    if (count == DRV_CANFDSPI_STAGE_LENGTH) {
+        for (j = 0; j < count && stage[j].staged; j++);
+        if (j == count) {
+            return NULL;
+        }
+        for (; j < count - 1; j++) {
+            stage[j] = stage[j + 1];
+        }
+        count--;
+        for (i = 0; i < count && stage[i].address < address; i++);
+    }
+
+    for (j = count; j > i; j--) {
+        stage[j] = stage[j - 1];
+    }
+    stage[i].address = address;
+    stage[i].known = 0;
+    stage[i].staged = 0;
+    stage[i].value = 0;
+    regStageCount[index] = count + 1;
+
+    return &stage[i];
+}
+
+void DRV_CANFDSPI_StagedBegin(CANFDSPI_MODULE_ID index)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return;
+    }
+
+    regStageDepth[index]++;
+}
+
+int8_t DRV_CANFDSPI_StagedFieldSet(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t mask, uint32_t value)
+{
+    REG_STAGE* reg;
+    uint8_t shift = (address & 3) * 8;
+    uint8_t i, j, m, v, old;
+    uint32_t d;
+    int8_t spiTransferError = 0;
+
+    reg = reg_stage_get(index, address & ~3);
+    if (reg == NULL) {
+        return -2;
+    }
+    mask <<= shift;
+    value <<= shift;
+
+    // Read only when part of a byte has to be kept and it isn't known
+    for (i = 0; i < 4; i++) {
+        m = (uint8_t) (mask >> (i * 8));
+        if (m && m != 0xFF && !(reg->known & (1 << i))) {
+            spiTransferError = DRV_CANFDSPI_ReadWord(index, reg->address, &d);
+            if (spiTransferError) {
+                return -1;
+            }
+            // Staged bytes keep their new value
+            for (j = 0; j < 4; j++) {
+                if (!(reg->known & (1 << j))) {
+                    reg->value = (reg->value & ~(0xFFUL << (j * 8))) | (d & (0xFFUL << (j * 8)));
+                }
+            }
+            reg->known = 0x0F;
+            break;
+        }
+    }
+
+    for (i = 0; i < 4; i++) {
+        m = (uint8_t) (mask >> (i * 8));
+        if (!m) {
+            continue;
+        }
+        old = (uint8_t) (reg->value >> (i * 8));
+        v = (old & ~m) | ((uint8_t) (value >> (i * 8)) & m);
+        // Already there
+        if ((reg->known & (1 << i)) && !(reg->staged & (1 << i)) && v == old) {
+            continue;
+        }
+        reg->value = (reg->value & ~(0xFFUL << (i * 8))) | ((uint32_t) v << (i * 8));
+        reg->known |= (1 << i);
+        reg->staged |= (1 << i);
+    }
+
+    return spiTransferError;
+}
+
+int8_t DRV_CANFDSPI_StagedCommit(CANFDSPI_MODULE_ID index)
+{
+    REG_STAGE* stage;
+    uint8_t count;
+    uint8_t txd[DRV_CANFDSPI_STAGE_LENGTH * 4];
+    uint16_t start = 0, next = 0;
+    uint8_t n = 0;
+    uint8_t i, j, k;
+    int8_t spiTransferError = 0;
+
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
+    }
+    stage = regStage[index];
+    count = regStageCount[index];
+
+    if (regStageDepth[index] > 1) {
+        regStageDepth[index]--;
+        return 0;
+    }
+    regStageDepth[index] = 0;
+
+    // Staged bytes in address order, one write per run of adjacent ones
+    for (i = 0; i < count && !spiTransferError; i++) {
+        for (j = 0; j < 4; j++) {
+            if (!(stage[i].staged & (1 << j))) {
+                continue;
+            }
+            if (n && next != stage[i].address + j) {
+                spiTransferError = DRV_CANFDSPI_WriteByteArray(index, start, txd, n);
+                n = 0;
+                if (spiTransferError) {
+                    break;
+                }
+            }
+            if (!n) {
+                start = stage[i].address + j;
+            }
+            txd[n++] = (uint8_t) (stage[i].value >> (j * 8));
+            next = stage[i].address + j + 1;
+        }
+    }
+    if (n && !spiTransferError) {
+        spiTransferError = DRV_CANFDSPI_WriteByteArray(index, start, txd, n);
+    }
+
+    // Keep what is still true afterwards: software-only registers, and only if the writes went through
+    for (i = 0, k = 0; i < count; i++) {
+        if (!spiTransferError && reg_stage_cacheable(stage[i].address)) {
+            stage[k] = stage[i];
+            stage[k].staged = 0;
+            k++;
+        }
+    }
+    regStageCount[index] = k;
+
+    return spiTransferError ? -1 : 0;
+}
+
+void DRV_CANFDSPI_StagedInvalidate(CANFDSPI_MODULE_ID index)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return;
+    }
+
+    regStageCount[index] = 0;
+    regStageDepth[index] = 0;
+}
+
+// One field update in a transaction of its own, or in the open one
+static int8_t reg_stage_field(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t mask, uint32_t value)
+{
+    int8_t spiTransferError = 0;
+
+    DRV_CANFDSPI_StagedBegin(index);
+    spiTransferError = DRV_CANFDSPI_StagedFieldSet(index, address, mask, value);
+    if (DRV_CANFDSPI_StagedCommit(index) && !spiTransferError) {
+        spiTransferError = -3;
+    }
 
     return spiTransferError;
 }
@@ -562,6 +1075,9 @@ int8_t DRV_CANFDSPI_Configure(CANFDSPI_MODULE_ID index, CAN_CONFIG* config)
     ciCon.bF.TXQEnable = config->TXQEnable;
     ciCon.bF.TxBandWidthSharing = config->TxBandWidthSharing;
 
+    // TEF and TXQ enables move every FIFO in RAM
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
+
     spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiCON, ciCon.word);
     if (spiTransferError) {
         return -1;
@@ -611,11 +1127,15 @@ int8_t DRV_CANFDSPI_OperationModeSelect(CANFDSPI_MODULE_ID index, CAN_OPERATION_
     d |= opMode;
 
     // Write
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
     spiTransferError = DRV_CANFDSPI_WriteByte(index, cREGADDR_CiCON + 3, d);
     if (spiTransferError) {
         return -2;
     }
 
+    // OPMOD follows once the bus is integrated; the first FIFO access after that reads the registers
+    fifoShadowModePending[index] = 1;
+
     return spiTransferError;
 }
 
@@ -748,6 +1268,9 @@ int8_t DRV_CANFDSPI_TransmitChannelConfigure(CANFDSPI_MODULE_ID index, CAN_FIFO_
 
     a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
 
+    // FIFO size/payload move this FIFO and the ones after it in RAM
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
+
     spiTransferError = DRV_CANFDSPI_WriteWord(index, a, ciFifoCon.word);
 
     return spiTransferError;
@@ -783,6 +1306,7 @@ int8_t DRV_CANFDSPI_TransmitQueueConfigure(CANFDSPI_MODULE_ID index,CAN_TX_QUEUE
     ciFifoCon.txBF.TxPriority = config->TxPriority;
 
     a = cREGADDR_CiTXQCON;
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
     spiTransferError = DRV_CANFDSPI_WriteWord(index, a, ciFifoCon.word);
 
     return spiTransferError;
@@ -804,24 +1328,20 @@ int8_t DRV_CANFDSPI_TransmitQueueConfigureObjectReset(CAN_TX_QUEUE_CONFIG* confi
 int8_t DRV_CANFDSPI_TransmitChannelLoad(CANFDSPI_MODULE_ID index,CAN_FIFO_CHANNEL channel, CAN_TX_MSGOBJ* txObj, uint8_t *txd, uint32_t txdNumBytes, bool flush)
 {
     uint16_t a;
-    uint32_t fifoReg[3];
+    uint8_t command[2];
     uint32_t dataBytesInObject;
-    REG_CiFIFOCON ciFifoCon;
-    __attribute__((unused)) REG_CiFIFOSTA ciFifoSta;
-    REG_CiFIFOUA ciFifoUa;
+    FIFO_SHADOW fifoRead;
+    FIFO_SHADOW* fifo;
     int8_t spiTransferError = 0;
 
-    // Get FIFO registers
-    a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
-
-    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, a, fifoReg, 3);
-    if (spiTransferError) {
+    // Get FIFO registers, unless the shadow already knows them
+    fifo = fifo_shadow_tx(index, channel, &fifoRead, 1);
+    if (fifo == NULL) {
         return -1;
     }
 
     // Check that it is a transmit buffer
-    ciFifoCon.word = fifoReg[0];
-    if (!ciFifoCon.txBF.TxEnable) {
+    if (!(fifo->flags & FIFO_SHADOW_TX)) {
         return -2;
     }
 
@@ -831,58 +1351,150 @@ int8_t DRV_CANFDSPI_TransmitChannelLoad(CANFDSPI_MODULE_ID index,CAN_FIFO_CHANNE
         return -3;
     }
 
-    // Get status
-    ciFifoSta.word = fifoReg[1];
+    // Check that there is room
+    if (fifo->credit == 0) {
+        return -6;
+    }
 
     // Get address
-    ciFifoUa.word = fifoReg[2];
-    #ifdef USERADDRESS_TIMES_FOUR
-    a = 4 * ciFifoUa.bF.UserAddress;
-    #else
-    a = ciFifoUa.bF.UserAddress;
-    #endif
-    a += cRAMADDR_START;
+    a = fifo->userAddress;
+
+    // Header and data are clocked out from where they are, padded to a multiple of 4 bytes
+    command[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((a >> 8) & 0xF));
+    command[1] = (uint8_t) (a & 0xFF);
+    spiTransferError = DRV_SPI_TransferWriteBegin(index, command, 2);
+    if (!spiTransferError) {
+        DRV_SPI_TransferWriteContinue(txObj->byte, 8);
+        DRV_SPI_TransferWriteContinue(txd, txdNumBytes);
+        DRV_SPI_TransferWriteContinue(NULL, (4 - (txdNumBytes % 4)) % 4);
+        DRV_SPI_TransferWriteEnd();
+    }
+    if (spiTransferError) {
+        fifo->flags &= ~FIFO_SHADOW_VALID;
+        return -4;
+    }
+
+    // Set UINC and TXREQ
+    spiTransferError = DRV_CANFDSPI_TransmitChannelUpdate(index, channel, flush);
+    if (spiTransferError) {
+        fifo->flags &= ~FIFO_SHADOW_VALID;
+        return -5;
+    }
 
-    uint8_t txBuffer[MAX_MSG_SIZE];
+    fifo_shadow_advance(fifo);
+    fifo->credit--;
 
-    txBuffer[0] = txObj->byte[0]; //not using 'for' to reduce no of instructions
-    txBuffer[1] = txObj->byte[1];
-    txBuffer[2] = txObj->byte[2];
-    txBuffer[3] = txObj->byte[3];
+    return spiTransferError;
+}
 
-    txBuffer[4] = txObj->byte[4];
-    txBuffer[5] = txObj->byte[5];
-    txBuffer[6] = txObj->byte[6];
-    txBuffer[7] = txObj->byte[7];
+CAN_TX_MSGOBJ* DRV_CANFDSPI_TransmitObjectGet(CANFDSPI_MODULE_ID index, uint8_t **txd)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        *txd = NULL;
+        return NULL;
+    }
 
-    uint8_t i;
-    for (i = 0; i < txdNumBytes; i++) {
-        txBuffer[i + 8] = txd[i];
+    *txd = &spiTransmitBuffer[index][TX_OBJECT_OFFSET + 8];
+    return (CAN_TX_MSGOBJ*) &spiTransmitBuffer[index][TX_OBJECT_OFFSET];
+}
+
+int8_t DRV_CANFDSPI_TransmitObjectLoad(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, uint8_t txdNumBytes, bool flush)
+{
+    uint8_t *txd;
+    CAN_TX_MSGOBJ* txObj = DRV_CANFDSPI_TransmitObjectGet(index, &txd);
+
+    if (txObj == NULL) {
+        return -1;
+    }
+    if (txdNumBytes > SPI_DEFAULT_BUFFER_LENGTH - TX_OBJECT_OFFSET - 8) {
+        return -3;
     }
 
-    // Make sure we write a multiple of 4 bytes to RAM
-    uint16_t n = 0;
-    uint8_t j = 0;
+    return DRV_CANFDSPI_TransmitChannelLoad(index, channel, txObj, txd, txdNumBytes, flush);
+}
+
+int8_t DRV_CANFDSPI_TransmitChannelLoadBatch(CANFDSPI_MODULE_ID index, CAN_FIFO_CHANNEL channel,
+        CAN_TX_MSGOBJ* txObj, uint8_t **txd, uint8_t nMessages, uint8_t *nLoaded, bool flush)
+{
+    uint8_t i, m;
+    uint8_t dataBytes;
+    uint8_t gap;
+    uint8_t command[2];
+    uint16_t a, fifoEnd;
+    bool burst;
+    FIFO_SHADOW fifoRead;
+    FIFO_SHADOW* fifo;
+    int8_t spiTransferError = 0;
 
-    if (txdNumBytes % 4) {
-        // Need to add bytes
-        n = 4 - (txdNumBytes % 4);
-        i = txdNumBytes + 8;
+    *nLoaded = 0;
 
-        for (j = 0; j < n; j++) {
-            txBuffer[i + 8 + j] = 0;
+    // Get FIFO registers, unless the shadow already knows them
+    fifo = fifo_shadow_tx(index, channel, &fifoRead, nMessages);
+    if (fifo == NULL) {
+        return -1;
+    }
+
+    // Check that it is a transmit buffer
+    if (!(fifo->flags & FIFO_SHADOW_TX)) {
+        return -2;
+    }
+
+    // Check that every object fits the FIFO payload
+    for (i = 0; i < nMessages; i++) {
+        if (DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) txObj[i].bF.ctrl.DLC) > fifo->objectSize - 8) {
+            return -3;
         }
     }
 
-    spiTransferError = DRV_CANFDSPI_WriteByteArray(index, a, txBuffer, txdNumBytes + 8 + n);
-    if (spiTransferError) {
-        return -4;
+    // Load as many as there is room for
+    if (fifo->credit == 0) {
+        return -6;
     }
+    m = (nMessages < fifo->credit) ? nMessages : fifo->credit;
 
-    // Set UINC and TXREQ
-    spiTransferError = DRV_CANFDSPI_TransmitChannelUpdate(index, channel, flush);
-    if (spiTransferError) {
-        return -5;
+    // Write objects in RAM bursts; a burst ends where the FIFO wraps, or where too much of a slot would be padding
+    a = fifo->userAddress;
+    fifoEnd = fifo->startAddress + fifo->objectSize * fifo->objectCount;
+    i = 0;
+    while (i < m) {
+        command[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((a >> 8) & 0xF));
+        command[1] = (uint8_t) (a & 0xFF);
+        spiTransferError = DRV_SPI_TransferWriteBegin(index, command, 2);
+        if (spiTransferError) {
+            fifo->flags &= ~FIFO_SHADOW_VALID;
+            return -4;
+        }
+        do {
+            dataBytes = DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) txObj[i].bF.ctrl.DLC);
+            DRV_SPI_TransferWriteContinue(txObj[i].byte, 8);
+            DRV_SPI_TransferWriteContinue(txd[i], dataBytes);
+            i++;
+            a += fifo->objectSize;
+            gap = fifo->objectSize - 8 - dataBytes;
+            burst = (i < m) && (a < fifoEnd) && (gap <= RAM_BURST_GAP_MAX);
+            // Pad to the next object, or to a multiple of 4 bytes at the end of the burst
+            if (!burst) {
+                gap = (4 - (dataBytes % 4)) % 4;
+            }
+            DRV_SPI_TransferWriteContinue(NULL, gap);
+        } while (burst);
+        DRV_SPI_TransferWriteEnd();
+        if (a >= fifoEnd) {
+            a = fifo->startAddress;
+        }
+    }
+
+    // One UINC per object, TXREQ with the last one
+    for (i = 0; i < m; i++) {
+        spiTransferError = DRV_CANFDSPI_TransmitChannelUpdate(index, channel, flush && (i == m - 1));
+        if (spiTransferError) {
+            fifo->flags &= ~FIFO_SHADOW_VALID;
+            return -5;
+        }
+        fifo_shadow_advance(fifo);
+        fifo->credit--;
+        (*nLoaded)++;
     }
 
     return spiTransferError;
@@ -1069,16 +1681,13 @@ int8_t DRV_CANFDSPI_FilterObjectConfigure(CANFDSPI_MODULE_ID index,
 {
     uint16_t a;
     REG_CiFLTOBJ fObj;
-    int8_t spiTransferError = 0;
 
     // Setup
     fObj.word = 0;
     fObj.bF = *id;
     a = cREGADDR_CiFLTOBJ + (filter * CiFILTER_OFFSET);
 
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, a, fObj.word);
-
-    return spiTransferError;
+    return reg_stage_field(index, a, 0xFFFFFFFF, fObj.word);
 }
 
 int8_t DRV_CANFDSPI_FilterMaskConfigure(CANFDSPI_MODULE_ID index,
@@ -1086,16 +1695,13 @@ int8_t DRV_CANFDSPI_FilterMaskConfigure(CANFDSPI_MODULE_ID index,
 {
     uint16_t a;
     REG_CiMASK mObj;
-    int8_t spiTransferError = 0;
 
     // Setup
     mObj.word = 0;
     mObj.bF = *mask;
     a = cREGADDR_CiMASK + (filter * CiFILTER_OFFSET);
 
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, a, mObj.word);
-
-    return spiTransferError;
+    return reg_stage_field(index, a, 0xFFFFFFFF, mObj.word);
 }
 
 int8_t DRV_CANFDSPI_FilterToFifoLink(CANFDSPI_MODULE_ID index,
@@ -1103,7 +1709,6 @@ int8_t DRV_CANFDSPI_FilterToFifoLink(CANFDSPI_MODULE_ID index,
 {
     uint16_t a;
     REG_CiFLTCON_BYTE fCtrl;
-    int8_t spiTransferError = 0;
 
     // Enable
     if (enable) {
@@ -1116,58 +1721,62 @@ int8_t DRV_CANFDSPI_FilterToFifoLink(CANFDSPI_MODULE_ID index,
     fCtrl.bF.BufferPointer = channel;
     a = cREGADDR_CiFLTCON + filter;
 
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, fCtrl.byte);
+    return reg_stage_field(index, a, 0xFF, fCtrl.byte);
+}
 
-    return spiTransferError;
+int8_t DRV_CANFDSPI_FilterEnable(CANFDSPI_MODULE_ID index, CAN_FILTER filter)
+{
+    REG_CiFLTCON_BYTE fCtrl;
+
+    // Modify the enable bit only, no read once the filter control is known
+    fCtrl.byte = 0;
+    fCtrl.bF.Enable = 1;
+
+    return reg_stage_field(index, cREGADDR_CiFLTCON + filter, fCtrl.byte, fCtrl.byte);
 }
 
-int8_t DRV_CANFDSPI_FilterEnable(CANFDSPI_MODULE_ID index, CAN_FILTER filter)
+int8_t DRV_CANFDSPI_FilterDisable(CANFDSPI_MODULE_ID index, CAN_FILTER filter)
 {
-    uint16_t a;
     REG_CiFLTCON_BYTE fCtrl;
-    int8_t spiTransferError = 0;
-
-    // Read
-    a = cREGADDR_CiFLTCON + filter;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &fCtrl.byte);
-    if (spiTransferError) {
-        return -1;
-    }
 
-    // Modify
+    // Modify the enable bit only, no read once the filter control is known
+    fCtrl.byte = 0;
     fCtrl.bF.Enable = 1;
 
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, fCtrl.byte);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    return spiTransferError;
+    return reg_stage_field(index, cREGADDR_CiFLTCON + filter, fCtrl.byte, 0);
 }
 
-int8_t DRV_CANFDSPI_FilterDisable(CANFDSPI_MODULE_ID index, CAN_FILTER filter)
+int8_t DRV_CANFDSPI_FilterTableWrite(CANFDSPI_MODULE_ID index, const uint32_t* control,
+        const uint32_t* objects, uint8_t nFilters)
 {
-    uint16_t a;
-    REG_CiFLTCON_BYTE fCtrl;
+    uint32_t disabled[CAN_FILTER_TOTAL / 4];
+    uint8_t i;
     int8_t spiTransferError = 0;
 
-    // Read
-    a = cREGADDR_CiFLTCON + filter;
+    if (nFilters > CAN_FILTER_TOTAL) {
+        return -1;
+    }
 
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &fCtrl.byte);
+    // Filter objects are only taken while their filter is disabled
+    for (i = 0; i < CAN_FILTER_TOTAL / 4; i++) {
+        disabled[i] = 0;
+    }
+    DRV_CANFDSPI_StagedInvalidate(index);
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiFLTCON, disabled, CAN_FILTER_TOTAL / 4);
     if (spiTransferError) {
-        return -1;
+        return -2;
     }
 
-    // Modify
-    fCtrl.bF.Enable = 0;
+    if (nFilters) {
+        spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiFLTOBJ, (uint32_t*) objects, nFilters * 2);
+        if (spiTransferError) {
+            return -3;
+        }
+    }
 
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, fCtrl.byte);
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiFLTCON, (uint32_t*) control, CAN_FILTER_TOTAL / 4);
     if (spiTransferError) {
-        return -2;
+        return -4;
     }
 
     return spiTransferError;
@@ -1219,6 +1828,9 @@ int8_t DRV_CANFDSPI_ReceiveChannelConfigure(CANFDSPI_MODULE_ID index,
 
     a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
 
+    // FIFO size/payload move this FIFO and the ones after it in RAM
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
+
     spiTransferError = DRV_CANFDSPI_WriteWord(index, a, ciFifoCon.word);
 
     return spiTransferError;
@@ -1263,103 +1875,177 @@ int8_t DRV_CANFDSPI_ReceiveMessageGet(CANFDSPI_MODULE_ID index,
         uint8_t *rxd, uint8_t nBytes)
 {
     uint8_t n = 0;
-    uint8_t i = 0;
+    uint8_t command[2];
     uint16_t a;
-    uint32_t fifoReg[3];
-    REG_CiFIFOCON ciFifoCon;
-    __attribute__((unused)) REG_CiFIFOSTA ciFifoSta;
-    REG_CiFIFOUA ciFifoUa;
+    FIFO_SHADOW fifoRead;
+    FIFO_SHADOW* fifo;
+    REG_CiFIFOSTA ciFifoSta;
     int8_t spiTransferError = 0;
 
-    // Get FIFO registers
-    a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
-
-    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, a, fifoReg, 3);
-    if (spiTransferError) {
-        return -1;
+    // Get FIFO registers, unless the shadow already knows them
+    fifo = fifo_shadow_get(index, channel);
+    if (fifo == NULL) {
+        fifo = &fifoRead;
+        fifo->flags = 0;
+    }
+    if (!(fifo->flags & FIFO_SHADOW_VALID)) {
+        // Not valid afterwards when object 0 is unknown: the read is served, the next one reads the registers again
+        spiTransferError = fifo_shadow_read(index, channel, fifo, &ciFifoSta);
+        if (spiTransferError) {
+            return -1;
+        }
     }
 
     // Check that it is a receive buffer
-    ciFifoCon.word = fifoReg[0];
-    if (ciFifoCon.txBF.TxEnable) {
+    if (fifo->flags & FIFO_SHADOW_TX) {
         return -2;
     }
 
-    // Get Status
-    ciFifoSta.word = fifoReg[1];
-
     // Get address
-    ciFifoUa.word = fifoReg[2];
-    #ifdef USERADDRESS_TIMES_FOUR
-    a = 4 * ciFifoUa.bF.UserAddress;
-    #else
-    a = ciFifoUa.bF.UserAddress;
-    #endif
-    a += cRAMADDR_START;
+    a = fifo->userAddress;
 
-    // Number of bytes to read
-    n = nBytes + 8; // Add 8 header bytes
+    // Don't read past the object
+    n = fifo->objectSize - 8;
+    if (fifo->flags & FIFO_SHADOW_TIMESTAMP) {
+        n -= 4;
+    }
+    if (nBytes > n) {
+        nBytes = n;
+    }
 
-    if (ciFifoCon.rxBF.RxTimeStampEnable) {
-        n += 4; // Add 4 time stamp bytes
+    // Header, time stamp and data are clocked in directly to rxObj and rxd, padded to a multiple of 4 bytes
+    command[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((a >> 8) & 0xF));
+    command[1] = (uint8_t) (a & 0xFF);
+    spiTransferError = DRV_SPI_TransferReadBegin(index, command, 2);
+    if (spiTransferError) {
+        fifo->flags &= ~FIFO_SHADOW_VALID;
+        return -3;
     }
+    DRV_SPI_TransferReadContinue(rxObj->byte, 8);
+    if (fifo->flags & FIFO_SHADOW_TIMESTAMP) {
+        DRV_SPI_TransferReadContinue(rxObj->byte + 8, 4);
+    } else {
+        rxObj->word[2] = 0;
+    }
+    DRV_SPI_TransferReadContinue(rxd, nBytes);
+    DRV_SPI_TransferReadContinue(NULL, (4 - (nBytes % 4)) % 4);
+    DRV_SPI_TransferReadEnd();
 
-    // Make sure we read a multiple of 4 bytes from RAM
-    if (n % 4) {
-        n = n + 4 - (n % 4);
+    // UINC channel
+    spiTransferError = DRV_CANFDSPI_ReceiveChannelUpdate(index, channel);
+    if (spiTransferError) {
+        fifo->flags &= ~FIFO_SHADOW_VALID;
+        return -4;
     }
 
-    // Read rxObj using one access
-    uint8_t ba[MAX_MSG_SIZE];
+    fifo_shadow_advance(fifo);
+
+    return spiTransferError;
+}
 
-    if (n > MAX_MSG_SIZE) {
-        n = MAX_MSG_SIZE;
+int8_t DRV_CANFDSPI_ReceiveObjectGet(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, CAN_RX_MSGOBJ** rxObj,
+        uint8_t **rxd, uint8_t nBytes)
+{
+    if (index >= DRV_CANFDSPI_INDEX_COUNT) {
+        return -1;
     }
 
-    spiTransferError = DRV_CANFDSPI_ReadByteArray(index, a, ba, n);
-    if (spiTransferError) {
-        return -3;
+    // Object at the start of the buffer, data always after a (possibly empty) time stamp
+    *rxObj = (CAN_RX_MSGOBJ*) spiReceiveBuffer[index];
+    *rxd = &spiReceiveBuffer[index][sizeof(CAN_RX_MSGOBJ)];
+
+    if (nBytes > SPI_DEFAULT_BUFFER_LENGTH - sizeof(CAN_RX_MSGOBJ)) {
+        nBytes = SPI_DEFAULT_BUFFER_LENGTH - sizeof(CAN_RX_MSGOBJ);
     }
 
-    // Assign message header
-    REG_t myReg;
+    return DRV_CANFDSPI_ReceiveMessageGet(index, channel, *rxObj, *rxd, nBytes);
+}
+
+int8_t DRV_CANFDSPI_ReceiveMessageDrain(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, CAN_RX_MSGOBJ* rxObj, uint8_t *rxd,
+        uint8_t nBytes, uint8_t nMessages, uint8_t *nReceived)
+{
+    uint8_t i, m;
+    uint8_t level = 0;
+    uint8_t headerBytes;
+    uint8_t dataBytes;
+    uint8_t gap;
+    uint8_t command[2];
+    uint16_t a, fifoEnd;
+    bool burst;
+    FIFO_SHADOW fifoRead;
+    FIFO_SHADOW* fifo;
+    int8_t spiTransferError = 0;
 
-    myReg.byte[0] = ba[0];
-    myReg.byte[1] = ba[1];
-    myReg.byte[2] = ba[2];
-    myReg.byte[3] = ba[3];
-    rxObj->word[0] = myReg.word;
+    *nReceived = 0;
 
-    myReg.byte[0] = ba[4];
-    myReg.byte[1] = ba[5];
-    myReg.byte[2] = ba[6];
-    myReg.byte[3] = ba[7];
-    rxObj->word[1] = myReg.word;
+    // Get the fill level, from the shadow when it is valid
+    fifo = fifo_shadow_rx(index, channel, &fifoRead, &level);
+    if (fifo == NULL) {
+        return -1;
+    }
 
-    if (ciFifoCon.rxBF.RxTimeStampEnable) {
-        myReg.byte[0] = ba[8];
-        myReg.byte[1] = ba[9];
-        myReg.byte[2] = ba[10];
-        myReg.byte[3] = ba[11];
-        rxObj->word[2] = myReg.word;
+    // Check that it is a receive buffer
+    if (fifo->flags & FIFO_SHADOW_TX) {
+        return -2;
+    }
 
-        // Assign message data
-        for (i = 0; i < nBytes; i++) {
-            rxd[i] = ba[i + 12];
-        }
-    } else {
-        rxObj->word[2] = 0;
+    m = (nMessages < level) ? nMessages : level;
+    if (m == 0) {
+        return 0;
+    }
 
-        // Assign message data
-        for (i = 0; i < nBytes; i++) {
-            rxd[i] = ba[i + 8];
+    headerBytes = (fifo->flags & FIFO_SHADOW_TIMESTAMP) ? 12 : 8;
+
+    // Read objects in RAM bursts: header first, then only the data bytes its DLC announces
+    a = fifo->userAddress;
+    fifoEnd = fifo->startAddress + fifo->objectSize * fifo->objectCount;
+    i = 0;
+    while (i < m) {
+        command[0] = (uint8_t) ((cINSTRUCTION_READ << 4) + ((a >> 8) & 0xF));
+        command[1] = (uint8_t) (a & 0xFF);
+        spiTransferError = DRV_SPI_TransferReadBegin(index, command, 2);
+        if (spiTransferError) {
+            fifo->flags &= ~FIFO_SHADOW_VALID;
+            return -3;
+        }
+        do {
+            rxObj[i].word[2] = 0;
+            DRV_SPI_TransferReadContinue(rxObj[i].byte, headerBytes);
+            dataBytes = DRV_CANFDSPI_DlcToDataBytes((CAN_DLC) rxObj[i].bF.ctrl.DLC);
+            if (dataBytes > fifo->objectSize - headerBytes) {
+                dataBytes = fifo->objectSize - headerBytes;
+            }
+            if (dataBytes > nBytes) {
+                dataBytes = nBytes;
+            }
+            DRV_SPI_TransferReadContinue(rxd + i * nBytes, dataBytes);
+            i++;
+            a += fifo->objectSize;
+            gap = fifo->objectSize - headerBytes - dataBytes;
+            burst = (i < m) && (a < fifoEnd) && (gap <= RAM_BURST_GAP_MAX);
+            // Skip to the next object, or to a multiple of 4 bytes at the end of the burst
+            if (!burst) {
+                gap = (4 - (dataBytes % 4)) % 4;
+            }
+            DRV_SPI_TransferReadContinue(NULL, gap);
+        } while (burst);
+        DRV_SPI_TransferReadEnd();
+        if (a >= fifoEnd) {
+            a = fifo->startAddress;
         }
     }
 
-    // UINC channel
-    spiTransferError = DRV_CANFDSPI_ReceiveChannelUpdate(index, channel);
-    if (spiTransferError) {
-        return -4;
+    // One UINC per object
+    for (i = 0; i < m; i++) {
+        spiTransferError = DRV_CANFDSPI_ReceiveChannelUpdate(index, channel);
+        if (spiTransferError) {
+            fifo->flags &= ~FIFO_SHADOW_VALID;
+            return -4;
+        }
+        fifo_shadow_advance(fifo);
+        (*nReceived)++;
     }
 
     return spiTransferError;
@@ -1370,6 +2056,7 @@ int8_t DRV_CANFDSPI_ReceiveChannelReset(CANFDSPI_MODULE_ID index,
 {
     uint16_t a = 0;
     REG_CiFIFOCON ciFifoCon;
+    FIFO_SHADOW* fifo;
     int8_t spiTransferError = 0;
 
     // Address and data
@@ -1377,6 +2064,12 @@ int8_t DRV_CANFDSPI_ReceiveChannelReset(CANFDSPI_MODULE_ID index,
     ciFifoCon.word = 0;
     ciFifoCon.rxBF.FRESET = 1;
 
+    // Back to object 0
+    fifo = fifo_shadow_get(index, channel);
+    if (fifo != NULL) {
+        fifo->flags = 0;
+    }
+
     spiTransferError = DRV_CANFDSPI_WriteByte(index, a, ciFifoCon.byte[1]);
 
     return spiTransferError;
@@ -1467,39 +2160,13 @@ int8_t DRV_CANFDSPI_TefMessageGet(CANFDSPI_MODULE_ID index,
         n += 4; // Add 4 time stamp bytes
     }
 
-    // Read rxObj using one access
-    uint8_t ba[12];
-
-    spiTransferError = DRV_CANFDSPI_ReadByteArray(index, a, ba, n);
+    // Read tefObj using one access, straight into its words
+    tefObj->word[2] = 0;
+    spiTransferError = DRV_CANFDSPI_ReadByteArray(index, a, tefObj->byte, n);
     if (spiTransferError) {
         return -2;
     }
 
-    // Assign message header
-    REG_t myReg;
-
-    myReg.byte[0] = ba[0];
-    myReg.byte[1] = ba[1];
-    myReg.byte[2] = ba[2];
-    myReg.byte[3] = ba[3];
-    tefObj->word[0] = myReg.word;
-
-    myReg.byte[0] = ba[4];
-    myReg.byte[1] = ba[5];
-    myReg.byte[2] = ba[6];
-    myReg.byte[3] = ba[7];
-    tefObj->word[1] = myReg.word;
-
-    if (ciTefCon.bF.TimeStampEnable) {
-        myReg.byte[0] = ba[8];
-        myReg.byte[1] = ba[9];
-        myReg.byte[2] = ba[10];
-        myReg.byte[3] = ba[11];
-        tefObj->word[2] = myReg.word;
-    } else {
-        tefObj->word[2] = 0;
-    }
-
     // Set UINC
     spiTransferError = DRV_CANFDSPI_TefUpdate(index);
     if (spiTransferError) {
@@ -1554,6 +2221,7 @@ int8_t DRV_CANFDSPI_TefConfigure(CANFDSPI_MODULE_ID index, CAN_TEF_CONFIG* confi
     ciTefCon.bF.FifoSize = config->FifoSize;
     ciTefCon.bF.TimeStampEnable = config->TimeStampEnable;
 
+    DRV_CANFDSPI_FifoShadowInvalidate(index);
     spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiTEFCON, ciTefCon.word);
 
     return spiTransferError;
@@ -1846,57 +2514,23 @@ int8_t DRV_CANFDSPI_TransmitChannelIndexGet(CANFDSPI_MODULE_ID index,
 int8_t DRV_CANFDSPI_TransmitChannelEventEnable(CANFDSPI_MODULE_ID index,
         CAN_FIFO_CHANNEL channel, CAN_TX_FIFO_EVENT flags)
 {
-    int8_t spiTransferError = 0;
     uint16_t a = 0;
 
-    // Read Interrupt Enables
+    // Modify the interrupt enables only
     a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
-    REG_CiFIFOCON ciFifoCon;
-    ciFifoCon.word = 0;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    ciFifoCon.byte[0] |= (flags & CAN_TX_FIFO_ALL_EVENTS);
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -2;
-    }
 
-    return spiTransferError;
+    return reg_stage_field(index, a, flags & CAN_TX_FIFO_ALL_EVENTS, flags & CAN_TX_FIFO_ALL_EVENTS);
 }
 
 int8_t DRV_CANFDSPI_TransmitChannelEventDisable(CANFDSPI_MODULE_ID index,
         CAN_FIFO_CHANNEL channel, CAN_TX_FIFO_EVENT flags)
 {
-    int8_t spiTransferError = 0;
     uint16_t a = 0;
 
-    // Read Interrupt Enables
+    // Modify the interrupt enables only
     a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
-    REG_CiFIFOCON ciFifoCon;
-    ciFifoCon.word = 0;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    ciFifoCon.byte[0] &= ~(flags & CAN_TX_FIFO_ALL_EVENTS);
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -2;
-    }
 
-    return spiTransferError;
+    return reg_stage_field(index, a, flags & CAN_TX_FIFO_ALL_EVENTS, 0);
 }
 
 int8_t DRV_CANFDSPI_TransmitChannelEventAttemptClear(CANFDSPI_MODULE_ID index,
@@ -1984,61 +2618,27 @@ int8_t DRV_CANFDSPI_ReceiveChannelIndexGet(CANFDSPI_MODULE_ID index,
 int8_t DRV_CANFDSPI_ReceiveChannelEventEnable(CANFDSPI_MODULE_ID index,
         CAN_FIFO_CHANNEL channel, CAN_RX_FIFO_EVENT flags)
 {
-    int8_t spiTransferError = 0;
     uint16_t a = 0;
 
     if (channel == CAN_TXQUEUE_CH0) return -100;
 
-    // Read Interrupt Enables
+    // Modify the interrupt enables only
     a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
-    REG_CiFIFOCON ciFifoCon;
-    ciFifoCon.word = 0;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    ciFifoCon.byte[0] |= (flags & CAN_RX_FIFO_ALL_EVENTS);
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -2;
-    }
 
-    return spiTransferError;
+    return reg_stage_field(index, a, flags & CAN_RX_FIFO_ALL_EVENTS, flags & CAN_RX_FIFO_ALL_EVENTS);
 }
 
 int8_t DRV_CANFDSPI_ReceiveChannelEventDisable(CANFDSPI_MODULE_ID index,
         CAN_FIFO_CHANNEL channel, CAN_RX_FIFO_EVENT flags)
 {
-    int8_t spiTransferError = 0;
     uint16_t a = 0;
 
     if (channel == CAN_TXQUEUE_CH0) return -100;
 
-    // Read Interrupt Enables
+    // Modify the interrupt enables only
     a = cREGADDR_CiFIFOCON + (channel * CiFIFO_OFFSET);
-    REG_CiFIFOCON ciFifoCon;
-    ciFifoCon.word = 0;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    ciFifoCon.byte[0] &= ~(flags & CAN_RX_FIFO_ALL_EVENTS);
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, ciFifoCon.byte[0]);
-    if (spiTransferError) {
-        return -2;
-    }
 
-    return spiTransferError;
+    return reg_stage_field(index, a, flags & CAN_RX_FIFO_ALL_EVENTS, 0);
 }
 
 int8_t DRV_CANFDSPI_ReceiveChannelEventOverflowClear(CANFDSPI_MODULE_ID index,
@@ -2306,48 +2906,14 @@ int8_t DRV_CANFDSPI_BusDiagnosticsClear(CANFDSPI_MODULE_ID index)
 
 int8_t DRV_CANFDSPI_EccEnable(CANFDSPI_MODULE_ID index)
 {
-    int8_t spiTransferError = 0;
-    uint8_t d = 0;
-
-    // Read
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, cREGADDR_ECCCON, &d);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    d |= 0x01;
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, cREGADDR_ECCCON, d);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    return 0;
+    // Modify ECCEN only, no read once ECCCON is known
+    return reg_stage_field(index, cREGADDR_ECCCON, 0x01, 0x01);
 }
 
 int8_t DRV_CANFDSPI_EccDisable(CANFDSPI_MODULE_ID index)
 {
-    int8_t spiTransferError = 0;
-    uint8_t d = 0;
-
-    // Read
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, cREGADDR_ECCCON, &d);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    d &= ~0x01;
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, cREGADDR_ECCCON, d);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    return 0;
+    // Modify ECCEN only, no read once ECCCON is known
+    return reg_stage_field(index, cREGADDR_ECCCON, 0x01, 0x00);
 }
 
 int8_t DRV_CANFDSPI_EccEventGet(CANFDSPI_MODULE_ID index,
@@ -2374,12 +2940,8 @@ int8_t DRV_CANFDSPI_EccEventGet(CANFDSPI_MODULE_ID index,
 int8_t DRV_CANFDSPI_EccParitySet(CANFDSPI_MODULE_ID index,
         uint8_t parity)
 {
-    int8_t spiTransferError = 0;
-
     // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, cREGADDR_ECCCON + 1, parity);
-
-    return spiTransferError;
+    return reg_stage_field(index, cREGADDR_ECCCON + 1, 0xFF, parity);
 }
 
 int8_t DRV_CANFDSPI_EccParityGet(CANFDSPI_MODULE_ID index,
@@ -2405,66 +2967,26 @@ int8_t DRV_CANFDSPI_EccErrorAddressGet(CANFDSPI_MODULE_ID index,
         return -1;
     }
 
-    // Update data
-    *a = reg.bF.ErrorAddress;
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_EccEventEnable(CANFDSPI_MODULE_ID index,
-        CAN_ECC_EVENT flags)
-{
-    int8_t spiTransferError = 0;
-    uint16_t a = 0;
-
-    // Read
-    a = cREGADDR_ECCCON;
-    uint8_t eccInterrupts = 0;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &eccInterrupts);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    eccInterrupts |= (flags & CAN_ECC_ALL_EVENTS);
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, eccInterrupts);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_EccEventDisable(CANFDSPI_MODULE_ID index,
-        CAN_ECC_EVENT flags)
-{
-    int8_t spiTransferError = 0;
-    uint16_t a = 0;
-
-    // Read
-    a = cREGADDR_ECCCON;
-    uint8_t eccInterrupts = 0;
-
-    spiTransferError = DRV_CANFDSPI_ReadByte(index, a, &eccInterrupts);
-    if (spiTransferError) {
-        return -1;
-    }
-
-    // Modify
-    eccInterrupts &= ~(flags & CAN_ECC_ALL_EVENTS);
-
-    // Write
-    spiTransferError = DRV_CANFDSPI_WriteByte(index, a, eccInterrupts);
-    if (spiTransferError) {
-        return -2;
-    }
+    // Update data
+    *a = reg.bF.ErrorAddress;
 
     return spiTransferError;
 }
 
+int8_t DRV_CANFDSPI_EccEventEnable(CANFDSPI_MODULE_ID index,
+        CAN_ECC_EVENT flags)
+{
+    // Modify the interrupt enables only
+    return reg_stage_field(index, cREGADDR_ECCCON, flags & CAN_ECC_ALL_EVENTS, flags & CAN_ECC_ALL_EVENTS);
+}
+
+int8_t DRV_CANFDSPI_EccEventDisable(CANFDSPI_MODULE_ID index,
+        CAN_ECC_EVENT flags)
+{
+    // Modify the interrupt enables only
+    return reg_stage_field(index, cREGADDR_ECCCON, flags & CAN_ECC_ALL_EVENTS, 0);
+}
+
 int8_t DRV_CANFDSPI_EccEventClear(CANFDSPI_MODULE_ID index,
         CAN_ECC_EVENT flags)
 {
@@ -2610,23 +3132,97 @@ int8_t DRV_CANFDSPI_CrcValueGet(CANFDSPI_MODULE_ID index, uint16_t* crc)
 
 int8_t DRV_CANFDSPI_RamInit(CANFDSPI_MODULE_ID index, uint8_t d)
 {
-    uint8_t txd[SPI_DEFAULT_BUFFER_LENGTH/2];
-    uint32_t k;
+    uint8_t command[2];
     int8_t spiTransferError = 0;
 
-    // Prepare data
-    for (k = 0; k < SPI_DEFAULT_BUFFER_LENGTH/2; k++) {
-        txd[k] = d;
+    // One write across the whole RAM, the address auto-increments while CS stays low
+    command[0] = (uint8_t) ((cINSTRUCTION_WRITE << 4) + ((cRAMADDR_START >> 8) & 0xF));
+    command[1] = (uint8_t) (cRAMADDR_START & 0xFF);
+    spiTransferError = DRV_SPI_TransferWriteBegin(index, command, 2);
+    if (spiTransferError) {
+        return -1;
     }
+    DRV_SPI_TransferWriteFill(d, cRAM_SIZE);
+    DRV_SPI_TransferWriteEnd();
 
-    uint16_t a = cRAMADDR_START;
+    return spiTransferError;
+}
 
-    for (k = 0; k < ((cRAM_SIZE / SPI_DEFAULT_BUFFER_LENGTH) * 2); k++) {
-        spiTransferError = DRV_CANFDSPI_WriteByteArray(index, a, txd, SPI_DEFAULT_BUFFER_LENGTH/2);
-        if (spiTransferError) {
-            return -1;
-        }
-        a += SPI_DEFAULT_BUFFER_LENGTH/2;
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Configuration Image
+
+int8_t DRV_CANFDSPI_ConfigurationCapture(CANFDSPI_MODULE_ID index, CAN_CONFIG_IMAGE* image)
+{
+    int8_t spiTransferError = 0;
+
+    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, cREGADDR_OSC, image->sfr, 4);
+    if (spiTransferError) {
+        return -1;
+    }
+    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, cREGADDR_CiCON, image->control, 8);
+    if (spiTransferError) {
+        return -2;
+    }
+    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, cREGADDR_CiTEFCON, image->fifo, 4 + 3 * CAN_CONFIG_IMAGE_FIFOS);
+    if (spiTransferError) {
+        return -3;
+    }
+    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, cREGADDR_CiFLTCON, image->filterControl, CAN_FILTER_TOTAL / 4);
+    if (spiTransferError) {
+        return -4;
+    }
+    spiTransferError = DRV_CANFDSPI_ReadWordArray(index, cREGADDR_CiFLTOBJ, image->filterObject, CAN_FILTER_TOTAL * 2);
+    if (spiTransferError) {
+        return -5;
+    }
+
+    return spiTransferError;
+}
+
+int8_t DRV_CANFDSPI_ConfigurationRestore(CANFDSPI_MODULE_ID index, const CAN_CONFIG_IMAGE* image)
+{
+    uint32_t control[8];
+    REG_CiCON ciCon;
+    uint8_t i;
+    int8_t spiTransferError = 0;
+
+    DRV_CANFDSPI_StagedInvalidate(index);
+
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_OSC, (uint32_t*) image->sfr, 4);
+    if (spiTransferError) {
+        return -1;
+    }
+
+    // Stay in configuration mode, start the time base from 0 and leave no interrupt flag behind
+    for (i = 0; i < 8; i++) {
+        control[i] = image->control[i];
+    }
+    ciCon.word = control[0];
+    ciCon.bF.RequestOpMode = CAN_CONFIGURATION_MODE;
+    control[0] = ciCon.word;
+    control[(cREGADDR_CiTBC - cREGADDR_CiCON) / 4] = 0;
+    control[(cREGADDR_CiINT - cREGADDR_CiCON) / 4] &= 0xFFFF0000;
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiCON, control, 8);
+    if (spiTransferError) {
+        return -2;
+    }
+
+    // Status words only hold flags, user addresses are read-only
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiTEFCON, (uint32_t*) image->fifo, 4 + 3 * CAN_CONFIG_IMAGE_FIFOS);
+    if (spiTransferError) {
+        return -3;
+    }
+
+    // Objects first, the filters are still disabled
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiFLTOBJ, (uint32_t*) image->filterObject, CAN_FILTER_TOTAL * 2);
+    if (spiTransferError) {
+        return -4;
+    }
+    spiTransferError = DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiFLTCON, (uint32_t*) image->filterControl, CAN_FILTER_TOTAL / 4);
+    if (spiTransferError) {
+        return -5;
     }
 
     return spiTransferError;
@@ -2830,702 +3426,65 @@ int8_t DRV_CANFDSPI_BitTimeConfigure(CANFDSPI_MODULE_ID index,
         CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode,
         CAN_SYSCLK_SPEED clk)
 {
-    int8_t spiTransferError = 0;
+    // Nominal and data bit rate [kbit/s] of each CAN_BITTIME_SETUP
+    static const uint16_t bitRates[][2] = {
+        {500, 1000}, {500, 2000}, {500, 3000}, {500, 4000},
+        {500, 5000}, {500, 6666}, {500, 8000}, {500, 10000},
+        {250, 500}, {250, 833}, {250, 1000}, {250, 1500},
+        {250, 2000}, {250, 3000}, {250, 4000},
+        {1000, 4000}, {1000, 8000},
+        {125, 500}
+    };
+    CAN_BITTIME_CONFIG config;
+    uint32_t sysclk;
 
     // Decode clk
     switch (clk) {
         case CAN_SYSCLK_40M:
-            spiTransferError = DRV_CANFDSPI_BitTimeConfigureNominal40MHz(index, bitTime);
-            if (spiTransferError) return spiTransferError;
-
-            spiTransferError = DRV_CANFDSPI_BitTimeConfigureData40MHz(index, bitTime, sspMode);
+            sysclk = 40000000;
             break;
         case CAN_SYSCLK_20M:
-            spiTransferError = DRV_CANFDSPI_BitTimeConfigureNominal20MHz(index, bitTime);
-            if (spiTransferError) return spiTransferError;
-
-            spiTransferError = DRV_CANFDSPI_BitTimeConfigureData20MHz(index, bitTime, sspMode);
+            sysclk = 20000000;
             break;
         case CAN_SYSCLK_10M:
-            spiTransferError = DRV_CANFDSPI_BitTimeConfigureNominal10MHz(index, bitTime);
-            if (spiTransferError) return spiTransferError;
-
-            spiTransferError = DRV_CANFDSPI_BitTimeConfigureData10MHz(index, bitTime, sspMode);
-            break;
-        default:
-            spiTransferError = -1;
-            break;
-    }
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_BitTimeConfigureNominal40MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime)
-{
-    int8_t spiTransferError = 0;
-    REG_CiNBTCFG ciNbtcfg;
-
-    ciNbtcfg.word = canControlResetValues[cREGADDR_CiNBTCFG / 4];
-
-    // Arbitration Bit rate
-    switch (bitTime) {
-            // All 500K
-        case CAN_500K_1M:
-        case CAN_500K_2M:
-        case CAN_500K_3M:
-        case CAN_500K_4M:
-        case CAN_500K_5M:
-        case CAN_500K_6M7:
-        case CAN_500K_8M:
-        case CAN_500K_10M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 62;
-            ciNbtcfg.bF.TSEG2 = 15;
-            ciNbtcfg.bF.SJW = 15;
-            break;
-
-            // All 250K
-        case CAN_250K_500K:
-        case CAN_250K_833K:
-        case CAN_250K_1M:
-        case CAN_250K_1M5:
-        case CAN_250K_2M:
-        case CAN_250K_3M:
-        case CAN_250K_4M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 126;
-            ciNbtcfg.bF.TSEG2 = 31;
-            ciNbtcfg.bF.SJW = 31;
-            break;
-
-        case CAN_1000K_4M:
-        case CAN_1000K_8M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 30;
-            ciNbtcfg.bF.TSEG2 = 7;
-            ciNbtcfg.bF.SJW = 7;
-            break;
-
-        case CAN_125K_500K:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 254;
-            ciNbtcfg.bF.TSEG2 = 63;
-            ciNbtcfg.bF.SJW = 63;
-            break;
-
-        default:
-            return -1;
-            //break;
-    }
-
-    // Write Bit time registers
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiNBTCFG, ciNbtcfg.word);
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_BitTimeConfigureData40MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode)
-{
-    int8_t spiTransferError = 0;
-    REG_CiDBTCFG ciDbtcfg;
-    REG_CiTDC ciTdc;
-    //    sspMode;
-
-    ciDbtcfg.word = canControlResetValues[cREGADDR_CiDBTCFG / 4];
-    ciTdc.word = 0;
-
-    // Configure Bit time and sample point
-    ciTdc.bF.TDCMode = CAN_SSP_MODE_AUTO;
-    uint32_t tdcValue = 0;
-
-    // Data Bit rate and SSP
-    switch (bitTime) {
-        case CAN_500K_1M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 30;
-            ciDbtcfg.bF.TSEG2 = 7;
-            ciDbtcfg.bF.SJW = 7;
-            // SSP
-            ciTdc.bF.TDCOffset = 31;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_2M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 14;
-            ciDbtcfg.bF.TSEG2 = 3;
-            ciDbtcfg.bF.SJW = 3;
-            // SSP
-            ciTdc.bF.TDCOffset = 15;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_3M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 8;
-            ciDbtcfg.bF.TSEG2 = 2;
-            ciDbtcfg.bF.SJW = 2;
-            // SSP
-            ciTdc.bF.TDCOffset = 9;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_4M:
-        case CAN_1000K_4M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 6;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 7;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_5M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 4;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 5;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_6M7:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 3;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 4;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_8M:
-        case CAN_1000K_8M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 2;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 3;
-            ciTdc.bF.TDCValue = 1;
-            break;
-        case CAN_500K_10M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 1;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 2;
-            ciTdc.bF.TDCValue = 0;
-            break;
-
-        case CAN_250K_500K:
-        case CAN_125K_500K:
-            ciDbtcfg.bF.BRP = 1;
-            ciDbtcfg.bF.TSEG1 = 30;
-            ciDbtcfg.bF.TSEG2 = 7;
-            ciDbtcfg.bF.SJW = 7;
-            // SSP
-            ciTdc.bF.TDCOffset = 31;
-            ciTdc.bF.TDCValue = tdcValue;
-            ciTdc.bF.TDCMode = CAN_SSP_MODE_OFF;
-            break;
-        case CAN_250K_833K:
-            ciDbtcfg.bF.BRP = 1;
-            ciDbtcfg.bF.TSEG1 = 17;
-            ciDbtcfg.bF.TSEG2 = 4;
-            ciDbtcfg.bF.SJW = 4;
-            // SSP
-            ciTdc.bF.TDCOffset = 18;
-            ciTdc.bF.TDCValue = tdcValue;
-            ciTdc.bF.TDCMode = CAN_SSP_MODE_OFF;
-            break;
-        case CAN_250K_1M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 30;
-            ciDbtcfg.bF.TSEG2 = 7;
-            ciDbtcfg.bF.SJW = 7;
-            // SSP
-            ciTdc.bF.TDCOffset = 31;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_1M5:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 18;
-            ciDbtcfg.bF.TSEG2 = 5;
-            ciDbtcfg.bF.SJW = 5;
-            // SSP
-            ciTdc.bF.TDCOffset = 19;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_2M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 14;
-            ciDbtcfg.bF.TSEG2 = 3;
-            ciDbtcfg.bF.SJW = 3;
-            // SSP
-            ciTdc.bF.TDCOffset = 15;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_3M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 8;
-            ciDbtcfg.bF.TSEG2 = 2;
-            ciDbtcfg.bF.SJW = 2;
-            // SSP
-            ciTdc.bF.TDCOffset = 9;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_4M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 6;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 7;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-
-        default:
-            return -1;
-            //break;
-    }
-
-    // Write Bit time registers
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiDBTCFG, ciDbtcfg.word);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    // Write Transmitter Delay Compensation
-    #ifdef REV_A
-    ciTdc.bF.TDCOffset = 0;
-    ciTdc.bF.TDCValue = 0;
-    #endif
-
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiTDC, ciTdc.word);
-    if (spiTransferError) {
-        return -3;
-    }
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_BitTimeConfigureNominal20MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime)
-{
-    int8_t spiTransferError = 0;
-    REG_CiNBTCFG ciNbtcfg;
-
-    ciNbtcfg.word = canControlResetValues[cREGADDR_CiNBTCFG / 4];
-
-    // Arbitration Bit rate
-    switch (bitTime) {
-            // All 500K
-        case CAN_500K_1M:
-        case CAN_500K_2M:
-        case CAN_500K_4M:
-        case CAN_500K_5M:
-        case CAN_500K_6M7:
-        case CAN_500K_8M:
-        case CAN_500K_10M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 30;
-            ciNbtcfg.bF.TSEG2 = 7;
-            ciNbtcfg.bF.SJW = 7;
-            break;
-
-            // All 250K
-        case CAN_250K_500K:
-        case CAN_250K_833K:
-        case CAN_250K_1M:
-        case CAN_250K_1M5:
-        case CAN_250K_2M:
-        case CAN_250K_3M:
-        case CAN_250K_4M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 62;
-            ciNbtcfg.bF.TSEG2 = 15;
-            ciNbtcfg.bF.SJW = 15;
-            break;
-
-        case CAN_1000K_4M:
-        case CAN_1000K_8M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 14;
-            ciNbtcfg.bF.TSEG2 = 3;
-            ciNbtcfg.bF.SJW = 3;
-            break;
-
-        case CAN_125K_500K:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 126;
-            ciNbtcfg.bF.TSEG2 = 31;
-            ciNbtcfg.bF.SJW = 31;
-            break;
-
-        default:
-            return -1;
-            //break;
-    }
-
-    // Write Bit time registers
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiNBTCFG, ciNbtcfg.word);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_BitTimeConfigureData20MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode)
-{
-    int8_t spiTransferError = 0;
-    REG_CiDBTCFG ciDbtcfg;
-    REG_CiTDC ciTdc;
-    //    sspMode;
-
-    ciDbtcfg.word = canControlResetValues[cREGADDR_CiDBTCFG / 4];
-    ciTdc.word = 0;
-
-    // Configure Bit time and sample point
-    ciTdc.bF.TDCMode = CAN_SSP_MODE_AUTO;
-    uint32_t tdcValue = 0;
-
-    // Data Bit rate and SSP
-    switch (bitTime) {
-        case CAN_500K_1M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 14;
-            ciDbtcfg.bF.TSEG2 = 3;
-            ciDbtcfg.bF.SJW = 3;
-            // SSP
-            ciTdc.bF.TDCOffset = 15;
-            ciTdc.bF.TDCValue = tdcValue;
+            sysclk = 10000000;
             break;
-        case CAN_500K_2M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 6;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 7;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_4M:
-        case CAN_1000K_4M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 2;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 3;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_5M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 1;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 2;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_6M7:
-        case CAN_500K_8M:
-        case CAN_500K_10M:
-        case CAN_1000K_8M:
-            //qDebug("Data Bitrate not feasible with this clock!");
-            return -1;
-            //break;
-
-        case CAN_250K_500K:
-        case CAN_125K_500K:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 30;
-            ciDbtcfg.bF.TSEG2 = 7;
-            ciDbtcfg.bF.SJW = 7;
-            // SSP
-            ciTdc.bF.TDCOffset = 31;
-            ciTdc.bF.TDCValue = tdcValue;
-            ciTdc.bF.TDCMode = CAN_SSP_MODE_OFF;
-            break;
-        case CAN_250K_833K:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 17;
-            ciDbtcfg.bF.TSEG2 = 4;
-            ciDbtcfg.bF.SJW = 4;
-            // SSP
-            ciTdc.bF.TDCOffset = 18;
-            ciTdc.bF.TDCValue = tdcValue;
-            ciTdc.bF.TDCMode = CAN_SSP_MODE_OFF;
-            break;
-        case CAN_250K_1M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 14;
-            ciDbtcfg.bF.TSEG2 = 3;
-            ciDbtcfg.bF.SJW = 3;
-            // SSP
-            ciTdc.bF.TDCOffset = 15;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_1M5:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 8;
-            ciDbtcfg.bF.TSEG2 = 2;
-            ciDbtcfg.bF.SJW = 2;
-            // SSP
-            ciTdc.bF.TDCOffset = 9;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_2M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 6;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 7;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_3M:
-            //qDebug("Data Bitrate not feasible with this clock!");
-            return -1;
-            //break;
-        case CAN_250K_4M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 2;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 3;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-
         default:
             return -1;
-            //break;
     }
 
-    // Write Bit time registers
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiDBTCFG, ciDbtcfg.word);
-    if (spiTransferError) {
-        return -2;
-    }
-
-    // Write Transmitter Delay Compensation
-    #ifdef REV_A
-    ciTdc.bF.TDCOffset = 0;
-    ciTdc.bF.TDCValue = 0;
-    #endif
-
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiTDC, ciTdc.word);
-    if (spiTransferError) {
-        return -3;
-    }
-
-    return spiTransferError;
-}
-
-int8_t DRV_CANFDSPI_BitTimeConfigureNominal10MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime)
-{
-    int8_t spiTransferError = 0;
-    REG_CiNBTCFG ciNbtcfg;
-
-    ciNbtcfg.word = canControlResetValues[cREGADDR_CiNBTCFG / 4];
-
-    // Arbitration Bit rate
-    switch (bitTime) {
-            // All 500K
-        case CAN_500K_1M:
-        case CAN_500K_2M:
-        case CAN_500K_4M:
-        case CAN_500K_5M:
-        case CAN_500K_6M7:
-        case CAN_500K_8M:
-        case CAN_500K_10M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 14;
-            ciNbtcfg.bF.TSEG2 = 3;
-            ciNbtcfg.bF.SJW = 3;
-            break;
-
-            // All 250K
-        case CAN_250K_500K:
-        case CAN_250K_833K:
-        case CAN_250K_1M:
-        case CAN_250K_1M5:
-        case CAN_250K_2M:
-        case CAN_250K_3M:
-        case CAN_250K_4M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 30;
-            ciNbtcfg.bF.TSEG2 = 7;
-            ciNbtcfg.bF.SJW = 7;
-            break;
-
-        case CAN_1000K_4M:
-        case CAN_1000K_8M:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 7;
-            ciNbtcfg.bF.TSEG2 = 2;
-            ciNbtcfg.bF.SJW = 2;
-            break;
-
-        case CAN_125K_500K:
-            ciNbtcfg.bF.BRP = 0;
-            ciNbtcfg.bF.TSEG1 = 62;
-            ciNbtcfg.bF.TSEG2 = 15;
-            ciNbtcfg.bF.SJW = 15;
-            break;
-
-        default:
-            return -1;
-            //break;
+    if (bitTime >= sizeof(bitRates) / sizeof(bitRates[0])) {
+        return -1;
     }
 
-    // Write Bit time registers
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiNBTCFG, ciNbtcfg.word);
-    if (spiTransferError) {
-        return -2;
+    // 80% sample point, maximum SJW
+    if (DRV_CANFDSPI_BitTimeCalculate(sysclk, bitRates[bitTime][0] * 1000UL, bitRates[bitTime][1] * 1000UL,
+            800, 0, sspMode, &config)) {
+        return -1;
     }
 
-    return spiTransferError;
+    return DRV_CANFDSPI_BitTimeWrite(index, &config);
 }
 
-int8_t DRV_CANFDSPI_BitTimeConfigureData10MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode)
+int8_t DRV_CANFDSPI_BitTimeWrite(CANFDSPI_MODULE_ID index, const CAN_BITTIME_CONFIG* config)
 {
-    int8_t spiTransferError = 0;
-    REG_CiDBTCFG ciDbtcfg;
+    uint32_t reg[3];
     REG_CiTDC ciTdc;
-    //    sspMode;
-
-    ciDbtcfg.word = canControlResetValues[cREGADDR_CiDBTCFG / 4];
-    ciTdc.word = 0;
-
-    // Configure Bit time and sample point
-    ciTdc.bF.TDCMode = CAN_SSP_MODE_AUTO;
-    uint32_t tdcValue = 0;
-
-    // Data Bit rate and SSP
-    switch (bitTime) {
-        case CAN_500K_1M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 6;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 7;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_2M:
-            // Data BR
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 2;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 3;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_500K_4M:
-        case CAN_500K_5M:
-        case CAN_500K_6M7:
-        case CAN_500K_8M:
-        case CAN_500K_10M:
-        case CAN_1000K_4M:
-        case CAN_1000K_8M:
-            //qDebug("Data Bitrate not feasible with this clock!");
-            return -1;
-            //break;
-
-        case CAN_250K_500K:
-        case CAN_125K_500K:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 14;
-            ciDbtcfg.bF.TSEG2 = 3;
-            ciDbtcfg.bF.SJW = 3;
-            // SSP
-            ciTdc.bF.TDCOffset = 15;
-            ciTdc.bF.TDCValue = tdcValue;
-            ciTdc.bF.TDCMode = CAN_SSP_MODE_OFF;
-            break;
-        case CAN_250K_833K:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 7;
-            ciDbtcfg.bF.TSEG2 = 2;
-            ciDbtcfg.bF.SJW = 2;
-            // SSP
-            ciTdc.bF.TDCOffset = 8;
-            ciTdc.bF.TDCValue = tdcValue;
-            ciTdc.bF.TDCMode = CAN_SSP_MODE_OFF;
-            break;
-        case CAN_250K_1M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 6;
-            ciDbtcfg.bF.TSEG2 = 1;
-            ciDbtcfg.bF.SJW = 1;
-            // SSP
-            ciTdc.bF.TDCOffset = 7;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_1M5:
-            //qDebug("Data Bitrate not feasible with this clock!");
-            return -1;
-            //break;
-        case CAN_250K_2M:
-            ciDbtcfg.bF.BRP = 0;
-            ciDbtcfg.bF.TSEG1 = 2;
-            ciDbtcfg.bF.TSEG2 = 0;
-            ciDbtcfg.bF.SJW = 0;
-            // SSP
-            ciTdc.bF.TDCOffset = 3;
-            ciTdc.bF.TDCValue = tdcValue;
-            break;
-        case CAN_250K_3M:
-        case CAN_250K_4M:
-            //qDebug("Data Bitrate not feasible with this clock!");
-            return -1;
-            //break;
-
-        default:
-            return -1;
-            //break;
-    }
 
-    // Write Bit time registers
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiDBTCFG, ciDbtcfg.word);
-    if (spiTransferError) {
-        return -2;
-    }
+    // CiNBTCFG, CiDBTCFG and CiTDC are consecutive: one access
+    reg[0] = config->nbtcfg;
+    reg[1] = config->dbtcfg;
+    ciTdc.word = config->tdc;
 
-    // Write Transmitter Delay Compensation
     #ifdef REV_A
     ciTdc.bF.TDCOffset = 0;
     ciTdc.bF.TDCValue = 0;
     #endif
+    reg[2] = ciTdc.word;
 
-    spiTransferError = DRV_CANFDSPI_WriteWord(index, cREGADDR_CiTDC, ciTdc.word);
-    if (spiTransferError) {
-        return -3;
-    }
-
-    return spiTransferError;
+    return DRV_CANFDSPI_WriteWordArray(index, cREGADDR_CiNBTCFG, reg, 3);
 }
 
-
 // *****************************************************************************
 // *****************************************************************************
 // Section: GPIO
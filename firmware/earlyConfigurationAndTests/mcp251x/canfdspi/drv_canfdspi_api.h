@@ -55,6 +55,7 @@
 #include <stdlib.h>
 #include "drv_canfdspi_defines.h"
 #include "drv_canfdspi_register.h"
+#include "../spi/drv_spi.h"
 
 // DOM-IGNORE-BEGIN
 /*
@@ -162,6 +163,64 @@ int8_t DRV_CANFDSPI_ReadWordArray(CANFDSPI_MODULE_ID index, uint16_t address,
 int8_t DRV_CANFDSPI_WriteWordArray(CANFDSPI_MODULE_ID index, uint16_t address,
         uint32_t *txd, uint16_t nWords);
 
+// *****************************************************************************
+//! SPI Read Byte Array, non-blocking
+//! Queues the read and returns its handle; rxd is filled by the eUSCI_A0 ISR and
+//! callback (may be NULL) is called once the transfer is done.
+
+DRV_SPI_TRANSACTION_HANDLE DRV_CANFDSPI_ReadByteArrayAsync(CANFDSPI_MODULE_ID index,
+        uint16_t address, uint8_t *rxd, uint16_t nBytes,
+        DRV_SPI_TRANSACTION_CALLBACK callback, void *context);
+
+// *****************************************************************************
+//! SPI Write Byte Array, non-blocking
+//! txd is sent straight from the caller's buffer, it must stay valid until the transaction completes.
+
+DRV_SPI_TRANSACTION_HANDLE DRV_CANFDSPI_WriteByteArrayAsync(CANFDSPI_MODULE_ID index,
+        uint16_t address, uint8_t *txd, uint16_t nBytes,
+        DRV_SPI_TRANSACTION_CALLBACK callback, void *context);
+
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: FIFO shadow
+
+//! Drop the FIFO shadows of a controller
+//! The driver does this itself on reset, mode change, (re)configuration and FIFO reset;
+//! call it after anything else that moves a FIFO behind the driver's back (e.g. an ECC/SPI error)
+
+void DRV_CANFDSPI_FifoShadowInvalidate(CANFDSPI_MODULE_ID index);
+
+// *****************************************************************************
+// *****************************************************************************
+// Section: Staged register transactions
+
+//! Begin a staged transaction
+//! Field updates are collected until the matching Commit; transactions nest, only the outermost
+//! Commit talks to the device. Setters using the layer join an open transaction.
+
+void DRV_CANFDSPI_StagedBegin(CANFDSPI_MODULE_ID index);
+
+// *****************************************************************************
+//! Stage a field update: the bits in mask take value, both relative to address (any byte of a
+//! register, must not cross into the next one)
+//! The register is only read when the update covers part of a byte whose value isn't known.
+//! Returns -1 on read error, -2 when the transaction is full (commit and stage the rest in a new one).
+
+int8_t DRV_CANFDSPI_StagedFieldSet(CANFDSPI_MODULE_ID index, uint16_t address, uint32_t mask, uint32_t value);
+
+// *****************************************************************************
+//! Commit a staged transaction
+//! Changed bytes are written in ascending address order, adjacent ones in one access; bytes that
+//! don't change are not written. Don't stage a filter enable together with its filter object: the
+//! object would be written after the enable and be ignored.
+
+int8_t DRV_CANFDSPI_StagedCommit(CANFDSPI_MODULE_ID index);
+
+// *****************************************************************************
+//! Forget the known register values (the driver does this itself on reset and configuration restore)
+
+void DRV_CANFDSPI_StagedInvalidate(CANFDSPI_MODULE_ID index);
 
 // *****************************************************************************
 // *****************************************************************************
@@ -183,6 +242,9 @@ int8_t DRV_CANFDSPI_ConfigureObjectReset(CAN_CONFIG* config);
 
 // *****************************************************************************
 //! Select Operation Mode
+//! Returns once REQOP is written; OPMOD follows when the controller gets there (out of Configuration mode: after
+//! 11 recessive bits on the bus). Poll DRV_CANFDSPI_OperationModeGet to wait for it. FIFO user addresses are
+//! not cached before OPMOD has left Configuration mode
 
 int8_t DRV_CANFDSPI_OperationModeSelect(CANFDSPI_MODULE_ID index,
         CAN_OPERATION_MODE opMode);
@@ -232,12 +294,37 @@ int8_t DRV_CANFDSPI_TransmitQueueConfigureObjectReset(CAN_TX_QUEUE_CONFIG* confi
 // *****************************************************************************
 //! TX Channel Load
 //!Loads data into Transmit channel Requests transmission, if flush==true
+//! Returns -6 without touching the FIFO when it is full
 
 
 int8_t DRV_CANFDSPI_TransmitChannelLoad(CANFDSPI_MODULE_ID index,
         CAN_FIFO_CHANNEL channel, CAN_TX_MSGOBJ* txObj,
         uint8_t *txd, uint32_t txdNumBytes, bool flush);
 
+// *****************************************************************************
+//! In-place TX object
+//! Returns the message object inside the driver's SPI buffer, *txd points right behind its header.
+//! Build header and data there, then send it with DRV_CANFDSPI_TransmitObjectLoad; no other driver
+//! call in between, they may use the same buffer. NULL when index is not below DRV_CANFDSPI_INDEX_COUNT.
+
+CAN_TX_MSGOBJ* DRV_CANFDSPI_TransmitObjectGet(CANFDSPI_MODULE_ID index, uint8_t **txd);
+
+// *****************************************************************************
+//! TX Channel Load of the in-place object, see DRV_CANFDSPI_TransmitChannelLoad
+
+int8_t DRV_CANFDSPI_TransmitObjectLoad(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, uint8_t txdNumBytes, bool flush);
+
+// *****************************************************************************
+//! TX Channel Load, batched
+//! Loads up to nMessages objects (txd[i] holds the DLC worth of data of txObj[i]) into the free objects of
+//! the channel, in as few RAM writes as the FIFO layout allows, then UINCs each; TXREQ is set once, if flush==true
+//! *nLoaded tells how many went in; the rest did not fit. Returns -6 when the FIFO is full.
+
+int8_t DRV_CANFDSPI_TransmitChannelLoadBatch(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, CAN_TX_MSGOBJ* txObj,
+        uint8_t **txd, uint8_t nMessages, uint8_t *nLoaded, bool flush);
+
 // *****************************************************************************
 //! TX Queue Load
 
@@ -382,6 +469,15 @@ int8_t DRV_CANFDSPI_FilterEnable(CANFDSPI_MODULE_ID index, CAN_FILTER filter);
 
 int8_t DRV_CANFDSPI_FilterDisable(CANFDSPI_MODULE_ID index, CAN_FILTER filter);
 
+// *****************************************************************************
+//! Filter Table Write
+//! Programs all filters from register images (can_filter_compiler.py): disables every filter, writes
+//! nFilters CiFLTOBJ/CiMASK pairs and then the CiFLTCON words, three accesses in all.
+//! control holds CAN_FILTER_TOTAL / 4 words, objects 2 * nFilters.
+
+int8_t DRV_CANFDSPI_FilterTableWrite(CANFDSPI_MODULE_ID index, const uint32_t* control,
+        const uint32_t* objects, uint8_t nFilters);
+
 // *****************************************************************************
 //! Set Device Net Filter Count
 int8_t DRV_CANFDSPI_DeviceNetFilterCountSet(CANFDSPI_MODULE_ID index,
@@ -407,11 +503,32 @@ int8_t DRV_CANFDSPI_ReceiveChannelStatusGet(CANFDSPI_MODULE_ID index,
 // *****************************************************************************
 //! Get Received Message
 //! Reads Received message from channel
+//! Call only when the channel is not empty, the shadowed user address follows every UINC
 
 int8_t DRV_CANFDSPI_ReceiveMessageGet(CANFDSPI_MODULE_ID index,
         CAN_FIFO_CHANNEL channel, CAN_RX_MSGOBJ* rxObj,
         uint8_t *rxd, uint8_t nBytes);
 
+// *****************************************************************************
+//! Get Received Message, in place
+//! Same as DRV_CANFDSPI_ReceiveMessageGet, but the message is left in the driver's SPI buffer:
+//! *rxObj and *rxd point into it and stay valid until the next driver call.
+//! rxObj->bF.timeStamp is 0 unless the FIFO stores time stamps.
+
+int8_t DRV_CANFDSPI_ReceiveObjectGet(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, CAN_RX_MSGOBJ** rxObj,
+        uint8_t **rxd, uint8_t nBytes);
+
+// *****************************************************************************
+//! Drain Received Messages
+//! Reads the fill level once, then up to nMessages objects in as few RAM reads as the FIFO layout allows,
+//! and UINCs each. Message i lands in rxObj[i] and rxd[i * nBytes], only its DLC worth of data is read.
+//! *nReceived tells how many were read, 0 when the channel was empty.
+
+int8_t DRV_CANFDSPI_ReceiveMessageDrain(CANFDSPI_MODULE_ID index,
+        CAN_FIFO_CHANNEL channel, CAN_RX_MSGOBJ* rxObj, uint8_t *rxd,
+        uint8_t nBytes, uint8_t nMessages, uint8_t *nReceived);
+
 // *****************************************************************************
 //! Receive FIFO Reset
 
@@ -804,9 +921,24 @@ int8_t DRV_CANFDSPI_EccEventClear(CANFDSPI_MODULE_ID index,
 
 // *****************************************************************************
 //! Initialize RAM
+//! Fills the whole message RAM with d in one streamed write, no staging buffer
 
 int8_t DRV_CANFDSPI_RamInit(CANFDSPI_MODULE_ID index, uint8_t d);
 
+// *****************************************************************************
+//! Configuration Image Capture
+//! Reads the configuration registers into image, five reads. Capture in configuration mode,
+//! once the setters are done.
+
+int8_t DRV_CANFDSPI_ConfigurationCapture(CANFDSPI_MODULE_ID index, CAN_CONFIG_IMAGE* image);
+
+// *****************************************************************************
+//! Configuration Image Restore
+//! Writes a captured image back in five bursts, right after DRV_CANFDSPI_Reset: filter objects
+//! are only taken while their filter is disabled. The device stays in configuration mode.
+
+int8_t DRV_CANFDSPI_ConfigurationRestore(CANFDSPI_MODULE_ID index, const CAN_CONFIG_IMAGE* image);
+
 
 // *****************************************************************************
 // *****************************************************************************
@@ -903,48 +1035,122 @@ int8_t DRV_CANFDSPI_OscillatorStatusGet(CANFDSPI_MODULE_ID index,
         CAN_OSC_STATUS* status);
 
 // *****************************************************************************
-//! Configure Bit Time registers (based on CAN clock speed)
-
-int8_t DRV_CANFDSPI_BitTimeConfigure(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode,
-        CAN_SYSCLK_SPEED clk);
-
-// *****************************************************************************
-//! Configure Nominal bit time for 40MHz system clock
+//! Largest bit rate error DRV_CANFDSPI_BitTimeCalculate accepts [1/1000 of the requested rate]
 
-int8_t DRV_CANFDSPI_BitTimeConfigureNominal40MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime);
+#define DRV_CANFDSPI_BIT_RATE_TOLERANCE 5
 
 // *****************************************************************************
-//! Configure Data bit time for 40MHz system clock
+//! Bit time segments of one phase (helper of DRV_CANFDSPI_BitTimeCalculate)
+//! Smallest BRP whose segments fit and whose bit rate is within DRV_CANFDSPI_BIT_RATE_TOLERANCE of the
+//! request (time quanta per bit rounded to nearest), sample point at or before samplePoint [1/1000].
+//! Results are in time quanta, not register values. Returns -1 when no BRP reaches the rate.
 
-int8_t DRV_CANFDSPI_BitTimeConfigureData40MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode);
-
-// *****************************************************************************
-//! Configure Nominal bit time for 20MHz system clock
-
-int8_t DRV_CANFDSPI_BitTimeConfigureNominal20MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime);
+static inline int8_t DRV_CANFDSPI_BitTimeSegments(uint32_t sysclk, uint32_t bitRate, uint16_t samplePoint,
+        uint16_t tseg1Max, uint8_t tseg2Max, uint8_t* brp, uint16_t* tseg1, uint8_t* tseg2)
+{
+    uint16_t b;
+    uint32_t ntq, sample, reached, error;
+
+    if (bitRate == 0) {
+        return -1;
+    }
+    for (b = 0; b < 256; b++) {
+        ntq = (sysclk + (b + 1) * bitRate / 2) / ((b + 1) * bitRate);
+        // At least sync, one quantum each side of the sample point, and one to move it
+        if (ntq < 4) {
+            return -1;
+        }
+        // SYSCLK cycles per bit against the requested rate, a larger BRP may divide better
+        reached = (b + 1) * ntq * bitRate;
+        error = (reached > sysclk) ? reached - sysclk : sysclk - reached;
+        if (error > sysclk / 1000 * DRV_CANFDSPI_BIT_RATE_TOLERANCE) {
+            continue;
+        }
+        // Sync + TSEG1 up to the sample point, at least one quantum of TSEG2
+        sample = (ntq * samplePoint) / 1000;
+        if (sample >= ntq) {
+            sample = ntq - 1;
+        }
+        if (sample < 2) {
+            sample = 2;
+        }
+        if (sample - 1 <= tseg1Max && ntq - sample <= tseg2Max) {
+            *brp = (uint8_t) b;
+            *tseg1 = (uint16_t) (sample - 1);
+            *tseg2 = (uint8_t) (ntq - sample);
+            return 0;
+        }
+    }
+    return -1;
+}
 
 // *****************************************************************************
-//! Configure Data bit time for 20MHz system clock
+//! Calculate Bit Time registers
+//! Nominal and data phase from SYSCLK and bit rates [Hz]; samplePoint in 1/1000 of the bit (e.g. 800),
+//! sjw in time quanta (0: as large as TSEG2). Transmitter delay compensation uses sspMode from a
+//! 1 Mbit/s data rate on, with the secondary sample point on the data sample point; it is off below.
+//! Returns -1 when a bit rate can't be reached from sysclk within DRV_CANFDSPI_BIT_RATE_TOLERANCE.
+//! Inline: with constant arguments it folds to constants, at run time it handles any rate.
 
-int8_t DRV_CANFDSPI_BitTimeConfigureData20MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode);
+static inline int8_t DRV_CANFDSPI_BitTimeCalculate(uint32_t sysclk, uint32_t nominalBitRate,
+        uint32_t dataBitRate, uint16_t samplePoint, uint8_t sjw, CAN_SSP_MODE sspMode,
+        CAN_BITTIME_CONFIG* config)
+{
+    uint8_t brp, tseg2;
+    uint16_t tseg1, tdcOffset;
+    REG_CiNBTCFG ciNbtcfg;
+    REG_CiDBTCFG ciDbtcfg;
+    REG_CiTDC ciTdc;
+
+    // Nominal: TSEG1 up to 256, TSEG2 and SJW up to 128 time quanta
+    if (DRV_CANFDSPI_BitTimeSegments(sysclk, nominalBitRate, samplePoint, 256, 128, &brp, &tseg1, &tseg2)) {
+        return -1;
+    }
+    ciNbtcfg.word = 0;
+    ciNbtcfg.bF.BRP = brp;
+    ciNbtcfg.bF.TSEG1 = tseg1 - 1;
+    ciNbtcfg.bF.TSEG2 = tseg2 - 1;
+    ciNbtcfg.bF.SJW = ((sjw == 0 || sjw > tseg2) ? tseg2 : sjw) - 1;
+
+    // Data: TSEG1 up to 32, TSEG2 and SJW up to 16 time quanta
+    if (DRV_CANFDSPI_BitTimeSegments(sysclk, dataBitRate, samplePoint, 32, 16, &brp, &tseg1, &tseg2)) {
+        return -1;
+    }
+    ciDbtcfg.word = 0;
+    ciDbtcfg.bF.BRP = brp;
+    ciDbtcfg.bF.TSEG1 = tseg1 - 1;
+    ciDbtcfg.bF.TSEG2 = tseg2 - 1;
+    ciDbtcfg.bF.SJW = ((sjw == 0 || sjw > tseg2) ? tseg2 : sjw) - 1;
+
+    // TDC: offset in SYSCLK periods, TDCValue is measured in auto mode
+    tdcOffset = (brp + 1) * tseg1;
+    ciTdc.word = 0;
+    ciTdc.bF.TDCMode = (dataBitRate >= 1000000) ? sspMode : CAN_SSP_MODE_OFF;
+    ciTdc.bF.TDCOffset = (tdcOffset > 63) ? 63 : tdcOffset;
+
+    config->nbtcfg = ciNbtcfg.word;
+    config->dbtcfg = ciDbtcfg.word;
+    config->tdc = ciTdc.word;
+
+    return 0;
+}
 
 // *****************************************************************************
-//! Configure Nominal bit time for 10MHz system clock
+//! Write Bit Time registers calculated by DRV_CANFDSPI_BitTimeCalculate (configuration mode only)
 
-int8_t DRV_CANFDSPI_BitTimeConfigureNominal10MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime);
+int8_t DRV_CANFDSPI_BitTimeWrite(CANFDSPI_MODULE_ID index, const CAN_BITTIME_CONFIG* config);
 
 // *****************************************************************************
-//! Configure Data bit time for 10MHz system clock
-
-int8_t DRV_CANFDSPI_BitTimeConfigureData10MHz(CANFDSPI_MODULE_ID index,
-        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode);
+//! Configure Bit Time registers (based on CAN clock speed)
+//! Calculated for an 80% sample point and maximum SJW; -1 when the setup can't be reached at clk within
+//! DRV_CANFDSPI_BIT_RATE_TOLERANCE. Dropped on purpose, the per-clock tables ran them 2.6% fast (13 or 26
+//! time quanta per bit), which nodes at the named rate don't decode: CAN_500K_3M, CAN_250K_1M5 and
+//! CAN_250K_3M at 40 MHz, CAN_250K_1M5 at 20 MHz. canSimulator/bittime.c checks every setup against the
+//! registers the tables wrote and lists where they differ
 
+int8_t DRV_CANFDSPI_BitTimeConfigure(CANFDSPI_MODULE_ID index,
+        CAN_BITTIME_SETUP bitTime, CAN_SSP_MODE sspMode,
+        CAN_SYSCLK_SPEED clk);
 
 // *****************************************************************************
 // *****************************************************************************
@@ -75,6 +75,18 @@ extern "C" {
 // Maximum number of data bytes in message
 #define MAX_DATA_BYTES 64
 
+// FIFO1 up to this channel keep a shadow of their configuration and user address
+// (8 bytes of RAM per FIFO and controller); the TXQ is never shadowed
+#ifndef DRV_CANFDSPI_SHADOW_CHANNELS
+#define DRV_CANFDSPI_SHADOW_CHANNELS 2
+#endif
+
+// Registers a staged transaction can hold (8 bytes of RAM each per controller); filter and ECC
+// registers stay in it as known values between transactions
+#ifndef DRV_CANFDSPI_STAGE_LENGTH
+#define DRV_CANFDSPI_STAGE_LENGTH 4
+#endif
+
 // *****************************************************************************
 // *****************************************************************************
 // Section: Object definitions
@@ -527,6 +539,30 @@ typedef enum {
     CAN_125K_500K // 0x11
 } CAN_BITTIME_SETUP;
 
+//! CAN Bit Time register values: CiNBTCFG, CiDBTCFG, CiTDC
+
+typedef struct _CAN_BITTIME_CONFIG {
+    uint32_t nbtcfg;
+    uint32_t dbtcfg;
+    uint32_t tdc;
+} CAN_BITTIME_CONFIG;
+
+//! CAN Configuration image: the configuration registers in address order, one block per burst
+//! TXQ and FIFOs up to CAN_CONFIG_IMAGE_FIFOS - 1 are kept, with the status and user address words
+//! that sit between their control registers.
+
+#ifndef CAN_CONFIG_IMAGE_FIFOS
+#define CAN_CONFIG_IMAGE_FIFOS 3
+#endif
+
+typedef struct _CAN_CONFIG_IMAGE {
+    uint32_t sfr[4];                                // OSC, IOCON, CRC, ECCCON
+    uint32_t control[8];                            // CiCON .. CiINT
+    uint32_t fifo[4 + 3 * CAN_CONFIG_IMAGE_FIFOS];  // CiTEFCON .. CiFIFOUA
+    uint32_t filterControl[CAN_FILTER_TOTAL / 4];   // CiFLTCON
+    uint32_t filterObject[CAN_FILTER_TOTAL * 2];    // CiFLTOBJ, CiMASK
+} CAN_CONFIG_IMAGE;
+
 //! CAN Nominal Bit Time Setup
 
 typedef enum {
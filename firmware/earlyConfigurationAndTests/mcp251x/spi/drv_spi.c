@@ -13,29 +13,180 @@
 #define SPI_DLYBS 0x00
 /* Delay between consecutive transfers. */
 #define SPI_DLYBCT 0x00
-/* Clock Speed */
-#define SPI_BAUDRATE 12500000
+/* Clock Speed (MCP2517FD: SCK <= 0.85 * SYSCLK / 2, SYSCLK = 20Mhz) */
+#define SPI_BAUDRATE 8500000
+/* Byte clocked out while reading (MCP2517FD ignores SDI after the address) */
+#define SPI_DUMMY_BYTE 0x00
+/* DMA trigger sources (DMAxTSEL), see FR573x datasheet DMA trigger assignments */
+#define SPI_DMA_TRIGGER_UCA0RXIFG 14
+#define SPI_DMA_TRIGGER_UCA0TXIFG 15
+// With SPI_USE_DMA, shorter segments are polled: arming both channels costs more than it saves
+#define SPI_DMA_MIN_SIZE 8
 
-inline int8_t spi_master_transfer(uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize);
+// SMCLK divider for SPI_BAUDRATE, see DRV_SPI_ClockConfigure
+static uint16_t spiClockDivider = 1;
+
+// UCA0CTLW0 bits that may differ between controllers
+#define SPI_MODE_MASK (UCCKPH|UCCKPL|UCMSB)
+
+// Per-controller chip select, clock and mode
+// Index 0 keeps the P2.2 chip select and mode bits initializeSPI has always used
+static DRV_SPI_DEVICE spiDevices[DRV_CANFDSPI_INDEX_COUNT] = {
+    {&P2OUT, &P2DIR, BIT2, 0, 0},
+#if DRV_CANFDSPI_INDEX_COUNT > 1
+    // PJ.1 is an extra GPIO on the schematic
+    {&PJOUT_L, &PJDIR_L, BIT1, 0, 0},
+#endif
+};
+
+// DMA transfer state
+static volatile uint8_t spiDmaBusy = 0;
+static uint8_t spiDmaDeviceIndex = 0;
+static DRV_SPI_TRANSFER_CALLBACK spiDmaCallback = NULL;
+static volatile uint8_t spiDmaSegment = 0;     // the transfer in flight is part of a blocking one, see spi_dma_segment
+static uint8_t spiDmaSink;
+#ifdef SPI_USE_DMA
+static const uint8_t spiDmaDummy = SPI_DUMMY_BYTE;
+#endif
+
+// Transaction queue state: head is advanced on submit, tail by the ISR when a transaction completes
+// Both count transactions (15 bit wrap) so a handle stays comparable after its slot is reused
+#define SPI_QUEUE_SEQUENCE_MASK 0x7FFF
+static DRV_SPI_TRANSACTION spiQueue[DRV_SPI_TRANSACTION_QUEUE_LENGTH];
+static volatile uint16_t spiQueueHead = 0;
+static volatile uint16_t spiQueueTail = 0;
+static volatile uint16_t spiQueuePosition = 0;
+static volatile uint8_t spiBlockingActive = 0;
+
+// UCA0 register images, one per mode, see DRV_SPI_BusCapture
+#define SPI_BUS_PINS (BIT0|BIT1)
+typedef struct {
+    uint16_t ctlw0;
+    uint16_t brw;
+    uint16_t mctlw;
+    uint16_t statw;
+    uint8_t sel0;
+    uint8_t sel1;
+    uint8_t valid;
+} SPI_BUS_IMAGE;
+static SPI_BUS_IMAGE spiBusImages[DRV_SPI_BUS_NONE];
+static volatile DRV_SPI_BUS_MODE spiBusMode = DRV_SPI_BUS_NONE;
+
+// UART telemetry ring, head is advanced by DRV_SPI_UartWrite, tail by the ISR
+#define SPI_UART_BUFFER_MASK (DRV_SPI_UART_BUFFER_LENGTH - 1)
+static uint8_t spiUartBuffer[DRV_SPI_UART_BUFFER_LENGTH];
+static volatile uint8_t spiUartHead = 0;
+static volatile uint8_t spiUartTail = 0;
+
+// Streamed transfer state, see DRV_SPI_TransferWriteBegin / DRV_SPI_TransferReadBegin
+static uint8_t spiStreamDeviceIndex = 0;
+
+#ifdef SPI_TRACE
+static DRV_SPI_TRACE_RECORD spiTrace[DRV_SPI_TRACE_LENGTH];
+static uint16_t spiTraceCount = 0;
+static uint16_t spiStreamTraceStart;
+static uint16_t spiStreamHeader;
+static uint16_t spiStreamSize;
+#endif
+
+static void spi_queue_start(void);
+static void spi_queue_wait_idle(uint8_t hold);
+static void spi_blocking_begin(void);
+static void spi_blocking_end(void);
+#ifdef SPI_TRACE
+static void spi_trace_record(const uint8_t *header, uint16_t headerSize, uint16_t size, uint16_t start);
+#endif
+
+inline int8_t spi_master_transfer(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize);
+static void spi_master_write(const uint8_t *SpiTxData, uint16_t spiTransferSize);
+static void spi_master_write_end(void);
+static void spi_master_read(uint8_t *SpiRxData, uint16_t spiTransferSize);
+static void spi_stream_begin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize);
+static void spi_stream_end(void);
+static void spi_dma_start(const uint8_t *SpiTxData, uint8_t txIncrement, uint8_t *SpiRxData, uint16_t spiTransferSize);
+#ifdef SPI_USE_DMA
+static void spi_dma_segment(const uint8_t *SpiTxData, uint8_t txIncrement, uint8_t *SpiRxData, uint16_t spiTransferSize);
+#endif
+
+// Load a mode's register image into UCA0
+// A UART byte still in the shift register is allowed to finish first; leaving reset clears UCA0IE
+static void spi_bus_switch(DRV_SPI_BUS_MODE mode)
+{
+    SPI_BUS_IMAGE* image = &spiBusImages[mode];
+
+    if (spiBusMode == mode || !image->valid)
+        return;
+    UCA0IE &= ~UCTXIE;
+    while (UCA0STATW & UCBUSY);
+    UCA0CTLW0 |= UCSWRST;
+    UCA0CTLW0 = image->ctlw0 | UCSWRST;
+    UCA0BRW = image->brw;
+    UCA0MCTLW = image->mctlw;
+    UCA0STATW = image->statw;
+    P2SEL0 = (P2SEL0 & ~SPI_BUS_PINS) | image->sel0;
+    P2SEL1 = (P2SEL1 & ~SPI_BUS_PINS) | image->sel1;
+    UCA0CTLW0 &= ~UCSWRST;
+    spiBusMode = mode;
+}
+
+// Hand UCA0 to the UART if bytes are waiting and SPI has nothing to do
+// Call with interrupts disabled or from an ISR
+static void spi_bus_idle(void)
+{
+    if (spiUartHead == spiUartTail || !spiBusImages[DRV_SPI_BUS_UART].valid)
+        return;
+    if (spiBlockingActive || spiDmaBusy || DRV_SPI_TransactionQueueCount())
+        return;
+    spi_bus_switch(DRV_SPI_BUS_UART);
+    UCA0IE |= UCTXIE;
+}
+
+// Bring UCA0 to the controller's clock and mode (only touching UCSWRST when they differ), then assert its CS
+// Leaving reset clears UCA0IE and sets UCTXIFG, so select before arming interrupts or DMA
+static void spi_device_select(uint8_t spiSlaveDeviceIndex)
+{
+    DRV_SPI_DEVICE* device = &spiDevices[spiSlaveDeviceIndex];
+    uint16_t divider = device->clockDivider ? device->clockDivider : spiClockDivider;
+
+    spi_bus_switch(DRV_SPI_BUS_SPI);
+    if (UCA0BRW != divider || (UCA0CTLW0 & SPI_MODE_MASK) != device->mode)
+    {
+        UCA0CTLW0 |= UCSWRST;
+        UCA0CTLW0 = (UCA0CTLW0 & ~SPI_MODE_MASK) | device->mode;
+        UCA0BRW = divider;
+        UCA0CTLW0 &= ~UCSWRST;
+    }
+    *device->csOut &= ~device->csPin;
+}
+
+static void spi_device_deselect(uint8_t spiSlaveDeviceIndex)
+{
+    *spiDevices[spiSlaveDeviceIndex].csOut |= spiDevices[spiSlaveDeviceIndex].csPin;
+}
 
 void initializeSPI()
 {
-    UCA0CTL1 |= UCSWRST;
+    // Start from the reset value, UCA0 may have been set up as a UART first
+    UCA0CTLW0 = UCSWRST;
     // Configure ports to SPI functionality
     P2SEL1 |= (BIT0|BIT1);
     P2SEL0 &= ~(BIT0|BIT1);
-    P2DIR |= (BIT2);
+    for (uint8_t i = 0; i < DRV_CANFDSPI_INDEX_COUNT; i++)
+        *spiDevices[i].csDir |= spiDevices[i].csPin;
     P1SEL1 |= (BIT5);
     P1SEL0 &= ~(BIT5);
     // Keep all the default values except the fields below...
     // (UCMode 3:3-pin SPI [CS on non STE GPIO]) (Master Mode) (UCSSEL 1:ACLK, 2,3:SMCLK)
-    UCA0CTLW0 |= (UCMODE_0|UCMST|UCSSEL__SMCLK|UCSYNC); // looks fine but ensure aclk is proper frequency
-    // Clock divider = 1 (SMCLK @ ~1Mhz /  = ~1Mhz)
-    UCA0BRW = 1;
+    UCA0CTLW0 |= (UCMODE_0|UCMST|UCSSEL__SMCLK|UCSYNC|spiDevices[0].mode); // looks fine but ensure aclk is proper frequency
+    // Clock divider from the active clock profile (SMCLK @ 1Mhz / 1 = 1Mhz at power-on)
+    UCA0BRW = spiClockDivider;
+    UCA0STATW = 0;
     // Exit reset mode
     UCA0CTL1 &= ~UCSWRST;
+    DRV_SPI_BusCapture(DRV_SPI_BUS_SPI);
     // Ensure all slave STE's are high
-    P2OUT |= (BIT2);
+    for (uint8_t i = 0; i < DRV_CANFDSPI_INDEX_COUNT; i++)
+        spi_device_deselect(i);
 }
 
 void transmitMasterSPI(unsigned int txData)
@@ -55,26 +206,688 @@ void receiveMasterSPI(uint8_t *rxData, unsigned int position)
 void DRV_SPI_Initialize(void)
 {
     initializeSPI();
+#ifdef SPI_TRACE
+    DRV_SPI_TraceReset();
+#endif
 }
 
+int8_t DRV_SPI_DeviceConfigure(uint8_t spiSlaveDeviceIndex, const DRV_SPI_DEVICE* device)
+{
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    spiDevices[spiSlaveDeviceIndex] = *device;
+    spiDevices[spiSlaveDeviceIndex].mode &= SPI_MODE_MASK;
+    return 0;
+}
+
+void DRV_SPI_ClockConfigure(uint32_t smclkHz)
+{
+    // Round up so SCK never exceeds SPI_BAUDRATE
+    spiClockDivider = (uint16_t) ((smclkHz + SPI_BAUDRATE - 1) / SPI_BAUDRATE);
+    if (spiClockDivider == 0)
+        spiClockDivider = 1;
+}
+
+uint16_t DRV_SPI_ClockDivider(void) {return spiClockDivider;}
+
 int8_t DRV_SPI_TransferData(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize)
 {
     // specify slave device on SPI bus, if multiple MCP25xx on CAN node
-    // we have 1 device per node hence the ignoring of spiSlaveDeviceIndex parameter
-	return spi_master_transfer(SpiTxData, SpiRxData, spiTransferSize);
+    int8_t spiTransferError;
+#ifdef SPI_TRACE
+    uint16_t spiTraceStart;
+#endif
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    spi_blocking_begin();
+#ifdef SPI_TRACE
+    spiTraceStart = TA1R;
+#endif
+#ifdef SPI_USE_DMA
+    spiTransferError = DRV_SPI_TransferDataDma(spiSlaveDeviceIndex, SpiTxData, SpiRxData, spiTransferSize, NULL);
+    if (!spiTransferError)
+        DRV_SPI_TransferWait();
+#else
+	spiTransferError = spi_master_transfer(spiSlaveDeviceIndex, SpiTxData, SpiRxData, spiTransferSize);
+#endif
+#ifdef SPI_TRACE
+    spi_trace_record(SpiTxData, spiTransferSize, spiTransferSize, spiTraceStart);
+#endif
+    spi_blocking_end();
+    return spiTransferError;
+}
+
+int8_t DRV_SPI_TransferDataRead(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize, uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+#ifdef SPI_TRACE
+    uint16_t spiTraceStart;
+#endif
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    spi_blocking_begin();
+#ifdef SPI_TRACE
+    spiTraceStart = TA1R;
+#endif
+    spi_device_select(spiSlaveDeviceIndex);
+    spi_master_write(SpiTxHeader, headerSize);
+    spi_master_write_end();
+    spi_master_read(SpiRxData, spiTransferSize);
+    spi_device_deselect(spiSlaveDeviceIndex);
+#ifdef SPI_TRACE
+    spi_trace_record(SpiTxHeader, headerSize, headerSize + spiTransferSize, spiTraceStart);
+#endif
+    spi_blocking_end();
+    return 0;
+}
+
+int8_t DRV_SPI_TransferDataWrite(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize, const uint8_t *SpiTxData, uint16_t spiTransferSize)
+{
+#ifdef SPI_TRACE
+    uint16_t spiTraceStart;
+#endif
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    spi_blocking_begin();
+#ifdef SPI_TRACE
+    spiTraceStart = TA1R;
+#endif
+    spi_device_select(spiSlaveDeviceIndex);
+    spi_master_write(SpiTxHeader, headerSize);
+    if (SpiTxData != NULL)
+        spi_master_write(SpiTxData, spiTransferSize);
+    spi_master_write_end();
+    spi_device_deselect(spiSlaveDeviceIndex);
+#ifdef SPI_TRACE
+    spi_trace_record(SpiTxHeader, headerSize, headerSize + spiTransferSize, spiTraceStart);
+#endif
+    spi_blocking_end();
+    return 0;
+}
+
+int8_t DRV_SPI_TransferWriteBegin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize)
+{
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    spi_stream_begin(spiSlaveDeviceIndex, SpiTxHeader, headerSize);
+    return 0;
+}
+
+void DRV_SPI_TransferWriteContinue(const uint8_t *SpiTxData, uint16_t spiTransferSize)
+{
+    if (SpiTxData == NULL)
+    {
+        DRV_SPI_TransferWriteFill(SPI_DUMMY_BYTE, spiTransferSize);
+        return;
+    }
+#ifdef SPI_TRACE
+    spiStreamSize += spiTransferSize;
+#endif
+    spi_master_write(SpiTxData, spiTransferSize);
+}
+
+void DRV_SPI_TransferWriteFill(uint8_t value, uint16_t spiTransferSize)
+{
+#ifdef SPI_TRACE
+    spiStreamSize += spiTransferSize;
+#endif
+#ifdef SPI_USE_DMA
+    if (spiTransferSize >= SPI_DMA_MIN_SIZE)
+    {
+        spi_dma_segment(&value, 0, NULL, spiTransferSize);
+        return;
+    }
+#endif
+    while (spiTransferSize--)
+    {
+        while (!(UCA0IFG & UCTXIFG));
+        UCA0TXBUF = value;
+    }
+}
+
+void DRV_SPI_TransferWriteEnd(void)
+{
+    spi_master_write_end();
+    spi_stream_end();
+}
+
+int8_t DRV_SPI_TransferReadBegin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize)
+{
+    if (spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -1;
+    spi_stream_begin(spiSlaveDeviceIndex, SpiTxHeader, headerSize);
+    spi_master_write_end();
+    return 0;
+}
+
+void DRV_SPI_TransferReadContinue(uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+#ifdef SPI_TRACE
+    spiStreamSize += spiTransferSize;
+#endif
+    if (SpiRxData != NULL)
+    {
+        spi_master_read(SpiRxData, spiTransferSize);
+        return;
+    }
+#ifdef SPI_USE_DMA
+    if (spiTransferSize >= SPI_DMA_MIN_SIZE)
+    {
+        spi_dma_segment(&spiDmaDummy, 0, NULL, spiTransferSize);
+        return;
+    }
+#endif
+    while (spiTransferSize--)
+    {
+        UCA0TXBUF = SPI_DUMMY_BYTE;
+        while (!(UCA0IFG & UCRXIFG));
+        (void) UCA0RXBUF;
+    }
+}
+
+void DRV_SPI_TransferReadEnd(void)
+{
+    spi_stream_end();
+}
+
+int8_t DRV_SPI_TransferDataDma(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize, DRV_SPI_TRANSFER_CALLBACK callback)
+{
+    if (spiDmaBusy || (DRV_SPI_TransactionQueueCount() && !spiBlockingActive))
+        return -1;
+    if (spiTransferSize == 0 || spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -2;
+
+    spiDmaBusy = 1;
+    spiDmaDeviceIndex = spiSlaveDeviceIndex;
+    spiDmaCallback = callback;
+
+    DMA0CTL &= ~DMAEN;
+    DMA1CTL &= ~DMAEN;
+    // Assert CS (and switch clock/mode) before arming, a UCSWRST cycle would fire the TX trigger
+    spi_device_select(spiSlaveDeviceIndex);
+    spi_dma_start(SpiTxData, 1, SpiRxData, spiTransferSize);
+    return 0;
+}
+
+// Arm both channels for a transfer on the selected device and send its first byte
+// txIncrement 0 repeats *SpiTxData; a NULL SpiRxData drops what comes back
+static void spi_dma_start(const uint8_t *SpiTxData, uint8_t txIncrement, uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+    DMA0CTL &= ~DMAEN;
+    DMA1CTL &= ~DMAEN;
+    // Channel 0 (highest priority) drains RX so UCA0RXBUF never overruns
+    // Channel 1 feeds TX
+    DMACTL0 = (SPI_DMA_TRIGGER_UCA0RXIFG | (SPI_DMA_TRIGGER_UCA0TXIFG << 8));
+    // Triggers are edge sensitive: drop any stale RX flag from a polled transfer
+    UCA0IFG &= ~UCRXIFG;
+
+    // Channel 0: UCA0RXBUF -> SpiRxData[0..n-1], interrupt on the last byte
+    __data16_write_addr((unsigned short) &DMA0SA, (unsigned long) &UCA0RXBUF);
+    __data16_write_addr((unsigned short) &DMA0DA, (unsigned long) (SpiRxData != NULL ? SpiRxData : &spiDmaSink));
+    DMA0SZ = spiTransferSize;
+    DMA0CTL = (DMADT_0|(SpiRxData != NULL ? DMADSTINCR_3 : DMADSTINCR_0)|DMASRCINCR_0|DMADSTBYTE|DMASRCBYTE|DMAIE|DMAEN);
+
+    // Channel 1: SpiTxData[1..n-1] -> UCA0TXBUF, byte 0 is written below to start the chain
+    if (spiTransferSize > 1)
+    {
+        __data16_write_addr((unsigned short) &DMA1SA, (unsigned long) (SpiTxData + txIncrement));
+        __data16_write_addr((unsigned short) &DMA1DA, (unsigned long) &UCA0TXBUF);
+        DMA1SZ = spiTransferSize - 1;
+        DMA1CTL = (DMADT_0|DMADSTINCR_0|(txIncrement ? DMASRCINCR_3 : DMASRCINCR_0)|DMADSTBYTE|DMASRCBYTE|DMAEN);
+    }
+
+    // Kick off the first byte; every following TXIFG edge triggers channel 1
+    while (!(UCA0IFG & UCTXIFG));
+    UCA0TXBUF = SpiTxData[0];
+}
+
+#ifdef SPI_USE_DMA
+// Payload of a transfer that already holds the bus and CS (split and streamed transfers)
+// Sleeps in LPM0 until the last byte is in; CS stays asserted
+static void spi_dma_segment(const uint8_t *SpiTxData, uint8_t txIncrement, uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+    // Polled bytes before it have to be through, their RX flag would trigger channel 0
+    spi_master_write_end();
+    spiDmaBusy = 1;
+    spiDmaSegment = 1;
+    spi_dma_start(SpiTxData, txIncrement, SpiRxData, spiTransferSize);
+    DRV_SPI_TransferWait();
+}
+#endif
+
+uint8_t DRV_SPI_TransferBusy(void) {return spiDmaBusy;}
+
+void DRV_SPI_TransferWait(void)
+{
+    unsigned short interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    while (spiDmaBusy)
+    {
+        // GIE and LPM0 are set in the same instruction so the DMA ISR can't slip in between
+        __bis_SR_register(LPM0_bits|GIE);
+        __disable_interrupt();
+    }
+    __set_interrupt_state(interruptState);
 }
 
-int8_t spi_master_transfer(uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize)
+DRV_SPI_TRANSACTION_HANDLE DRV_SPI_TransactionSubmit(DRV_SPI_TRANSACTION* transaction)
+{
+    DRV_SPI_TRANSACTION_HANDLE handle;
+    unsigned short interruptState;
+
+    if (transaction->headerSize > DRV_SPI_TRANSACTION_HEADER_LENGTH)
+        return -2;
+    if (transaction->headerSize + transaction->dataSize == 0)
+        return -2;
+    if (transaction->spiSlaveDeviceIndex >= DRV_CANFDSPI_INDEX_COUNT)
+        return -2;
+
+    interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    if (DRV_SPI_TransactionQueueCount() >= DRV_SPI_TRANSACTION_QUEUE_LENGTH)
+    {
+        __set_interrupt_state(interruptState);
+        return -1;
+    }
+    handle = spiQueueHead;
+    spiQueue[handle % DRV_SPI_TRANSACTION_QUEUE_LENGTH] = *transaction;
+    spiQueueHead = (spiQueueHead + 1) & SPI_QUEUE_SEQUENCE_MASK;
+    // Start the engine if it was idle
+    if (DRV_SPI_TransactionQueueCount() == 1 && !spiBlockingActive && !spiDmaBusy)
+        spi_queue_start();
+    __set_interrupt_state(interruptState);
+    return handle;
+}
+
+DRV_SPI_TRANSACTION_STATUS DRV_SPI_TransactionStatusGet(DRV_SPI_TRANSACTION_HANDLE handle)
+{
+    uint16_t age = (handle - spiQueueTail) & SPI_QUEUE_SEQUENCE_MASK;
+    if (age >= DRV_SPI_TransactionQueueCount())
+        return DRV_SPI_TRANSACTION_COMPLETE;
+    return (age == 0) ? DRV_SPI_TRANSACTION_ACTIVE : DRV_SPI_TRANSACTION_QUEUED;
+}
+
+uint8_t DRV_SPI_TransactionQueueCount(void) {return (spiQueueHead - spiQueueTail) & SPI_QUEUE_SEQUENCE_MASK;}
+
+void DRV_SPI_TransactionQueueFlush(void) {spi_queue_wait_idle(0);}
+
+// Claim the bus for a blocking transfer: let queued transactions finish, then hold the queue off
+static void spi_blocking_begin(void) {spi_queue_wait_idle(1);}
+
+// Give the bus back; an ISR may have submitted work (or UART bytes) while we owned it
+static void spi_blocking_end(void)
+{
+    unsigned short interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    spiBlockingActive = 0;
+    if (DRV_SPI_TransactionQueueCount())
+        spi_queue_start();
+    else
+        spi_bus_idle();
+    __set_interrupt_state(interruptState);
+}
+
+// Sleep until the queue drains; with hold set, the blocking path claims the bus before interrupts come back
+static void spi_queue_wait_idle(uint8_t hold)
+{
+    unsigned short interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    while (DRV_SPI_TransactionQueueCount())
+    {
+        __bis_SR_register(LPM0_bits|GIE);
+        __disable_interrupt();
+    }
+    if (hold)
+        spiBlockingActive = 1;
+    __set_interrupt_state(interruptState);
+}
+
+void DRV_SPI_BusCapture(DRV_SPI_BUS_MODE mode)
+{
+    SPI_BUS_IMAGE* image = &spiBusImages[mode];
+    image->ctlw0 = UCA0CTLW0 & ~UCSWRST;
+    image->brw = UCA0BRW;
+    image->mctlw = UCA0MCTLW;
+    image->statw = UCA0STATW & UCLISTEN;
+    image->sel0 = P2SEL0 & SPI_BUS_PINS;
+    image->sel1 = P2SEL1 & SPI_BUS_PINS;
+    image->valid = 1;
+    spiBusMode = mode;
+}
+
+DRV_SPI_BUS_MODE DRV_SPI_BusMode(void) {return spiBusMode;}
+
+uint16_t DRV_SPI_UartWrite(const uint8_t* data, uint16_t size)
+{
+    uint16_t written = 0;
+    unsigned short interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    while (written < size && ((spiUartHead + 1) & SPI_UART_BUFFER_MASK) != spiUartTail)
+    {
+        spiUartBuffer[spiUartHead] = data[written++];
+        spiUartHead = (spiUartHead + 1) & SPI_UART_BUFFER_MASK;
+    }
+    spi_bus_idle();
+    __set_interrupt_state(interruptState);
+    return written;
+}
+
+void DRV_SPI_UartFlush(void)
+{
+    unsigned short interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    if (!(interruptState & GIE) && !spiBlockingActive && !spiDmaBusy && !DRV_SPI_TransactionQueueCount()
+        && spiBusImages[DRV_SPI_BUS_UART].valid)
+    {
+        // The caller has interrupts off, so don't open a window for the ISR: feed UCA0TXBUF by polling
+        spi_bus_switch(DRV_SPI_BUS_UART);
+        UCA0IE &= ~UCTXIE;
+        while (spiUartHead != spiUartTail)
+        {
+            while ((UCA0IFG & UCTXIFG) == 0);
+            UCA0TXBUF = spiUartBuffer[spiUartTail];
+            spiUartTail = (spiUartTail + 1) & SPI_UART_BUFFER_MASK;
+        }
+    }
+    while (spiUartHead != spiUartTail && spiBusImages[DRV_SPI_BUS_UART].valid)
+    {
+        __bis_SR_register(LPM0_bits|GIE);
+        __disable_interrupt();
+    }
+    __set_interrupt_state(interruptState);
+    // The last byte is still in the shift register
+    while (spiBusMode == DRV_SPI_BUS_UART && (UCA0STATW & UCBUSY));
+}
+
+void DRV_SPI_UartSelect(void)
+{
+    unsigned short interruptState;
+    spi_queue_wait_idle(0);
+    DRV_SPI_TransferWait();
+    interruptState = __get_interrupt_state();
+    __disable_interrupt();
+    spi_bus_switch(DRV_SPI_BUS_UART);
+    if (spiUartHead != spiUartTail)
+        UCA0IE |= UCTXIE;
+    __set_interrupt_state(interruptState);
+}
+
+void DRV_SPI_UartClockConfigure(uint16_t brw, uint16_t mctlw)
+{
+    uint16_t ctlw0;
+    spiBusImages[DRV_SPI_BUS_UART].brw = brw;
+    spiBusImages[DRV_SPI_BUS_UART].mctlw = mctlw;
+    if (spiBusMode != DRV_SPI_BUS_UART)
+        return;
+    ctlw0 = UCA0CTLW0;
+    UCA0CTLW0 |= UCSWRST;
+    UCA0BRW = brw;
+    UCA0MCTLW = mctlw;
+    UCA0CTLW0 = ctlw0;
+}
+
+#ifdef SPI_TRACE
+// Cycles cover the bus transfer only, not the wait for the queue
+static void spi_trace_record(const uint8_t *header, uint16_t headerSize, uint16_t size, uint16_t start)
+{
+    DRV_SPI_TRACE_RECORD* record = &spiTrace[spiTraceCount % DRV_SPI_TRACE_LENGTH];
+    record->cycles = TA1R - start;
+    record->header = (uint16_t) header[0] << 8;
+    if (headerSize > 1)
+        record->header |= header[1];
+    record->size = size;
+    spiTraceCount++;
+}
+
+void DRV_SPI_TraceReset(void)
+{
+    spiTraceCount = 0;
+    TA1CTL = (TASSEL__SMCLK|MC__CONTINUOUS|TACLR);
+}
+
+uint16_t DRV_SPI_TraceCount(void) {return spiTraceCount;}
+
+uint8_t DRV_SPI_TraceDump(DRV_SPI_TRACE_RECORD* records, uint8_t maxRecords)
+{
+    uint16_t first = 0;
+    uint8_t n = 0;
+    if (spiTraceCount > DRV_SPI_TRACE_LENGTH)
+        first = spiTraceCount - DRV_SPI_TRACE_LENGTH;
+    while (first + n < spiTraceCount && n < maxRecords)
+    {
+        records[n] = spiTrace[(first + n) % DRV_SPI_TRACE_LENGTH];
+        n++;
+    }
+    return n;
+}
+
+// Queue a 16 bit value as 4 hex digits
+static void spi_trace_write_hex(uint16_t value, uint8_t separator)
+{
+    uint8_t text[5];
+    for (int8_t i = 3; i >= 0; i--)
+    {
+        text[i] = "0123456789ABCDEF"[value & 0xF];
+        value >>= 4;
+    }
+    text[4] = separator;
+    for (uint8_t i = 0; i < sizeof(text);)
+        i += DRV_SPI_UartWrite(&text[i], sizeof(text) - i);
+}
+
+void DRV_SPI_TraceDumpUart(void)
+{
+    DRV_SPI_TRACE_RECORD record;
+    uint16_t count = spiTraceCount;
+    uint16_t first = (count > DRV_SPI_TRACE_LENGTH) ? count - DRV_SPI_TRACE_LENGTH : 0;
+    for (; first < count; first++)
+    {
+        // Copy first, a transfer from an ISR may overwrite the slot mid-line
+        record = spiTrace[first % DRV_SPI_TRACE_LENGTH];
+        spi_trace_write_hex(record.header, ',');
+        spi_trace_write_hex(record.size, ',');
+        spi_trace_write_hex(record.cycles, '\n');
+    }
+}
+#endif
+
+// Clock out the byte at the current position of the transaction at the tail
+static void spi_queue_transmit(DRV_SPI_TRANSACTION* t)
+{
+    uint16_t position = spiQueuePosition;
+    if (position < t->headerSize)
+        UCA0TXBUF = t->header[position];
+    else if (t->txData != NULL)
+        UCA0TXBUF = t->txData[position - t->headerSize];
+    else
+        UCA0TXBUF = 0;
+}
+
+// Assert CS for the transaction at the tail and send its first byte; the RX interrupt does the rest
+static void spi_queue_start(void)
+{
+    DRV_SPI_TRANSACTION* t = &spiQueue[spiQueueTail % DRV_SPI_TRANSACTION_QUEUE_LENGTH];
+    spiQueuePosition = 0;
+    spi_device_select(t->spiSlaveDeviceIndex);
+    UCA0IFG &= ~UCRXIFG;
+    UCA0IE |= UCRXIE;
+    while (!(UCA0IFG & UCTXIFG));
+    spi_queue_transmit(t);
+}
+
+int8_t spi_master_transfer(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize)
 {
 	unsigned int position = 0;
-	P2OUT &= ~(BIT2);
+	spi_device_select(spiSlaveDeviceIndex);
 	while(position < spiTransferSize)
 	{
 	    transmitMasterSPI(SpiTxData[position]);
 	    receiveMasterSPI(SpiRxData, position);
 	    position++;
 	}
-	P2OUT |= (BIT2);
+	spi_device_deselect(spiSlaveDeviceIndex);
 	return 0;
 }
 
+// Claim the bus, assert CS and clock out the header of a streamed transfer
+static void spi_stream_begin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize)
+{
+    spi_blocking_begin();
+#ifdef SPI_TRACE
+    spiStreamTraceStart = TA1R;
+    spiStreamHeader = (uint16_t) SpiTxHeader[0] << 8;
+    if (headerSize > 1)
+        spiStreamHeader |= SpiTxHeader[1];
+    spiStreamSize = headerSize;
+#endif
+    spiStreamDeviceIndex = spiSlaveDeviceIndex;
+    spi_device_select(spiSlaveDeviceIndex);
+    spi_master_write(SpiTxHeader, headerSize);
+}
+
+// Release CS and the bus once the last byte is through, the whole stream is one trace record
+static void spi_stream_end(void)
+{
+#ifdef SPI_TRACE
+    DRV_SPI_TRACE_RECORD* record = &spiTrace[spiTraceCount % DRV_SPI_TRACE_LENGTH];
+#endif
+    spi_device_deselect(spiStreamDeviceIndex);
+#ifdef SPI_TRACE
+    record->cycles = TA1R - spiStreamTraceStart;
+    record->header = spiStreamHeader;
+    record->size = spiStreamSize;
+    spiTraceCount++;
+#endif
+    spi_blocking_end();
+}
+
+// Clock out bytes without looking at what comes back
+static void spi_master_write(const uint8_t *SpiTxData, uint16_t spiTransferSize)
+{
+#ifdef SPI_USE_DMA
+    if (spiTransferSize >= SPI_DMA_MIN_SIZE)
+    {
+        spi_dma_segment(SpiTxData, 1, NULL, spiTransferSize);
+        return;
+    }
+#endif
+    while (spiTransferSize--)
+    {
+        while (!(UCA0IFG & UCTXIFG));
+        UCA0TXBUF = *SpiTxData++;
+    }
+}
+
+// Wait for the last byte to leave, then drop the byte (and overrun) left in RXBUF
+static void spi_master_write_end(void)
+{
+    while (UCA0STATW & UCBUSY);
+    // Reading RXBUF clears UCRXIFG and UCOE
+    (void) UCA0RXBUF;
+}
+
+// Clock in bytes with a constant dummy, no source buffer
+// One byte in flight at a time, so TXBUF is always empty when written
+static void spi_master_read(uint8_t *SpiRxData, uint16_t spiTransferSize)
+{
+#ifdef SPI_USE_DMA
+    if (spiTransferSize >= SPI_DMA_MIN_SIZE)
+    {
+        spi_dma_segment(&spiDmaDummy, 0, SpiRxData, spiTransferSize);
+        return;
+    }
+#endif
+    while (spiTransferSize--)
+    {
+        UCA0TXBUF = SPI_DUMMY_BYTE;
+        while (!(UCA0IFG & UCRXIFG));
+        *SpiRxData++ = UCA0RXBUF;
+    }
+}
+
+// DMA, Interrupt Handler
+#pragma vector = DMA_VECTOR
+__interrupt void DMA_ISR(void)
+{
+    switch (__even_in_range(DMAIV, DMAIV_DMA2IFG))
+    {
+        case DMAIV_DMA0IFG:
+            // Last byte received, the transfer is finished on the bus
+            spiDmaBusy = 0;
+            if (spiDmaSegment)
+            {
+                // spi_dma_segment keeps CS and the bus
+                spiDmaSegment = 0;
+                __bic_SR_register_on_exit(LPM0_bits);
+                break;
+            }
+            spi_device_deselect(spiDmaDeviceIndex);
+            if (spiDmaCallback != NULL)
+                spiDmaCallback(spiDmaDeviceIndex);
+            // Run anything that was queued while DMA owned the bus
+            if (!spiBlockingActive && DRV_SPI_TransactionQueueCount())
+                spi_queue_start();
+            else
+                spi_bus_idle();
+            __bic_SR_register_on_exit(LPM0_bits);
+            break;
+        default:
+            break;
+    }
+}
+
+// eUSCI_A0, Interrupt Handler (transaction queue, UART telemetry)
+#pragma vector = USCI_A0_VECTOR
+__interrupt void USCI_A0_ISR(void)
+{
+    DRV_SPI_TRANSACTION* t;
+    uint16_t position;
+    uint8_t rxByte;
+
+    switch (__even_in_range(UCA0IV, USCI_UART_UCTXCPTIFG))
+    {
+        case USCI_SPI_UCRXIFG:
+            t = &spiQueue[spiQueueTail % DRV_SPI_TRANSACTION_QUEUE_LENGTH];
+            position = spiQueuePosition;
+            rxByte = UCA0RXBUF;
+            if (position >= t->headerSize && t->rxData != NULL)
+                t->rxData[position - t->headerSize] = rxByte;
+            spiQueuePosition = ++position;
+            if (position < t->headerSize + t->dataSize)
+            {
+                spi_queue_transmit(t);
+                break;
+            }
+            // Transaction done: release CS, report, move on to the next one
+            spi_device_deselect(t->spiSlaveDeviceIndex);
+            if (t->callback != NULL)
+                t->callback(t);
+            spiQueueTail = (spiQueueTail + 1) & SPI_QUEUE_SEQUENCE_MASK;
+            if (DRV_SPI_TransactionQueueCount())
+                spi_queue_start();
+            else
+            {
+                UCA0IE &= ~UCRXIE;
+                spi_bus_idle();
+                __bic_SR_register_on_exit(LPM0_bits);
+            }
+            break;
+        case USCI_UART_UCTXIFG:
+            // Only enabled in UART mode, by spi_bus_idle
+            if (spiUartTail != spiUartHead)
+            {
+                UCA0TXBUF = spiUartBuffer[spiUartTail];
+                spiUartTail = (spiUartTail + 1) & SPI_UART_BUFFER_MASK;
+            }
+            else
+            {
+                // Reading UCA0IV cleared UCTXIFG although TXBUF is empty; set it back, or the next
+                // UartWrite (UCTXIE) or polled UartFlush would wait for it forever
+                UCA0IE &= ~UCTXIE;
+                UCA0IFG |= UCTXIFG;
+                __bic_SR_register_on_exit(LPM0_bits);
+            }
+            break;
+        default:
+            break;
+    }
+}
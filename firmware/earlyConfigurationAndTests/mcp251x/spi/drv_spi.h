@@ -3,6 +3,7 @@
 
 // Include files
 #include <stdint.h>
+#include <stddef.h>
 #include <msp430.h>
 #include <msp430fr5738.h>
 
@@ -11,19 +12,227 @@
 #define DRV_CANFDSPI_INDEX_0         0
 #define DRV_CANFDSPI_INDEX_1         1
 
+// Number of MCP25xxFD driven from this MCU; each one gets its own CS descriptor and driver buffers
+// Set to 2 to drive a second controller (CS on PJ.1)
+#ifndef DRV_CANFDSPI_INDEX_COUNT
+#define DRV_CANFDSPI_INDEX_COUNT     1
+#endif
+
 // Index to SPI channel
 // Used when multiple MCP25xxFD are connected to the same SPI interface, but with different CS
-#define SPI_DEFAULT_BUFFER_LENGTH 96
+// Driver buffer per controller, TX and RX: the longest transfer built in one is a READ_CRC of a whole
+// object (3 command bytes, 12 byte header, 64 data bytes, 2 CRC bytes), rounded up to a word
+#define SPI_DEFAULT_BUFFER_LENGTH 84
+
+// Move transfers through the DMA engine: DRV_SPI_TransferData whole, the split and streamed transfers
+// their payload (from SPI_DMA_MIN_SIZE bytes). The CPU sleeps in LPM0 while the bytes move instead of
+// spinning on UCA0IFG
+//#define SPI_USE_DMA
+
+// Record every DRV_SPI_TransferData call (instruction, address, size, SMCLK cycles) in a RAM ring
+// Timer A1 runs from SMCLK as the cycle counter; nothing is compiled in when left undefined
+//#define SPI_TRACE
+
+//! Per-controller SPI descriptor: chip select pin, SCK divider and clock mode
+
+typedef struct {
+    volatile uint8_t *csOut;    // PxOUT of the chip select
+    volatile uint8_t *csDir;    // PxDIR of the chip select
+    uint8_t csPin;
+    uint16_t clockDivider;      // UCA0BRW, 0 follows the clock profile (DRV_SPI_ClockConfigure)
+    uint16_t mode;              // UCA0CTLW0 UCCKPH/UCCKPL/UCMSB bits
+} DRV_SPI_DEVICE;
+
+//! SPI transfer completion callback, called from the DMA ISR
+
+typedef void (*DRV_SPI_TRANSFER_CALLBACK)(uint8_t spiSlaveDeviceIndex);
+
+// Transaction queue
+// Transactions are copied into the queue on submit and run back-to-back by the eUSCI_A0 ISR
+#define DRV_SPI_TRANSACTION_QUEUE_LENGTH 4
+#define DRV_SPI_TRANSACTION_HEADER_LENGTH 3
+
+typedef struct _DRV_SPI_TRANSACTION DRV_SPI_TRANSACTION;
+
+//! SPI transaction completion hook, called from the eUSCI_A0 ISR
+
+typedef void (*DRV_SPI_TRANSACTION_CALLBACK)(DRV_SPI_TRANSACTION* transaction);
+
+//! SPI transaction handle, negative on submit error
+
+typedef int16_t DRV_SPI_TRANSACTION_HANDLE;
+
+//! SPI transaction descriptor
+//! header bytes (command/address) are clocked out first, followed by dataSize data bytes
+//! txData == NULL clocks out zeros, rxData == NULL discards what is received
+
+struct _DRV_SPI_TRANSACTION {
+    uint8_t spiSlaveDeviceIndex;
+    uint8_t header[DRV_SPI_TRANSACTION_HEADER_LENGTH];
+    uint8_t headerSize;
+    uint8_t *txData;
+    uint8_t *rxData;
+    uint16_t dataSize;
+    DRV_SPI_TRANSACTION_CALLBACK callback;
+    void *context;
+};
+
+typedef enum {
+    DRV_SPI_TRANSACTION_QUEUED,
+    DRV_SPI_TRANSACTION_ACTIVE,
+    DRV_SPI_TRANSACTION_COMPLETE
+} DRV_SPI_TRANSACTION_STATUS;
+
+// UCA0 arbitration
+// eUSCI_A0 and P2.0/P2.1 are shared by SPI (MCP25xxFD) and UART (logging)
+// SPI always wins; queued UART bytes are sent while SPI is idle
+#define DRV_SPI_UART_BUFFER_LENGTH 32
+
+typedef enum {
+    DRV_SPI_BUS_SPI,
+    DRV_SPI_BUS_UART,
+    DRV_SPI_BUS_NONE
+} DRV_SPI_BUS_MODE;
+
+#ifdef SPI_TRACE
+// Trace ring, the oldest record is overwritten when full
+#define DRV_SPI_TRACE_LENGTH 16
+
+//! One DRV_SPI_TransferData call: first two bytes sent, bytes clocked and SMCLK cycles spent
+
+typedef struct {
+    uint16_t header;    // instruction nibble (bits 15:12) and address (bits 11:0)
+    uint16_t size;
+    uint16_t cycles;
+} DRV_SPI_TRACE_RECORD;
+
+#define DRV_SPI_TRACE_INSTRUCTION(record)   ((record)->header >> 12)
+#define DRV_SPI_TRACE_ADDRESS(record)       ((record)->header & 0x0FFF)
+#endif
 
 //! SPI Initialization
 
 void DRV_SPI_Initialize(void);
 
+//! Replace the descriptor of one controller; call before DRV_SPI_Initialize
+
+int8_t DRV_SPI_DeviceConfigure(uint8_t spiSlaveDeviceIndex, const DRV_SPI_DEVICE* device);
+
+//! SPI Clock
+//! Recompute the UCA0BRW divider for a new SMCLK; applied on the next initializeSPI or by the caller
+
+void DRV_SPI_ClockConfigure(uint32_t smclkHz);
+uint16_t DRV_SPI_ClockDivider(void);
+
 //! SPI Read/Write Transfer
 
 void initializeSPI();
-void transmitMasterSPI(unsigned int* data);
-void receiveMasterSPI(unsigned int rxData, unsigned int position);
+void transmitMasterSPI(unsigned int txData);
+void receiveMasterSPI(uint8_t *rxData, unsigned int position);
 int8_t DRV_SPI_TransferData(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize);
 
+//! SPI Read Transfer
+//! Clocks out the header, then spiTransferSize dummy bytes; only the bytes after the header are stored
+
+int8_t DRV_SPI_TransferDataRead(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize, uint8_t *SpiRxData, uint16_t spiTransferSize);
+
+//! SPI Write Transfer
+//! Clocks out the header followed by SpiTxData (may be NULL); nothing is received
+
+int8_t DRV_SPI_TransferDataWrite(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize, const uint8_t *SpiTxData, uint16_t spiTransferSize);
+
+//! SPI Streamed Write Transfer
+//! Begin asserts CS and clocks out the header, every Continue appends bytes (NULL clocks out zeros),
+//! Fill appends one value repeated, End releases CS. The bus stays claimed in between, so keep the
+//! calls back-to-back.
+
+int8_t DRV_SPI_TransferWriteBegin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize);
+void DRV_SPI_TransferWriteContinue(const uint8_t *SpiTxData, uint16_t spiTransferSize);
+void DRV_SPI_TransferWriteFill(uint8_t value, uint16_t spiTransferSize);
+void DRV_SPI_TransferWriteEnd(void);
+
+//! SPI Streamed Read Transfer
+//! Same as the streamed write, but Continue clocks bytes in (NULL drops them). Lets the caller decide
+//! how much to read next from what it already has, all under one CS assertion.
+
+int8_t DRV_SPI_TransferReadBegin(uint8_t spiSlaveDeviceIndex, const uint8_t *SpiTxHeader, uint16_t headerSize);
+void DRV_SPI_TransferReadContinue(uint8_t *SpiRxData, uint16_t spiTransferSize);
+void DRV_SPI_TransferReadEnd(void);
+
+//! SPI DMA Transfer
+//! Starts the transfer and returns; CS is released and callback is called once the last byte is received
+
+int8_t DRV_SPI_TransferDataDma(uint8_t spiSlaveDeviceIndex, uint8_t *SpiTxData, uint8_t *SpiRxData, uint16_t spiTransferSize, DRV_SPI_TRANSFER_CALLBACK callback);
+
+//! SPI DMA Transfer status, 1 while a DMA transfer is in flight
+
+uint8_t DRV_SPI_TransferBusy(void);
+
+//! Sleep in LPM0 until the DMA transfer in flight completes
+
+void DRV_SPI_TransferWait(void);
+
+//! Queue a SPI transaction; returns its handle, or -1 if the queue is full
+
+DRV_SPI_TRANSACTION_HANDLE DRV_SPI_TransactionSubmit(DRV_SPI_TRANSACTION* transaction);
+
+//! Status of a submitted transaction
+
+DRV_SPI_TRANSACTION_STATUS DRV_SPI_TransactionStatusGet(DRV_SPI_TRANSACTION_HANDLE handle);
+
+//! Number of queued or active transactions
+
+uint8_t DRV_SPI_TransactionQueueCount(void);
+
+//! Sleep in LPM0 until the transaction queue is empty
+
+void DRV_SPI_TransactionQueueFlush(void);
+
+//! Snapshot the current UCA0 configuration as the register image of a mode
+//! initializeSPI and initializeUART call this; UCA0 is then switched by rewriting the image
+
+void DRV_SPI_BusCapture(DRV_SPI_BUS_MODE mode);
+
+//! Mode UCA0 is currently configured for
+
+DRV_SPI_BUS_MODE DRV_SPI_BusMode(void);
+
+//! Queue UART bytes; returns how many fit in the buffer
+//! They are sent from the eUSCI_A0 ISR in the gaps between SPI transfers
+
+uint16_t DRV_SPI_UartWrite(const uint8_t* data, uint16_t size);
+
+//! Sleep in LPM0 until every queued UART byte has been sent
+//! Called with interrupts off (and SPI idle) it sends them by polling instead
+
+void DRV_SPI_UartFlush(void);
+
+//! Wait for SPI to go idle and leave UCA0 in UART mode (for polled reception)
+
+void DRV_SPI_UartSelect(void);
+
+//! Update the UART baud rate registers in its image (and in UCA0 while in UART mode)
+//! Call with the UART buffer flushed
+
+void DRV_SPI_UartClockConfigure(uint16_t brw, uint16_t mctlw);
+
+#ifdef SPI_TRACE
+//! Clear the trace ring and restart the cycle counter
+
+void DRV_SPI_TraceReset(void);
+
+//! Number of calls traced since the last reset, including records already overwritten
+
+uint16_t DRV_SPI_TraceCount(void);
+
+//! Copy up to maxRecords trace records, oldest first; returns how many were copied
+
+uint8_t DRV_SPI_TraceDump(DRV_SPI_TRACE_RECORD* records, uint8_t maxRecords);
+
+//! Send the trace ring over the UART, one "header,size,cycles" hex line per record
+//! spi_trace_report.py turns a capture of these lines into a per-function report
+
+void DRV_SPI_TraceDumpUart(void);
+#endif
+
 #endif	// _DRV_SPI_H
@@ -0,0 +1,94 @@
+# Quick & dirty script -> turns a UART capture of DRV_SPI_TraceDumpUart into a per-function SPI report
+
+# build with SPI_TRACE defined in drv_spi.h, call DRV_SPI_TraceDumpUart() and save the terminal output
+# ex trace line         ------>   '3050,0006,00A2'
+#                                  ^ instruction nibble + 12 bit address, bytes clocked (incl. 2 header bytes), SMCLK cycles
+
+# the driver function is inferred from instruction, address and size; RAM accesses are grouped by direction
+# since TransmitChannelLoad / ReceiveMessageGet / TefMessageGet / RamInit all use the byte array accessors
+
+import sys
+
+trace_capture_file = "./trace.txt"
+smclk_hz = 24000000
+
+instructions = {0x0: "RESET", 0x3: "READ", 0x2: "WRITE", 0xB: "READ_CRC", 0xA: "WRITE_CRC", 0xC: "WRITE_SAFE"}
+
+# MCP2517FD address map (drv_canfdspi_register.h)
+fifo_con = 0x050
+fifo_offset = 12
+fifo_channels = 32
+filter_con = fifo_con + fifo_offset * fifo_channels
+filter_obj = filter_con + fifo_channels
+ram_start = 0x400
+ram_end = 0xC00
+sfr_start = 0xE00
+
+def region(address):
+    if address < 0x040:
+        return "CAN control"
+    if address < fifo_con:
+        return "TEF"
+    if address < filter_con:
+        return "FIFO" + str((address - fifo_con) // fifo_offset)
+    if address < filter_obj:
+        return "filter control"
+    if address < ram_start:
+        return "filter/mask"
+    if address < ram_end:
+        return "RAM"
+    if address >= sfr_start:
+        return "SFR"
+    return "reserved"
+
+def api_function(instruction, address, size):
+    data = size - 2
+    name = instructions.get(instruction, "?")
+    if name == "RESET":
+        return "DRV_CANFDSPI_Reset"
+    if name == "READ_CRC":
+        return "DRV_CANFDSPI_ReadByteArrayWithCRC"
+    if name == "WRITE_CRC":
+        return "DRV_CANFDSPI_WriteByteArrayWithCRC"
+    if name == "WRITE_SAFE":
+        return "DRV_CANFDSPI_WriteWordSafe" if data == 6 else "DRV_CANFDSPI_WriteByteSafe"
+    if name == "READ":
+        if region(address) == "RAM":
+            return "DRV_CANFDSPI_ReadByteArray (RAM)"
+        return {1: "DRV_CANFDSPI_ReadByte", 4: "DRV_CANFDSPI_ReadWord"}.get(data, "DRV_CANFDSPI_ReadWordArray")
+    if name == "WRITE":
+        if region(address) == "RAM":
+            return "DRV_CANFDSPI_WriteByteArray (RAM)"
+        return {1: "DRV_CANFDSPI_WriteByte", 4: "DRV_CANFDSPI_WriteWord"}.get(data, "DRV_CANFDSPI_WriteWordArray")
+    return "unknown"
+
+def parse(line):
+    fields = line.strip().split(",")
+    if len(fields) != 3:
+        return None
+    try:
+        return [int(field, 16) for field in fields]
+    except ValueError:
+        return None
+
+def main():
+    file_name = sys.argv[1] if len(sys.argv) > 1 else trace_capture_file
+    report = {}
+    total_cycles = 0
+    with open(file_name) as file:
+        for line in file.read().splitlines():
+            record = parse(line)
+            if record is None:
+                continue
+            header, size, cycles = record
+            key = (api_function(header >> 12, header & 0x0FFF, size), region(header & 0x0FFF))
+            calls, nbytes, ncycles = report.get(key, (0, 0, 0))
+            report[key] = (calls + 1, nbytes + size, ncycles + cycles)
+            total_cycles += cycles
+    print("%-42s %-15s %6s %7s %9s %8s %6s" % ("function", "region", "calls", "bytes", "cycles", "us/call", "share"))
+    for key, (calls, nbytes, ncycles) in sorted(report.items(), key=lambda item: -item[1][2]):
+        us_per_call = ncycles * 1000000.0 / smclk_hz / calls
+        share = 100.0 * ncycles / total_cycles if total_cycles else 0
+        print("%-42s %-15s %6d %7d %9d %8.1f %5.1f%%" % (key[0], key[1], calls, nbytes, ncycles, us_per_call, share))
+
+main()
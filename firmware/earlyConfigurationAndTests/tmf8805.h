@@ -115,12 +115,12 @@
 #define RAM_RESET_KEY                     0x16 // "S 41 W 08 10 00 EF p"
 #define ROM_REMAP_RESET_KEY               0x17 // "S 41 W 08 12 00 ED P"
 
-static unsigned char wakeUpFromStandby[]         = {WRITE, REG_ENABLE,    WAKEUP_FROM_STANDBY_PL};
-static unsigned char putIntoStandby[]            = {WRITE, REG_ENABLE,    PUT_INTO_STANDBY_PL};
-static unsigned char startSerialNumber[]         = {WRITE, REG_SIXTEEN,   START_SERIAL_NUMBER_PL};
-static unsigned char startCalibration[]          = {WRITE, REG_SIXTEEN,   START_CALIBRATION_PL};
-static unsigned char stopApp0[]                  = {WRITE, REG_SIXTEEN,   STOP_APP0_PL};
-static unsigned char calibrateApp0[]             = {WRITE, REG_CALIBRATE, CALIBRATE_APP0_PL_0,
+static const unsigned char wakeUpFromStandby[]         = {WRITE, REG_ENABLE,    WAKEUP_FROM_STANDBY_PL};
+static const unsigned char putIntoStandby[]            = {WRITE, REG_ENABLE,    PUT_INTO_STANDBY_PL};
+static const unsigned char startSerialNumber[]         = {WRITE, REG_SIXTEEN,   START_SERIAL_NUMBER_PL};
+static const unsigned char startCalibration[]          = {WRITE, REG_SIXTEEN,   START_CALIBRATION_PL};
+static const unsigned char stopApp0[]                  = {WRITE, REG_SIXTEEN,   STOP_APP0_PL};
+static const unsigned char calibrateApp0[]             = {WRITE, REG_CALIBRATE, CALIBRATE_APP0_PL_0,
                                                                           CALIBRATE_APP0_PL_1,
                                                                           CALIBRATE_APP0_PL_2,
                                                                           CALIBRATE_APP0_PL_3,
@@ -134,7 +134,7 @@ static unsigned char calibrateApp0[]             = {WRITE, REG_CALIBRATE, CALIBR
                                                                           CALIBRATE_APP0_PL_11,
                                                                           CALIBRATE_APP0_PL_12,
                                                                           CALIBRATE_APP0_PL_13};
-static unsigned char startApp0[]                 = {WRITE, REG_EIGHT,     START_APP0_PL_0,
+static const unsigned char startApp0[]                 = {WRITE, REG_EIGHT,     START_APP0_PL_0,
                                                                           START_APP0_PL_1,
                                                                           START_APP0_PL_2,
                                                                           START_APP0_PL_3,
@@ -143,35 +143,35 @@ static unsigned char startApp0[]                 = {WRITE, REG_EIGHT,     START_
                                                                           START_APP0_PL_6,
                                                                           START_APP0_PL_7,
                                                                           START_APP0_PL_8};
-static unsigned char downloadInit[]              = {WRITE, REG_EIGHT,     DOWNLOAD_INIT_PL_0,
+static const unsigned char downloadInit[]              = {WRITE, REG_EIGHT,     DOWNLOAD_INIT_PL_0,
                                                                           DOWNLOAD_INIT_PL_1,
                                                                           DOWNLOAD_INIT_PL_2,
                                                                           DOWNLOAD_INIT_PL_3};
-static unsigned char setAddressPointer[]         = {WRITE, REG_EIGHT,     SET_ADDRESS_POINTER_PL_0,
+static const unsigned char setAddressPointer[]         = {WRITE, REG_EIGHT,     SET_ADDRESS_POINTER_PL_0,
                                                                           SET_ADDRESS_POINTER_PL_1,
                                                                           SET_ADDRESS_POINTER_PL_2,
                                                                           SET_ADDRESS_POINTER_PL_3,
                                                                           SET_ADDRESS_POINTER_PL_4};
-static unsigned char ramRemapReset[]             = {WRITE, REG_EIGHT,     RAM_REMAP_RESET_PL_0,
+static const unsigned char ramRemapReset[]             = {WRITE, REG_EIGHT,     RAM_REMAP_RESET_PL_0,
                                                                           RAM_REMAP_RESET_PL_1,
                                                                           RAM_REMAP_RESET_PL_2};
-static unsigned char romRemapReset[]             = {WRITE, REG_EIGHT,     ROM_REMAP_RESET_PL_0,
+static const unsigned char romRemapReset[]             = {WRITE, REG_EIGHT,     ROM_REMAP_RESET_PL_0,
                                                                           ROM_REMAP_RESET_PL_1,
                                                                           ROM_REMAP_RESET_PL_2};
-static unsigned char ramReset[]                  = {WRITE, REG_EIGHT,     RAM_RESET_PL_0,
+static const unsigned char ramReset[]                  = {WRITE, REG_EIGHT,     RAM_RESET_PL_0,
                                                                           RAM_RESET_PL_1,
                                                                           RAM_RESET_PL_2};
-static unsigned char discoverRunningApp[]        = {READ,  REG_ZERO,      READ_ONE_BYTE};
-static unsigned char discoverApp0MajorVersion[]  = {READ,  REG_MAJOR,     READ_ONE_BYTE};
-static unsigned char discoverApp0MinorVersion[]  = {READ,  REG_MINOR,     READ_TWO_BYTE};
-static unsigned char discoverIDREVID[]           = {READ,  REG_ID,        READ_TWO_BYTE};
-static unsigned char isSerialNumberReady[]       = {READ,  REG_READY,     READ_ONE_BYTE};
-static unsigned char readSerialNumber[]          = {READ,  REG_SERIAL,    READ_FOUR_BYTE};
-static unsigned char isCpuReady[]                = {READ,  REG_ENABLE,    READ_ONE_BYTE};
-static unsigned char isCalibrationReady[]        = {READ,  REG_READY,     READ_TWO_BYTE};
-static unsigned char readCalibrationData[]       = {READ,  REG_CALIBRATE, READ_FOURTEEN_BYTE};
-static unsigned char readResults[]               = {READ,  REG_RESULTS,   READ_ELEVEN_BYTE};
-static unsigned char readStatus[]                = {READ,  REG_EIGHT,     READ_THREE_BYTE};
+static const unsigned char discoverRunningApp[]        = {READ,  REG_ZERO,      READ_ONE_BYTE};
+static const unsigned char discoverApp0MajorVersion[]  = {READ,  REG_MAJOR,     READ_ONE_BYTE};
+static const unsigned char discoverApp0MinorVersion[]  = {READ,  REG_MINOR,     READ_TWO_BYTE};
+static const unsigned char discoverIDREVID[]           = {READ,  REG_ID,        READ_TWO_BYTE};
+static const unsigned char isSerialNumberReady[]       = {READ,  REG_READY,     READ_ONE_BYTE};
+static const unsigned char readSerialNumber[]          = {READ,  REG_SERIAL,    READ_FOUR_BYTE};
+static const unsigned char isCpuReady[]                = {READ,  REG_ENABLE,    READ_ONE_BYTE};
+static const unsigned char isCalibrationReady[]        = {READ,  REG_READY,     READ_TWO_BYTE};
+static const unsigned char readCalibrationData[]       = {READ,  REG_CALIBRATE, READ_FOURTEEN_BYTE};
+static const unsigned char readResults[]               = {READ,  REG_RESULTS,   READ_ELEVEN_BYTE};
+static const unsigned char readStatus[]                = {READ,  REG_EIGHT,     READ_THREE_BYTE};
 
 int i2cWriteBytesToRegister(const unsigned char i2cAddress, const unsigned char i2cRegister, const unsigned char* payload, int payloadSize);
 int i2cReadBytesFromRegister(unsigned char i2cAddress, unsigned char i2cRegister, unsigned char bytesToRead, unsigned char* dataBack);
@@ -182,7 +182,7 @@ int performRamPatch();
 
 int performWriteSequence(unsigned char sequenceKey)
 {
-    unsigned char *sequence;
+    const unsigned char *sequence;
     int sequenceSize = DEFAULT_WRITE_SEQUENCE_SIZE;
     switch(sequenceKey)
     {
@@ -206,7 +206,7 @@ int performWriteSequence(unsigned char sequenceKey)
 
 int performReadSequence(unsigned char sequenceKey, unsigned char* dataBack)
 {
-    unsigned char *sequence;
+    const unsigned char *sequence;
     switch(sequenceKey)
     {
         case DISCOVER_RUNNING_APP_KEY:          sequence = discoverRunningApp; break;